@@ -0,0 +1,573 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+
+#include "version.hpp"
+#include "DigestTable.hpp"
+#include "FileReader.hpp"
+#include "Hasher.hpp"
+#include "Platform.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if PDCPP_HAS_POSIX_IO
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define PDCPP_BENCH_ARG_FILTER "--filter"
+#define PDCPP_BENCH_ARG_REPETITIONS "--repetitions"
+#define PDCPP_BENCH_ARG_DIGESTBYTES "--digest-bytes"
+#define PDCPP_BENCH_ARG_FILESIZE "--file-size"
+#define PDCPP_BENCH_ARG_DIRECTORY "--dir"
+#define PDCPP_BENCH_ARG_TABLESIZES "--table-sizes"
+#define PDCPP_BENCH_ARG_LIST "--list"
+
+namespace fs = std::filesystem;
+
+namespace {
+    // Message sizes the digest kernel is timed at: a tiny file, the default sample block, a typical
+    // file and the default read buffer
+    const std::vector<std::size_t> kDigestSizes = {64, 4096, 64 * 1024, 1 << 20};
+    // Size of every file of the small-file read benchmark
+    constexpr std::size_t kSmallFileSize = 16 * 1024;
+    // Stride at which read benchmarks touch the delivered data, so mapped pages are faulted in
+    constexpr std::size_t kTouchStride = 4096;
+    // Distinct digests cycled through by the hex encoding benchmark
+    constexpr std::size_t kHexDigests = 64 * 1024;
+    // Encodings timed per repetition of the hex benchmark
+    constexpr std::uint64_t kHexOperations = 1 << 20;
+
+    // Results are folded in here so the compiler cannot drop the work being timed
+    volatile std::uint64_t blackhole = 0;
+
+    /**
+     * @brief Settings of a benchmark run, taken from the command line.
+     */
+    struct BenchOptions {
+        std::string filter;                 // Only benchmarks whose name contains this run
+        unsigned int repetitions = 5;       // Timed repetitions of every benchmark
+        std::size_t digestBytes = 64 << 20; // Bytes hashed per repetition of the digest benchmarks
+        std::size_t fileSize = 64 << 20;    // Size of the large file, and total size of the small files, read
+        std::string directory;              // Where the files of the read benchmarks are created
+        std::vector<std::size_t> tableSizes = {1000000, 10000000}; // Entries of the hash table benchmarks
+        bool list = false;                  // Print the benchmark names instead of running them
+    };
+
+    /**
+     * @brief Escapes a string for a JSON document.
+     */
+    std::string jsonString(const std::string& text) {
+        std::string escaped = "\"";
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped += '\\';
+                escaped += c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                escaped += ' ';
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped + "\"";
+    }
+
+    /**
+     * @brief Fills a buffer with reproducible pseudo-random bytes.
+     */
+    void fillRandom(unsigned char* data, std::size_t length, std::mt19937_64& random) {
+        for (std::size_t i = 0; i < length; i += sizeof(std::uint64_t)) {
+            const std::uint64_t word = random();
+            for (std::size_t b = 0; b < sizeof(word) && i + b < length; ++b) {
+                data[i + b] = static_cast<unsigned char>(word >> (8 * b));
+            }
+        }
+    }
+
+    /**
+     * @brief Generates digests of the given length with random content.
+     */
+    std::vector<Digest> randomDigests(std::size_t count, std::uint8_t length, std::mt19937_64& random) {
+        std::vector<Digest> digests(count);
+        for (auto& digest : digests) {
+            fillRandom(digest.bytes.data(), length, random);
+            digest.length = length;
+        }
+        return digests;
+    }
+
+    /**
+     * @brief Times the repetitions of every selected benchmark and writes one NDJSON record for each.
+     * @details A record holds the work done by one repetition and the minimum, median and mean time
+     *          it took; rates are derived from the median, which shrugs off a disturbed repetition.
+     */
+    class Runner {
+    public:
+        Runner(const BenchOptions& options, std::ostream& out) : options(options), out(out) {
+        }
+
+        bool selected(const std::string& name) const {
+            return options.filter.empty() || name.find(options.filter) != std::string::npos;
+        }
+
+        /**
+         * @brief Runs a benchmark if it is selected.
+         * @param operations Operations performed by one repetition, e.g. messages hashed.
+         * @param bytes Bytes processed by one repetition, zero if throughput is meaningless.
+         * @param repetition The timed work.
+         * @param prepare Untimed work run before every repetition, may be empty.
+         */
+        void run(const std::string& name, std::uint64_t operations, std::uint64_t bytes,
+                 const std::function<void()>& repetition, const std::function<void()>& prepare = nullptr) {
+            if (!selected(name)) {
+                return;
+            }
+            if (options.list) {
+                out << name << '\n';
+                return;
+            }
+            std::vector<double> seconds;
+            for (unsigned int r = 0; r < options.repetitions; ++r) {
+                if (prepare) {
+                    prepare();
+                }
+                const auto start = std::chrono::steady_clock::now();
+                repetition();
+                seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+            }
+            std::vector<double> sorted(seconds);
+            std::sort(sorted.begin(), sorted.end());
+            const double median = sorted.size() % 2 == 1 ? sorted[sorted.size() / 2]
+                    : (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]) / 2;
+            const double mean = std::accumulate(sorted.begin(), sorted.end(), 0.0) / static_cast<double>(sorted.size());
+
+            std::ostringstream record;
+            record.precision(9);
+            record << "{\"type\":\"benchmark\",\"name\":" << jsonString(name)
+                   << ",\"repetitions\":" << seconds.size() << ",\"operations\":" << operations
+                   << ",\"bytes\":" << bytes << ",\"min_seconds\":" << sorted.front()
+                   << ",\"median_seconds\":" << median << ",\"mean_seconds\":" << mean
+                   << ",\"ns_per_operation\":" << (operations > 0 ? median * 1e9 / static_cast<double>(operations) : 0.0);
+            if (bytes > 0) {
+                record << ",\"bytes_per_second\":" << (median > 0 ? static_cast<double>(bytes) / median : 0.0);
+            }
+            record << "}\n";
+            out << record.str() << std::flush;
+        }
+
+        /**
+         * @brief Records a selected benchmark that could not run on this machine.
+         */
+        void skip(const std::string& name, const std::string& reason) {
+            if (!selected(name) || options.list) {
+                return;
+            }
+            out << "{\"type\":\"skipped\",\"name\":" << jsonString(name) << ",\"reason\":" << jsonString(reason)
+                << "}\n" << std::flush;
+        }
+
+    private:
+        const BenchOptions& options;
+        std::ostream& out;
+    };
+
+    /**
+     * @brief Hashes whole messages of each size with every algorithm built in, like the hash tiers do per file.
+     */
+    void benchDigests(Runner& runner, const BenchOptions& options) {
+        std::mt19937_64 random(1);
+        std::vector<unsigned char> buffer(kDigestSizes.back());
+        fillRandom(buffer.data(), buffer.size(), random);
+        for (const auto& algorithm : HashAlgorithm::names()) {
+            for (std::size_t size : kDigestSizes) {
+                const std::uint64_t messages = std::max<std::uint64_t>(1, options.digestBytes / size);
+                Hasher& hasher = HashAlgorithm::byName(algorithm).threadHasher();
+                runner.run("digest/" + algorithm + "/" + std::to_string(size), messages, messages * size, [&]() {
+                    for (std::uint64_t m = 0; m < messages; ++m) {
+                        hasher.update(buffer.data(), size);
+                        blackhole = blackhole ^ hasher.finish().prefix();
+                    }
+                });
+            }
+        }
+    }
+
+    /**
+     * @brief Writes a file of pseudo-random content.
+     */
+    void writeFile(const std::string& path, std::size_t size, std::mt19937_64& random) {
+        std::vector<unsigned char> chunk(std::min<std::size_t>(size, 1 << 20));
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        for (std::size_t written = 0; written < size; written += chunk.size()) {
+            fillRandom(chunk.data(), chunk.size(), random);
+            file.write(reinterpret_cast<const char*>(chunk.data()),
+                       static_cast<std::streamsize>(std::min(chunk.size(), size - written)));
+        }
+        if (!file) {
+            throw std::runtime_error("Cannot write benchmark file " + path);
+        }
+    }
+
+#if PDCPP_HAS_POSIX_IO
+    /**
+     * @brief Drops the pages of a file from the page cache so the next read goes to the device.
+     * @details Dirty pages cannot be dropped, so they are written back first. Has no effect on
+     *          file systems living in memory such as tmpfs.
+     */
+    void evict(const std::string& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open benchmark file " + path);
+        }
+        (void)::fdatasync(fd);
+        (void)::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+#endif
+
+    /**
+     * @brief Reads one large file and many small ones through every backend, from the page cache and cold.
+     */
+    void benchReads(Runner& runner, const BenchOptions& options) {
+        const std::vector<ReadBackend> backends = {ReadBackend::Stream, ReadBackend::Pread, ReadBackend::Mmap};
+        const std::size_t smallFiles = std::max<std::size_t>(1, options.fileSize / kSmallFileSize);
+        bool anySelected = false;
+        for (ReadBackend backend : backends) {
+            for (const char* layout : {"large", "small"}) {
+                for (const char* state : {"cached", "cold"}) {
+                    const std::string name = std::string("read/") + FileReader::backendName(backend) + "/" + state + "/" + layout;
+                    anySelected = anySelected || runner.selected(name);
+                    if (options.list) {
+                        runner.run(name, 0, 0, nullptr);
+                    }
+                }
+            }
+        }
+        if (!anySelected || options.list) {
+            return;
+        }
+
+        const fs::path directory = fs::path(options.directory.empty() ? fs::temp_directory_path().string() : options.directory)
+                / ("rmdup_bench-" + std::to_string(std::random_device()()));
+        fs::create_directories(directory);
+        std::vector<std::string> largePaths = {(directory / "large").string()};
+        std::vector<std::string> smallPaths;
+        std::mt19937_64 random(2);
+        writeFile(largePaths.front(), options.fileSize, random);
+        for (std::size_t i = 0; i < smallFiles; ++i) {
+            smallPaths.push_back((directory / ("small-" + std::to_string(i))).string());
+            writeFile(smallPaths.back(), kSmallFileSize, random);
+        }
+
+        try {
+            for (ReadBackend backend : backends) {
+                const FileReader reader(backend);
+                for (const auto* paths : {&largePaths, &smallPaths}) {
+                    const std::string layout = paths == &largePaths ? "large" : "small";
+                    auto readAll = [&]() {
+                        std::uint64_t sum = 0;
+                        for (const auto& path : *paths) {
+                            reader.readFile(path, [&sum](const unsigned char* data, std::size_t length) {
+                                for (std::size_t i = 0; i < length; i += kTouchStride) {
+                                    sum += data[i];
+                                }
+                            });
+                        }
+                        blackhole = blackhole ^ sum;
+                    };
+                    const std::string prefix = std::string("read/") + FileReader::backendName(backend) + "/";
+                    const std::uint64_t bytes = paths == &largePaths ? options.fileSize : smallFiles * kSmallFileSize;
+
+                    // A first pass fills the page cache for every repetition
+                    if (runner.selected(prefix + "cached/" + layout)) {
+                        readAll();
+                    }
+                    runner.run(prefix + "cached/" + layout, paths->size(), bytes, readAll);
+#if PDCPP_HAS_POSIX_IO
+                    runner.run(prefix + "cold/" + layout, paths->size(), bytes, readAll, [&]() {
+                        for (const auto& path : *paths) {
+                            evict(path);
+                        }
+                    });
+#else
+                    runner.skip(prefix + "cold/" + layout, "the page cache cannot be dropped on this platform");
+#endif
+                }
+            }
+        } catch (...) {
+            fs::remove_all(directory);
+            throw;
+        }
+        fs::remove_all(directory);
+    }
+
+    /**
+     * @brief Encodes digests of the lengths produced by the 256 and 512-bit algorithms as hexadecimal.
+     */
+    void benchHex(Runner& runner) {
+        for (std::uint8_t length : {static_cast<std::uint8_t>(32), static_cast<std::uint8_t>(64)}) {
+            const std::string name = "hex/" + std::to_string(length);
+            if (!runner.selected(name)) {
+                continue;
+            }
+            std::mt19937_64 random(3);
+            const std::vector<Digest> digests = randomDigests(kHexDigests, length, random);
+            runner.run(name, kHexOperations, kHexOperations * length, [&]() {
+                std::uint64_t sum = 0;
+                for (std::uint64_t i = 0; i < kHexOperations; ++i) {
+                    const std::string hex = digests[i % kHexDigests].toHex();
+                    sum += static_cast<unsigned char>(hex[i % hex.size()]);
+                }
+                blackhole = blackhole ^ sum;
+            });
+        }
+    }
+
+    /**
+     * @brief Inserts and looks up random keys in the digest table of the hash tiers and in a size map
+     *        like the one grouping the walked files.
+     * @details Lookups visit the keys in a shuffled order so neither the table nor the key array is
+     *          walked sequentially.
+     */
+    void benchTables(Runner& runner, const BenchOptions& options) {
+        for (std::size_t entries : options.tableSizes) {
+            const std::string count = std::to_string(entries);
+            const std::string digestInsert = "table/digest/insert/" + count;
+            const std::string digestLookup = "table/digest/lookup/" + count;
+            const std::string sizeInsert = "table/size_map/insert/" + count;
+            const std::string sizeLookup = "table/size_map/lookup/" + count;
+            const bool digestSelected = runner.selected(digestInsert) || runner.selected(digestLookup);
+            const bool sizeSelected = runner.selected(sizeInsert) || runner.selected(sizeLookup);
+            if (!digestSelected && !sizeSelected) {
+                continue;
+            }
+            if (entries > UINT32_MAX - 1) {
+                for (const auto& name : {digestInsert, digestLookup, sizeInsert, sizeLookup}) {
+                    runner.skip(name, "more entries than the digest table can index");
+                }
+                continue;
+            }
+
+            try {
+                std::mt19937_64 random(4);
+                std::vector<std::uint32_t> order(entries);
+                std::iota(order.begin(), order.end(), 0);
+                std::shuffle(order.begin(), order.end(), random);
+
+                if (digestSelected) {
+                    const std::vector<Digest> digests = randomDigests(entries, Digest::kMaxSize, random);
+                    DigestTable table(digests);
+                    auto insertAll = [&]() {
+                        table.reset(entries);
+                        for (std::size_t i = 0; i < entries; ++i) {
+                            blackhole = blackhole ^ table.findOrInsert(static_cast<std::uint32_t>(i));
+                        }
+                    };
+                    runner.run(digestInsert, entries, 0, insertAll);
+                    insertAll();
+                    runner.run(digestLookup, entries, 0, [&]() {
+                        std::uint64_t sum = 0;
+                        for (std::uint32_t index : order) {
+                            sum += table.findOrInsert(index);
+                        }
+                        blackhole = blackhole ^ sum;
+                    });
+                }
+
+                if (sizeSelected) {
+                    std::vector<std::uintmax_t> keys(entries);
+                    for (auto& key : keys) {
+                        key = random();
+                    }
+                    std::unordered_map<std::uintmax_t, std::size_t> sizes;
+                    runner.run(sizeInsert, entries, 0, [&]() {
+                        for (std::size_t i = 0; i < entries; ++i) {
+                            sizes.emplace(keys[i], i);
+                        }
+                    }, [&]() {
+                        std::unordered_map<std::uintmax_t, std::size_t>().swap(sizes);
+                    });
+                    if (sizes.size() != entries) {
+                        for (std::size_t i = 0; i < entries; ++i) {
+                            sizes.emplace(keys[i], i);
+                        }
+                    }
+                    runner.run(sizeLookup, entries, 0, [&]() {
+                        std::uint64_t sum = 0;
+                        for (std::uint32_t index : order) {
+                            sum += sizes.find(keys[index])->second;
+                        }
+                        blackhole = blackhole ^ sum;
+                    });
+                }
+            } catch (const std::bad_alloc&) {
+                for (const auto& name : {digestInsert, digestLookup, sizeInsert, sizeLookup}) {
+                    runner.skip(name, "not enough memory");
+                }
+            }
+        }
+    }
+
+    /**
+     * @brief Matches an option that carries a value, given either as "--name=value" or as "--name value"
+     * @throws std::invalid_argument If the option is given without a value
+     */
+    bool matchOptionValue(const std::string& argument, const char* name, int& index, int argc, char* argv[], std::string& value) {
+        const std::string optionName = name;
+        if (argument == optionName) {
+            if (index + 1 >= argc) {
+                throw std::invalid_argument("'" + optionName + "' requires a value.");
+            }
+            value = argv[++index];
+            return true;
+        }
+        if (argument.compare(0, optionName.size() + 1, optionName + "=") == 0) {
+            value = argument.substr(optionName.size() + 1);
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Parses a strictly positive count with an optional K, M or G (binary) suffix
+     * @throws std::invalid_argument If the value is not a positive count
+     */
+    std::size_t parseCount(const std::string& value) {
+        std::size_t consumed = 0;
+        unsigned long long amount = 0;
+        try {
+            amount = std::stoull(value, &consumed);
+        } catch (const std::exception&) {
+            throw std::invalid_argument("'" + value + "' is not a valid count.");
+        }
+        const std::string suffix = value.substr(consumed);
+        if (suffix == "K" || suffix == "k") {
+            amount <<= 10;
+        } else if (suffix == "M" || suffix == "m") {
+            amount <<= 20;
+        } else if (suffix == "G" || suffix == "g") {
+            amount <<= 30;
+        } else if (!suffix.empty()) {
+            throw std::invalid_argument("'" + value + "' is not a valid count.");
+        }
+        if (amount == 0) {
+            throw std::invalid_argument("'" + value + "' is not a positive count.");
+        }
+        return static_cast<std::size_t>(amount);
+    }
+
+    void printUsage(const char* appName) {
+        std::cerr << "Usage: " << appName << " [--filter=TEXT] [--repetitions=N] [--digest-bytes=BYTES]" << std::endl;
+        std::cerr << "       [--file-size=BYTES] [--dir=PATH] [--table-sizes=N,N,...] [--list]" << std::endl;
+        std::cerr << std::endl;
+        std::cerr << "Writes one JSON record per benchmark to stdout." << std::endl;
+        std::cerr << "  --filter=TEXT      Only run benchmarks whose name contains TEXT" << std::endl;
+        std::cerr << "  --repetitions=N    Timed repetitions of every benchmark (default 5)" << std::endl;
+        std::cerr << "  --digest-bytes=N   Bytes hashed per repetition of the digest benchmarks (default 64M)" << std::endl;
+        std::cerr << "  --file-size=N      Size of the large file read, and total size of the 16K files (default 64M)" << std::endl;
+        std::cerr << "  --dir=PATH         Directory on the device to read from (default: the temporary directory," << std::endl;
+        std::cerr << "                     where cold reads are only meaningful if it is not tmpfs)" << std::endl;
+        std::cerr << "  --table-sizes=LIST Entries of the hash table benchmarks (default 1000000,10000000; 100M" << std::endl;
+        std::cerr << "                     entries take about 10G of memory)" << std::endl;
+        std::cerr << "  --list             Print the names of the selected benchmarks and exit" << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string argument = argv[i];
+            std::string value;
+            if (argument == "-h" || argument == "--help") {
+                printUsage(argv[0]);
+                return EXIT_SUCCESS;
+            } else if (argument == PDCPP_BENCH_ARG_LIST) {
+                options.list = true;
+            } else if (matchOptionValue(argument, PDCPP_BENCH_ARG_FILTER, i, argc, argv, value)) {
+                options.filter = value;
+            } else if (matchOptionValue(argument, PDCPP_BENCH_ARG_REPETITIONS, i, argc, argv, value)) {
+                options.repetitions = static_cast<unsigned int>(std::min<std::size_t>(parseCount(value), 1000));
+            } else if (matchOptionValue(argument, PDCPP_BENCH_ARG_DIGESTBYTES, i, argc, argv, value)) {
+                options.digestBytes = parseCount(value);
+            } else if (matchOptionValue(argument, PDCPP_BENCH_ARG_FILESIZE, i, argc, argv, value)) {
+                options.fileSize = parseCount(value);
+            } else if (matchOptionValue(argument, PDCPP_BENCH_ARG_DIRECTORY, i, argc, argv, value)) {
+                options.directory = value;
+            } else if (matchOptionValue(argument, PDCPP_BENCH_ARG_TABLESIZES, i, argc, argv, value)) {
+                options.tableSizes.clear();
+                std::stringstream list(value);
+                std::string item;
+                while (std::getline(list, item, ',')) {
+                    options.tableSizes.push_back(parseCount(item));
+                }
+            } else {
+                std::cerr << "Error: '" << argument << "' is an unknown command-line argument." << std::endl;
+                printUsage(argv[0]);
+                return EXIT_FAILURE;
+            }
+        }
+    } catch (const std::invalid_argument& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    try {
+        if (!options.list) {
+            std::cout << "{\"type\":\"context\",\"version\":" << jsonString(pdcpp::VERSION)
+                      << ",\"pointer_bits\":" << sizeof(void*) * 8
+                      << ",\"hardware_threads\":" << std::thread::hardware_concurrency()
+#if defined(__VERSION__)
+                      << ",\"compiler\":" << jsonString(__VERSION__)
+#endif
+                      << ",\"repetitions\":" << options.repetitions << "}\n";
+        }
+        Runner runner(options, std::cout);
+        benchDigests(runner, options);
+        benchReads(runner, options);
+        benchHex(runner);
+        benchTables(runner, options);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
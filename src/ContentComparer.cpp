@@ -0,0 +1,315 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "ContentComparer.hpp"
+#include "Platform.hpp"
+#include "ScanStats.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <ios>
+#include <memory>
+#include <stdexcept>
+
+#if PDCPP_HAS_POSIX_IO
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    /**
+     * @brief A file read chunk by chunk at explicit offsets.
+     */
+    class InputFile {
+    public:
+        explicit InputFile(const std::string& filePath) : path(filePath) {
+#if PDCPP_HAS_POSIX_IO
+            fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                throw std::ios_base::failure("Could not open file: " + filePath);
+            }
+            ScanStats::count(StatCounter::FilesOpened);
+#if defined(POSIX_FADV_SEQUENTIAL)
+            (void)::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+#else
+            stream.open(filePath, std::ios::binary);
+            if (!stream) {
+                throw std::ios_base::failure("Could not open file: " + filePath);
+            }
+            ScanStats::count(StatCounter::FilesOpened);
+#endif
+        }
+
+        ~InputFile() {
+#if PDCPP_HAS_POSIX_IO
+            ::close(fd);
+#endif
+        }
+
+        InputFile(const InputFile&) = delete;
+        InputFile& operator=(const InputFile&) = delete;
+
+        /**
+         * @brief Reads exactly length bytes; files are read front to back so offset only guards POSIX reads.
+         * @throws std::ios_base::failure If the file ends early or cannot be read.
+         */
+        void read(std::uintmax_t offset, unsigned char* buffer, std::size_t length) {
+#if PDCPP_HAS_POSIX_IO
+            while (length > 0) {
+                const ssize_t got = ::pread(fd, buffer, length, static_cast<off_t>(offset));
+                ScanStats::count(StatCounter::ReadCalls);
+                if (got < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (got <= 0) {
+                    throw std::ios_base::failure("Unexpected end of file: " + path);
+                }
+                ScanStats::count(StatCounter::BytesRead, static_cast<std::uint64_t>(got));
+                buffer += got;
+                offset += static_cast<std::uintmax_t>(got);
+                length -= static_cast<std::size_t>(got);
+            }
+#else
+            (void)offset;
+            stream.read(reinterpret_cast<char*>(buffer), static_cast<std::streamsize>(length));
+            ScanStats::count(StatCounter::ReadCalls);
+            ScanStats::count(StatCounter::BytesRead, static_cast<std::uint64_t>(stream.gcount()));
+            if (stream.gcount() != static_cast<std::streamsize>(length)) {
+                throw std::ios_base::failure("Unexpected end of file: " + path);
+            }
+#endif
+        }
+
+        /**
+         * @brief Whether the file ends at offset, i.e. it did not grow past the size it was listed with.
+         * @throws std::ios_base::failure If the file cannot be read.
+         */
+        bool endsAt(std::uintmax_t offset) {
+            unsigned char byte;
+#if PDCPP_HAS_POSIX_IO
+            ssize_t got;
+            do {
+                got = ::pread(fd, &byte, 1, static_cast<off_t>(offset));
+                ScanStats::count(StatCounter::ReadCalls);
+            } while (got < 0 && errno == EINTR);
+            if (got < 0) {
+                throw std::ios_base::failure("Could not read file: " + path);
+            }
+            return got == 0;
+#else
+            (void)offset;
+            stream.read(reinterpret_cast<char*>(&byte), 1);
+            ScanStats::count(StatCounter::ReadCalls);
+            return stream.gcount() == 0;
+#endif
+        }
+
+    private:
+        const std::string& path;
+#if PDCPP_HAS_POSIX_IO
+        int fd = -1;
+#else
+        std::ifstream stream;
+#endif
+    };
+
+    /**
+     * @brief One open member of a window with the chunk it read last.
+     */
+    struct Member {
+        std::size_t position;
+        std::unique_ptr<InputFile> file;
+        std::vector<unsigned char> chunk;
+    };
+}
+
+ContentComparer::ContentComparer(std::size_t chunkSize)
+        : chunkSize(chunkSize) {
+    if (chunkSize == 0) {
+        throw std::invalid_argument("The comparison chunk size must be greater than zero.");
+    }
+}
+
+std::vector<std::vector<std::size_t>> ContentComparer::split(const std::vector<const std::string*>& paths,
+                                                             std::uintmax_t size, std::vector<std::string>& errors) const {
+    errors.assign(paths.size(), std::string());
+    std::vector<std::vector<std::size_t>> classes;
+    std::vector<std::size_t> remaining(paths.size());
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        remaining[i] = i;
+    }
+
+    // The first remaining file leads every window; whatever differs from it is split again afterwards
+    while (!remaining.empty()) {
+        std::vector<std::size_t> leaderClass;
+        std::vector<std::size_t> different;
+        std::size_t next = 1;
+        bool leaderFailed = false;
+        do {
+            std::vector<std::size_t> window{remaining.front()};
+            for (; next < remaining.size() && window.size() < kMaxOpenFiles; ++next) {
+                window.push_back(remaining[next]);
+            }
+
+            std::vector<std::vector<std::size_t>> windowClasses;
+            splitWindow(paths, window, size, errors, windowClasses);
+            for (auto& windowClass : windowClasses) {
+                if (windowClass.front() == remaining.front()) {
+                    leaderClass.insert(leaderClass.end(), windowClass.begin() + (leaderClass.empty() ? 0 : 1),
+                                       windowClass.end());
+                } else {
+                    different.insert(different.end(), windowClass.begin(), windowClass.end());
+                }
+            }
+            leaderFailed = !errors[remaining.front()].empty();
+        } while (next < remaining.size() && !leaderFailed);
+
+        // An unreadable leader cannot vouch for anyone, the files after its last window start over
+        for (; next < remaining.size(); ++next) {
+            different.push_back(remaining[next]);
+        }
+        if (leaderFailed) {
+            leaderClass.erase(std::remove(leaderClass.begin(), leaderClass.end(), remaining.front()), leaderClass.end());
+        }
+        if (!leaderClass.empty()) {
+            classes.push_back(std::move(leaderClass));
+        }
+        std::sort(different.begin(), different.end());
+        remaining = std::move(different);
+    }
+
+    std::sort(classes.begin(), classes.end());
+    return classes;
+}
+
+void ContentComparer::splitWindow(const std::vector<const std::string*>& paths, const std::vector<std::size_t>& window,
+                                  std::uintmax_t size, std::vector<std::string>& errors,
+                                  std::vector<std::vector<std::size_t>>& classes) const {
+    const auto stepSize = static_cast<std::size_t>(std::min<std::uintmax_t>(chunkSize, std::max<std::uintmax_t>(size, 1)));
+    std::vector<std::vector<Member>> groups(1);
+    for (std::size_t position : window) {
+        try {
+            groups.front().push_back({position, std::make_unique<InputFile>(*paths[position]), {}});
+        } catch (const std::exception& e) {
+            errors[position] = e.what();
+        }
+    }
+
+    std::vector<std::vector<Member>> settled;
+    for (std::uintmax_t offset = 0; offset < size && !groups.empty(); offset += stepSize) {
+        const auto length = static_cast<std::size_t>(std::min<std::uintmax_t>(stepSize, size - offset));
+        std::vector<std::vector<Member>> nextGroups;
+        for (auto& group : groups) {
+            // Read the next chunk of every member, then partition the members by it in their original order
+            std::vector<std::vector<Member>> parts;
+            for (auto& member : group) {
+                try {
+                    member.chunk.resize(length);
+                    member.file->read(offset, member.chunk.data(), length);
+                } catch (const std::exception& e) {
+                    errors[member.position] = e.what();
+                    continue;
+                }
+                auto same = std::find_if(parts.begin(), parts.end(), [&](const std::vector<Member>& candidate) {
+                    return std::memcmp(candidate.front().chunk.data(), member.chunk.data(), length) == 0;
+                });
+                if (same == parts.end()) {
+                    parts.emplace_back();
+                    same = parts.end() - 1;
+                }
+                same->push_back(std::move(member));
+            }
+            for (auto& part : parts) {
+                // A lone file is settled and closed, which keeps the number of open files low
+                if (part.size() < 2) {
+                    part.front().file.reset();
+                    settled.push_back(std::move(part));
+                } else {
+                    nextGroups.push_back(std::move(part));
+                }
+            }
+        }
+        groups = std::move(nextGroups);
+    }
+
+    // A file that grew since the walk matched only its first size bytes: it differs from the others
+    for (auto& group : groups) {
+        std::vector<Member> ended;
+        for (auto& member : group) {
+            bool atEnd = false;
+            try {
+                atEnd = member.file->endsAt(size);
+            } catch (const std::exception& e) {
+                errors[member.position] = e.what();
+                continue;
+            }
+            member.file.reset();
+            if (atEnd) {
+                ended.push_back(std::move(member));
+            } else {
+                settled.emplace_back();
+                settled.back().push_back(std::move(member));
+            }
+        }
+        if (!ended.empty()) {
+            settled.push_back(std::move(ended));
+        }
+    }
+    for (const auto& group : settled) {
+        std::vector<std::size_t> positions;
+        for (const auto& member : group) {
+            positions.push_back(member.position);
+        }
+        classes.push_back(std::move(positions));
+    }
+}
+
+bool ContentComparer::prefersBytes(std::size_t files, std::uintmax_t size) {
+    return files <= kAutoMaxGroupFiles || (files <= kMaxOpenFiles && size <= kDefaultChunkSize);
+}
+
+CompareMode ContentComparer::parseMode(const std::string& name) {
+    for (CompareMode mode : {CompareMode::Auto, CompareMode::Hash, CompareMode::Bytes}) {
+        if (name == modeName(mode)) {
+            return mode;
+        }
+    }
+    throw std::invalid_argument("'" + name + "' is not a known comparison mode (auto, hash, bytes).");
+}
+
+const char* ContentComparer::modeName(CompareMode mode) {
+    switch (mode) {
+        case CompareMode::Auto:
+            return "auto";
+        case CompareMode::Hash:
+            return "hash";
+        case CompareMode::Bytes:
+            return "bytes";
+    }
+    return "auto";
+}
@@ -0,0 +1,104 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef CONTENT_COMPARER_HPP
+#define CONTENT_COMPARER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief How candidate files that survived the partial hash are confirmed as duplicates.
+ */
+enum class CompareMode {
+    Auto,  // Compare bytes where every file is read exactly once, hash otherwise
+    Hash,  // Hash every file in full
+    Bytes  // Compare the files of a group against each other in lockstep
+};
+
+/**
+ * @brief Splits files of equal size into classes of byte-identical content.
+ * @details All members of a group are read in lockstep, one chunk at a time, and the group is split
+ *          as soon as their contents diverge, so files that differ early cost almost no I/O. Unlike
+ *          a digest this never reports a false match. At most kMaxOpenFiles files are open at once:
+ *          larger groups are compared against their first member in windows.
+ */
+class ContentComparer {
+public:
+    static constexpr std::size_t kDefaultChunkSize = 256 * 1024;
+    static constexpr std::size_t kMaxOpenFiles = 64;
+    // Largest group CompareMode::Auto always compares byte by byte, whatever the file size
+    static constexpr std::size_t kAutoMaxGroupFiles = 4;
+
+    /**
+     * @param chunkSize Bytes read from every file per step.
+     */
+    explicit ContentComparer(std::size_t chunkSize = kDefaultChunkSize);
+
+    /**
+     * @brief Splits files into classes of identical content.
+     * @param paths The files to compare, all expected to be size bytes long.
+     * @param size The common size of the files.
+     * @param errors Receives at position i the error of paths[i] if it could not be read completely.
+     * @return Classes of positions into paths, including classes of a single file but not files that
+     *         failed. Positions ascend within a class and classes are ordered by their first position.
+     *         A file that grew past size since it was listed is in a class of its own.
+     */
+    std::vector<std::vector<std::size_t>> split(const std::vector<const std::string*>& paths, std::uintmax_t size,
+                                                std::vector<std::string>& errors) const;
+
+    /**
+     * @brief Whether CompareMode::Auto compares a group byte by byte instead of hashing it.
+     * @param files Number of files in the group.
+     * @param size Common size of the files.
+     * @details Small groups, and groups of files that fit in a single chunk and window, are read
+     *          exactly once by a comparison and may stop early. Larger groups would be re-read
+     *          window by window, where hashing reads every file exactly once.
+     */
+    static bool prefersBytes(std::size_t files, std::uintmax_t size);
+
+    /**
+     * @brief Parses a mode name as given on the command line.
+     * @throws std::invalid_argument If the name is unknown.
+     */
+    static CompareMode parseMode(const std::string& name);
+
+    /**
+     * @brief Returns the command line name of a mode.
+     */
+    static const char* modeName(CompareMode mode);
+
+private:
+    std::size_t chunkSize;
+
+    void splitWindow(const std::vector<const std::string*>& paths, const std::vector<std::size_t>& window,
+                     std::uintmax_t size, std::vector<std::string>& errors,
+                     std::vector<std::vector<std::size_t>>& classes) const;
+};
+
+#endif // CONTENT_COMPARER_HPP
@@ -0,0 +1,329 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "Deduplicator.hpp"
+#include "Platform.hpp"
+#include "ScanStats.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#if PDCPP_HAS_POSIX_IO
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+#if PDCPP_HAS_POSIX_IO
+namespace {
+    // Directories of link targets kept open at once while replacing files by hardlinks
+    constexpr std::size_t kMaxCachedDirectories = 256;
+
+    /**
+     * @brief Splits a path into its parent directory and its last component.
+     */
+    std::pair<std::string, std::string> splitPath(const std::string& path) {
+        const std::size_t slash = path.find_last_of('/');
+        if (slash == std::string::npos) {
+            return {".", path};
+        }
+        return {slash == 0 ? "/" : path.substr(0, slash), path.substr(slash + 1)};
+    }
+
+    /**
+     * @brief Visits items grouped by the parent directory of their path, with that directory open.
+     * @param pathOf Returns the path an item operates on.
+     * @param visit Invoked with the item position, the directory descriptor and the file name.
+     * @param onError Invoked with the item position for every item whose directory cannot be opened.
+     */
+    template <typename PathFunction, typename Visitor, typename ErrorHandler>
+    void forEachInDirectory(std::size_t count, PathFunction pathOf, Visitor visit, ErrorHandler onError) {
+        std::vector<std::pair<std::string, std::string>> parts(count);
+        std::vector<std::size_t> order(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            parts[i] = splitPath(pathOf(i));
+            order[i] = i;
+        }
+        std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+            return parts[a].first < parts[b].first;
+        });
+
+        for (std::size_t begin = 0; begin < count;) {
+            const std::string& directory = parts[order[begin]].first;
+            std::size_t end = begin;
+            while (end < count && parts[order[end]].first == directory) {
+                ++end;
+            }
+            const int directoryFd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            const int openError = errno;
+            for (std::size_t k = begin; k < end; ++k) {
+                if (directoryFd < 0) {
+                    onError(order[k], std::strerror(openError));
+                } else {
+                    visit(order[k], directoryFd, parts[order[k]].second);
+                }
+            }
+            if (directoryFd >= 0) {
+                ::close(directoryFd);
+            }
+            begin = end;
+        }
+    }
+}
+#endif
+#if defined(__linux__)
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#endif
+
+void Deduplicator::shareExtents(const std::string& original, const std::vector<const std::string*>& duplicates,
+                                std::uintmax_t size, std::vector<std::uint64_t>& shared, std::vector<std::string>& errors) {
+    shared.assign(duplicates.size(), 0);
+    errors.assign(duplicates.size(), std::string());
+#if defined(__linux__) && defined(FIDEDUPERANGE)
+    if (size == 0) {
+        return;
+    }
+    const int sourceFd = ::open(original.c_str(), O_RDONLY | O_CLOEXEC);
+    if (sourceFd < 0) {
+        const std::string error = "cannot open original " + original + ": " + std::strerror(errno);
+        std::fill(errors.begin(), errors.end(), error);
+        return;
+    }
+
+    std::vector<unsigned char> request(sizeof(struct file_dedupe_range)
+                                       + kMaxDedupeTargets * sizeof(struct file_dedupe_range_info));
+    for (std::size_t windowStart = 0; windowStart < duplicates.size(); windowStart += kMaxDedupeTargets) {
+        const std::size_t windowEnd = std::min(duplicates.size(), windowStart + kMaxDedupeTargets);
+
+        // The ioctl wants the targets writable, unless the caller owns them
+        std::vector<std::pair<std::size_t, int>> targets;
+        for (std::size_t i = windowStart; i < windowEnd; ++i) {
+            int fd = ::open(duplicates[i]->c_str(), O_RDWR | O_CLOEXEC);
+            if (fd < 0 && (errno == EACCES || errno == ETXTBSY || errno == EROFS)) {
+                fd = ::open(duplicates[i]->c_str(), O_RDONLY | O_CLOEXEC);
+            }
+            if (fd < 0) {
+                errors[i] = std::strerror(errno);
+            } else {
+                targets.emplace_back(i, fd);
+            }
+        }
+
+        // Every target continues where the kernel stopped sharing, which may be short of the range
+        // asked for. One call shares a single source offset, so it covers the targets furthest behind
+        while (!targets.empty()) {
+            std::uint64_t offset = size;
+            for (const auto& target : targets) {
+                offset = std::min<std::uint64_t>(offset, shared[target.first]);
+            }
+            std::vector<std::pair<std::size_t, int>> batch;
+            std::vector<std::pair<std::size_t, int>> remaining;
+            for (const auto& target : targets) {
+                (shared[target.first] == offset ? batch : remaining).push_back(target);
+            }
+
+            std::fill(request.begin(), request.end(), 0);
+            auto* range = reinterpret_cast<struct file_dedupe_range*>(request.data());
+            range->src_offset = offset;
+            range->src_length = std::min<std::uint64_t>(kDedupeRangeSize, size - offset);
+            range->dest_count = static_cast<std::uint16_t>(batch.size());
+            for (std::size_t t = 0; t < batch.size(); ++t) {
+                range->info[t].dest_fd = batch[t].second;
+                range->info[t].dest_offset = offset;
+            }
+
+            ScanStats::count(StatCounter::ActionCalls);
+            if (::ioctl(sourceFd, FIDEDUPERANGE, range) != 0) {
+                const std::string error = std::strerror(errno);
+                for (const auto& target : batch) {
+                    errors[target.first] = error;
+                    ::close(target.second);
+                }
+                targets = std::move(remaining);
+                continue;
+            }
+
+            // A target that failed a range, or had none of it shared, is left alone from there on
+            for (std::size_t t = 0; t < batch.size(); ++t) {
+                const auto& info = range->info[t];
+                const std::size_t i = batch[t].first;
+                if (info.status == FILE_DEDUPE_RANGE_SAME && info.bytes_deduped > 0) {
+                    shared[i] += info.bytes_deduped;
+                    if (shared[i] < size) {
+                        remaining.push_back(batch[t]);
+                    } else {
+                        ::close(batch[t].second);
+                    }
+                    continue;
+                }
+                if (info.status == FILE_DEDUPE_RANGE_SAME) {
+                    errors[i] = "no bytes shared from offset " + std::to_string(offset) + " on";
+                } else {
+                    errors[i] = info.status == FILE_DEDUPE_RANGE_DIFFERS ? "contents differ from the original"
+                                                                         : std::strerror(-info.status);
+                }
+                ::close(batch[t].second);
+            }
+            targets = std::move(remaining);
+        }
+    }
+    ::close(sourceFd);
+#else
+    (void)original;
+    (void)size;
+    std::fill(errors.begin(), errors.end(), std::string("sharing extents is not supported on this platform"));
+#endif
+}
+
+void Deduplicator::removeFiles(const std::vector<const std::string*>& paths, std::vector<std::string>& errors) {
+    errors.assign(paths.size(), std::string());
+#if PDCPP_HAS_POSIX_IO
+    forEachInDirectory(paths.size(), [&](std::size_t i) -> const std::string& { return *paths[i]; },
+                       [&](std::size_t i, int directoryFd, const std::string& name) {
+        ScanStats::count(StatCounter::ActionCalls);
+        if (::unlinkat(directoryFd, name.c_str(), 0) != 0) {
+            errors[i] = std::strerror(errno);
+        }
+    }, [&](std::size_t i, const char* error) {
+        errors[i] = error;
+    });
+#else
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        ScanStats::count(StatCounter::ActionCalls);
+        try {
+            fs::remove(*paths[i]);
+        } catch (const std::exception& e) {
+            errors[i] = e.what();
+        }
+    }
+#endif
+}
+
+void Deduplicator::replaceWithHardlinks(const std::vector<std::pair<const std::string*, const std::string*>>& replacements,
+                                        std::vector<std::string>& errors) {
+    errors.assign(replacements.size(), std::string());
+#if PDCPP_HAS_POSIX_IO
+    // Originals are spread over fewer directories than their duplicates, their descriptors are cached
+    std::unordered_map<std::string, int> targetDirectories;
+    auto targetDirectory = [&](const std::string& directory) {
+        auto known = targetDirectories.find(directory);
+        if (known != targetDirectories.end()) {
+            return known->second;
+        }
+        if (targetDirectories.size() >= kMaxCachedDirectories) {
+            for (const auto& entry : targetDirectories) {
+                if (entry.second >= 0) {
+                    ::close(entry.second);
+                }
+            }
+            targetDirectories.clear();
+        }
+        const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        targetDirectories.emplace(directory, fd);
+        return fd;
+    };
+
+    unsigned long long counter = 0;
+    const std::string prefix = ".rmdup-" + std::to_string(static_cast<long long>(::getpid())) + "-";
+    forEachInDirectory(replacements.size(), [&](std::size_t i) -> const std::string& { return *replacements[i].first; },
+                       [&](std::size_t i, int directoryFd, const std::string& name) {
+        const auto target = splitPath(*replacements[i].second);
+        const int targetFd = targetDirectory(target.first);
+        if (targetFd < 0) {
+            errors[i] = std::string("cannot open directory of ") + *replacements[i].second;
+            return;
+        }
+
+        // Link under a fresh temporary name, then move it over the duplicate in one step. The walk
+        // lists symbolic links like their targets, so an original may be one: the link has to
+        // point at the file behind it, not at the symbolic link
+        std::string temporary;
+        int result;
+        do {
+            temporary = prefix + std::to_string(counter++) + ".tmp";
+            result = ::linkat(targetFd, target.second.c_str(), directoryFd, temporary.c_str(), AT_SYMLINK_FOLLOW);
+            ScanStats::count(StatCounter::ActionCalls);
+        } while (result != 0 && errno == EEXIST);
+        if (result != 0) {
+            errors[i] = std::strerror(errno);
+            return;
+        }
+        ScanStats::count(StatCounter::ActionCalls);
+        if (::renameat(directoryFd, temporary.c_str(), directoryFd, name.c_str()) != 0) {
+            errors[i] = std::strerror(errno);
+            ::unlinkat(directoryFd, temporary.c_str(), 0);
+        }
+    }, [&](std::size_t i, const char* error) {
+        errors[i] = error;
+    });
+    for (const auto& entry : targetDirectories) {
+        if (entry.second >= 0) {
+            ::close(entry.second);
+        }
+    }
+#else
+    for (std::size_t i = 0; i < replacements.size(); ++i) {
+        const fs::path temporary = fs::path(*replacements[i].first).parent_path() / ".rmdup-link.tmp";
+        ScanStats::count(StatCounter::ActionCalls, 2);
+        try {
+            fs::create_hard_link(fs::canonical(*replacements[i].second), temporary);
+            fs::rename(temporary, *replacements[i].first);
+        } catch (const std::exception& e) {
+            errors[i] = e.what();
+            std::error_code ignored;
+            fs::remove(temporary, ignored);
+        }
+    }
+#endif
+}
+
+DuplicateAction Deduplicator::parseAction(const std::string& name) {
+    for (DuplicateAction action : {DuplicateAction::Delete, DuplicateAction::Reflink, DuplicateAction::Hardlink}) {
+        if (name == actionName(action)) {
+            return action;
+        }
+    }
+    throw std::invalid_argument("'" + name + "' is not a known action (delete, reflink, hardlink).");
+}
+
+const char* Deduplicator::actionName(DuplicateAction action) {
+    switch (action) {
+        case DuplicateAction::Delete:
+            return "delete";
+        case DuplicateAction::Reflink:
+            return "reflink";
+        case DuplicateAction::Hardlink:
+            return "hardlink";
+    }
+    return "delete";
+}
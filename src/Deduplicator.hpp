@@ -0,0 +1,116 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef DEDUPLICATOR_HPP
+#define DEDUPLICATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief What is done with a confirmed duplicate.
+ */
+enum class DuplicateAction {
+    Delete,   // Remove the duplicate and all of its hardlinks
+    Reflink,  // Keep every path, but let the duplicate share the extents of the original
+    Hardlink  // Replace every path of the duplicate by a hardlink to the original
+};
+
+/**
+ * @brief A confirmed set of identical files, by path.
+ */
+struct DuplicateSet {
+    std::string original;              // Path of the member that is kept
+    std::uintmax_t size = 0;           // Size of every member
+    std::vector<std::string> paths;    // Paths of the other members, each followed by its hardlinks
+    std::vector<std::size_t> members;  // Position in paths of every other member, its hardlinks excluded
+};
+
+/**
+ * @brief Reclaims the space taken by duplicates.
+ * @details Operations on paths are grouped by parent directory. Each directory is opened once and
+ *          its entries are addressed relative to it, so the kernel does not resolve the full path of
+ *          every file again.
+ */
+class Deduplicator {
+public:
+    // Bytes submitted per FIDEDUPERANGE call; btrfs handles at most 16 MiB per request
+    static constexpr std::uint64_t kDedupeRangeSize = 16 * 1024 * 1024;
+    // Duplicates deduplicated against the original by a single call, which also bounds open files
+    static constexpr std::size_t kMaxDedupeTargets = 64;
+
+    /**
+     * @brief Makes duplicates share the extents of their original through the Linux FIDEDUPERANGE ioctl.
+     * @param original The file that is kept.
+     * @param duplicates Files with the same content as the original, all size bytes long.
+     * @param size Common size of the files.
+     * @param shared Receives at position i the number of bytes of duplicates[i] now shared with the original.
+     * @param errors Receives at position i the error of duplicates[i], which then is left as it was from
+     *               the first failing range on.
+     * @details The kernel locks both files and compares the ranges before sharing them, so a file
+     *          modified since it was hashed is reported instead of being corrupted. Files are processed
+     *          in ranges of kDedupeRangeSize, every call covering up to kMaxDedupeTargets duplicates.
+     *          When the kernel shares less than a range, the rest is asked for again; a call that
+     *          shares nothing is an error, with shared holding what was shared before it.
+     *          File systems without shared extents, like ext4, fail every duplicate.
+     */
+    static void shareExtents(const std::string& original, const std::vector<const std::string*>& duplicates,
+                             std::uintmax_t size, std::vector<std::uint64_t>& shared, std::vector<std::string>& errors);
+
+    /**
+     * @brief Removes files, directory by directory.
+     * @param errors Receives at position i the error of paths[i] if it could not be removed.
+     */
+    static void removeFiles(const std::vector<const std::string*>& paths, std::vector<std::string>& errors);
+
+    /**
+     * @brief Atomically replaces files by hardlinks to other files.
+     * @param replacements Pairs of the path to replace and the file it will link to.
+     * @param errors Receives at position i the error of replacements[i]; the path then is left as it was.
+     * @details The link is created under a temporary name next to the replaced path and renamed over
+     *          it, so the path never disappears, not even briefly. The replaced path takes on the owner,
+     *          permissions and timestamps of the file it now links to. A symbolic link given as the file
+     *          to link to is followed. Links cannot cross file systems; such replacements fail.
+     */
+    static void replaceWithHardlinks(const std::vector<std::pair<const std::string*, const std::string*>>& replacements,
+                                     std::vector<std::string>& errors);
+
+    /**
+     * @brief Parses the value of --action.
+     * @throws std::invalid_argument If the name is not a known action.
+     */
+    static DuplicateAction parseAction(const std::string& name);
+
+    /**
+     * @brief Name of an action as accepted by parseAction().
+     */
+    static const char* actionName(DuplicateAction action);
+};
+
+#endif // DEDUPLICATOR_HPP
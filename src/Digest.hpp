@@ -0,0 +1,76 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef DIGEST_HPP
+#define DIGEST_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+/**
+ * @brief A message digest kept in binary form, converted to hexadecimal only for display.
+ */
+struct Digest {
+    static constexpr std::size_t kMaxSize = 64; // Large enough for every EVP digest (EVP_MAX_MD_SIZE)
+
+    std::array<std::uint8_t, kMaxSize> bytes{};
+    std::uint8_t length = 0;
+
+    bool operator==(const Digest& other) const {
+        return length == other.length && std::memcmp(bytes.data(), other.bytes.data(), length) == 0;
+    }
+
+    bool operator!=(const Digest& other) const {
+        return !(*this == other);
+    }
+
+    /**
+     * @brief Leading bytes of the digest as a machine word, a well-mixed hash for table lookups.
+     */
+    std::uint64_t prefix() const {
+        std::uint64_t value = 0;
+        std::memcpy(&value, bytes.data(), sizeof(value));
+        return value;
+    }
+
+    /**
+     * @brief Returns the digest as a lowercase hexadecimal string.
+     */
+    std::string toHex() const {
+        static const char hexDigits[] = "0123456789abcdef";
+        std::string hex(static_cast<std::size_t>(length) * 2, '0');
+        for (std::size_t i = 0; i < length; ++i) {
+            hex[2 * i] = hexDigits[bytes[i] >> 4];
+            hex[2 * i + 1] = hexDigits[bytes[i] & 0x0F];
+        }
+        return hex;
+    }
+};
+
+#endif // DIGEST_HPP
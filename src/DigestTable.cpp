@@ -0,0 +1,84 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "DigestTable.hpp"
+#include <utility>
+
+namespace {
+    constexpr std::size_t kMinimumSlots = 16;
+}
+
+DigestTable::DigestTable(const std::vector<Digest>& digests)
+        : digests(digests) {
+    reset(0);
+}
+
+void DigestTable::reset(std::size_t expectedEntries) {
+    // Keep the load factor at or below one half
+    std::size_t capacity = kMinimumSlots;
+    while (capacity < expectedEntries * 2) {
+        capacity <<= 1;
+    }
+    slots.assign(capacity, Slot{kEmpty, 0});
+    mask = capacity - 1;
+    entries = 0;
+}
+
+std::uint32_t DigestTable::findOrInsert(std::uint32_t index) {
+    if ((entries + 1) * 2 > slots.size()) {
+        grow();
+    }
+
+    const std::uint64_t hash = digests[index].prefix();
+    const auto tag = static_cast<std::uint32_t>(hash >> 32);
+    for (std::size_t position = static_cast<std::size_t>(hash) & mask;; position = (position + 1) & mask) {
+        Slot& slot = slots[position];
+        if (slot.index == kEmpty) {
+            slot = Slot{index, tag};
+            ++entries;
+            return index;
+        }
+        if (slot.tag == tag && digests[slot.index] == digests[index]) {
+            return slot.index;
+        }
+    }
+}
+
+void DigestTable::grow() {
+    std::vector<Slot> previous(slots.size() * 2, Slot{kEmpty, 0});
+    previous.swap(slots);
+    mask = slots.size() - 1;
+    for (const Slot& slot : previous) {
+        if (slot.index == kEmpty) {
+            continue;
+        }
+        std::size_t position = static_cast<std::size_t>(digests[slot.index].prefix()) & mask;
+        while (slots[position].index != kEmpty) {
+            position = (position + 1) & mask;
+        }
+        slots[position] = slot;
+    }
+}
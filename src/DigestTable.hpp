@@ -0,0 +1,78 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef DIGEST_TABLE_HPP
+#define DIGEST_TABLE_HPP
+
+#include "Digest.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Flat open-addressing set of digests that stores indices instead of the digests themselves.
+ * @details The digests live in an array owned by the caller; every slot holds the index of one of
+ *          them plus a 32-bit tag of its hash, so most probes never touch the digest array. Slots
+ *          are 8 bytes wide and probed linearly, keeping collisions within one or two cache lines.
+ */
+class DigestTable {
+public:
+    /**
+     * @param digests The array indices refer to. It must outlive the table and only grow.
+     */
+    explicit DigestTable(const std::vector<Digest>& digests);
+
+    /**
+     * @brief Empties the table and sizes it for the given number of entries.
+     */
+    void reset(std::size_t expectedEntries);
+
+    /**
+     * @brief Inserts an index unless an equal digest is already present.
+     * @param index Position in the digest array of the digest to insert.
+     * @return The index stored for the digest, which is index itself if the digest was new.
+     */
+    std::uint32_t findOrInsert(std::uint32_t index);
+
+    std::size_t size() const { return entries; }
+
+private:
+    struct Slot {
+        std::uint32_t index;
+        std::uint32_t tag;
+    };
+
+    static constexpr std::uint32_t kEmpty = UINT32_MAX;
+
+    const std::vector<Digest>& digests;
+    std::vector<Slot> slots;
+    std::size_t mask = 0;
+    std::size_t entries = 0;
+
+    void grow();
+};
+
+#endif // DIGEST_TABLE_HPP
@@ -0,0 +1,456 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "ExternalSorter.hpp"
+#include "Platform.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+#if PDCPP_HAS_POSIX_IO
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr std::size_t kWriteBufferSize = 1 << 20;
+    constexpr std::size_t kMinReadBufferSize = 4 << 10;
+    constexpr std::size_t kMaxReadBufferSize = 1 << 20;
+}
+
+/**
+ * @brief A buffered file of spilled records, closed when it goes out of scope.
+ * @details Files opened for writing are created and must not exist yet; no file is opened through
+ *          a symbolic link.
+ */
+class SpillFile {
+public:
+    SpillFile(const std::string& path, const char* mode, std::size_t bufferSize)
+            : path(path), buffer(bufferSize), file(open(path, mode)) {
+        if (file == nullptr) {
+            throw std::runtime_error("Could not open spill file: " + path);
+        }
+        std::setvbuf(file, buffer.data(), _IOFBF, buffer.size());
+    }
+
+    ~SpillFile() {
+        if (file != nullptr) {
+            std::fclose(file);
+        }
+    }
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    void write(const void* data, std::size_t length) {
+        if (length != 0 && std::fwrite(data, 1, length, file) != length) {
+            throw std::runtime_error("Could not write spill file: " + path);
+        }
+    }
+
+    template <typename T>
+    void writeValue(T value) {
+        write(&value, sizeof(value));
+    }
+
+    void writeString(const std::string& text) {
+        writeValue(static_cast<std::uint32_t>(text.size()));
+        write(text.data(), text.size());
+    }
+
+    /**
+     * @return False at the end of the file, before anything was read.
+     * @throws std::runtime_error If the file ends in the middle of the data.
+     */
+    bool read(void* data, std::size_t length) {
+        const std::size_t got = std::fread(data, 1, length, file);
+        if (got == length) {
+            return true;
+        }
+        if (got == 0 && std::feof(file)) {
+            return false;
+        }
+        throw std::runtime_error("Could not read spill file: " + path);
+    }
+
+    template <typename T>
+    T readValue() {
+        T value;
+        if (!read(&value, sizeof(value))) {
+            throw std::runtime_error("Truncated spill file: " + path);
+        }
+        return value;
+    }
+
+    std::string readString() {
+        std::string text(readValue<std::uint32_t>(), '\0');
+        if (!text.empty() && !read(&text[0], text.size())) {
+            throw std::runtime_error("Truncated spill file: " + path);
+        }
+        return text;
+    }
+
+    void rewind() {
+        if (std::fflush(file) != 0 || std::fseek(file, 0, SEEK_SET) != 0) {
+            throw std::runtime_error("Could not read spill file: " + path);
+        }
+    }
+
+    void close() {
+        const int result = std::fclose(file);
+        file = nullptr;
+        if (result != 0) {
+            throw std::runtime_error("Could not write spill file: " + path);
+        }
+    }
+
+private:
+    std::string path;
+    std::vector<char> buffer;
+    std::FILE* file;
+
+    static std::FILE* open(const std::string& path, const char* mode) {
+#if PDCPP_HAS_POSIX_IO
+        int flags = O_NOFOLLOW | O_CLOEXEC;
+        if (mode[0] == 'w') {
+            flags |= O_CREAT | O_EXCL | (std::strchr(mode, '+') != nullptr ? O_RDWR : O_WRONLY);
+        } else {
+            flags |= O_RDONLY;
+        }
+        const int fd = ::open(path.c_str(), flags, S_IRUSR | S_IWUSR);
+        if (fd < 0) {
+            return nullptr;
+        }
+        std::FILE* stream = ::fdopen(fd, mode);
+        if (stream == nullptr) {
+            ::close(fd);
+        }
+        return stream;
+#else
+        if (mode[0] == 'w' && std::filesystem::exists(std::filesystem::symlink_status(path))) {
+            return nullptr;
+        }
+        return std::fopen(path.c_str(), mode);
+#endif
+    }
+};
+
+namespace {
+    // Records are written in the native layout, run files never outlive the process that wrote them
+    void writeRecord(SpillFile& out, const SpillRecord& record, bool withDigest) {
+        out.writeValue(static_cast<std::uint64_t>(record.file.size));
+        out.writeValue(record.file.device);
+        out.writeValue(record.file.inode);
+        out.writeValue(record.file.mtimeNs);
+        out.writeValue(record.file.ctimeNs);
+        out.writeString(record.file.path);
+        if (withDigest) {
+            out.writeValue(record.digest.length);
+            out.write(record.digest.bytes.data(), record.digest.length);
+            out.writeValue(static_cast<std::uint32_t>(record.links.size()));
+            for (const auto& link : record.links) {
+                out.writeString(link);
+            }
+        }
+    }
+
+    bool readRecord(SpillFile& in, SpillRecord& record, bool withDigest) {
+        std::uint64_t size = 0;
+        if (!in.read(&size, sizeof(size))) {
+            return false;
+        }
+        record.file.size = size;
+        record.file.device = in.readValue<std::uint64_t>();
+        record.file.inode = in.readValue<std::uint64_t>();
+        record.file.mtimeNs = in.readValue<std::int64_t>();
+        record.file.ctimeNs = in.readValue<std::int64_t>();
+        record.file.path = in.readString();
+        if (withDigest) {
+            record.digest.length = std::min<std::uint8_t>(in.readValue<std::uint8_t>(), Digest::kMaxSize);
+            if (record.digest.length != 0) {
+                in.read(record.digest.bytes.data(), record.digest.length);
+            }
+            record.links.resize(in.readValue<std::uint32_t>());
+            for (auto& link : record.links) {
+                link = in.readString();
+            }
+        }
+        return true;
+    }
+
+}
+
+ExternalSorter::ExternalSorter(std::string pathPrefix, SpillOrder order, std::size_t memoryBudget)
+        : pathPrefix(std::move(pathPrefix)), order(order), memoryBudget(memoryBudget) {
+}
+
+ExternalSorter::~ExternalSorter() {
+    for (const auto& run : runs) {
+        std::remove(run.c_str());
+    }
+}
+
+std::size_t ExternalSorter::footprint(const FileEntry& file) {
+    // Short paths live inside the string object, longer ones cost a heap block of their own
+    constexpr std::size_t kInlinePath = 15;
+    return sizeof(SpillRecord) + (file.path.size() > kInlinePath ? file.path.size() + 1 : 0);
+}
+
+std::size_t ExternalSorter::footprint(const SpillRecord& record) {
+    std::size_t bytes = footprint(record.file);
+    for (const auto& link : record.links) {
+        bytes += sizeof(std::string) + link.size();
+    }
+    return bytes;
+}
+
+bool ExternalSorter::less(SpillOrder order, const SpillRecord& a, const SpillRecord& b) {
+    if (order == SpillOrder::Size) {
+        if (a.file.size != b.file.size) {
+            return a.file.size < b.file.size;
+        }
+        if (a.file.device != b.file.device) {
+            return a.file.device < b.file.device;
+        }
+        if (a.file.inode != b.file.inode) {
+            return a.file.inode < b.file.inode;
+        }
+    } else {
+        if (a.digest.length != b.digest.length) {
+            return a.digest.length < b.digest.length;
+        }
+        const int digestOrder = std::memcmp(a.digest.bytes.data(), b.digest.bytes.data(), a.digest.length);
+        if (digestOrder != 0) {
+            return digestOrder < 0;
+        }
+    }
+    return a.file.path < b.file.path;
+}
+
+SpillDirectory::SpillDirectory() {
+    const std::filesystem::path parent = std::filesystem::temp_directory_path();
+#if PDCPP_HAS_POSIX_IO
+    std::string pattern = (parent / "rmdup-XXXXXX").string();
+    if (::mkdtemp(&pattern[0]) == nullptr) {
+        throw std::runtime_error("Could not create a spill directory in " + parent.string() + ": " + std::strerror(errno));
+    }
+    directory = pattern;
+#else
+    for (int attempt = 0; directory.empty(); ++attempt) {
+        const auto id = static_cast<long long>(std::chrono::steady_clock::now().time_since_epoch().count());
+        const std::filesystem::path candidate = parent / ("rmdup-" + std::to_string(id));
+        if (std::filesystem::create_directory(candidate)) {
+            directory = candidate.string();
+        } else if (attempt == 100) {
+            throw std::runtime_error("Could not create a spill directory in " + parent.string());
+        }
+    }
+#endif
+}
+
+SpillDirectory::~SpillDirectory() {
+    std::error_code ignored;
+    std::filesystem::remove_all(directory, ignored);
+}
+
+std::string SpillDirectory::file(const std::string& name) const {
+    return (std::filesystem::path(directory) / name).string();
+}
+
+void ExternalSorter::add(SpillRecord&& record) {
+    bufferBytes += footprint(record);
+    buffer.push_back(std::move(record));
+    ++recordCount;
+    if (bufferBytes >= memoryBudget) {
+        spill();
+    }
+}
+
+std::string ExternalSorter::newRunPath() {
+    return pathPrefix + std::to_string(nextRun++);
+}
+
+void ExternalSorter::spill() {
+    const SpillOrder recordOrder = order;
+    std::sort(buffer.begin(), buffer.end(), [recordOrder](const SpillRecord& a, const SpillRecord& b) {
+        return less(recordOrder, a, b);
+    });
+
+    const std::string path = newRunPath();
+    runs.push_back(path);
+    SpillFile out(path, "wb", kWriteBufferSize);
+    for (const auto& record : buffer) {
+        writeRecord(out, record, order == SpillOrder::Digest);
+    }
+    out.close();
+    ++spilledRuns;
+
+    // Release the memory, not just the elements, so the budget holds between spills
+    std::vector<SpillRecord>().swap(buffer);
+    bufferBytes = 0;
+}
+
+void ExternalSorter::mergeRuns(const std::vector<std::string>& paths,
+                               const std::function<void(SpillRecord&)>& onRecord) const {
+    const bool withDigest = order == SpillOrder::Digest;
+    const std::size_t readBufferSize = std::min(kMaxReadBufferSize,
+            std::max(kMinReadBufferSize, memoryBudget / (2 * kMaxMergeWidth)));
+
+    std::vector<std::unique_ptr<SpillFile>> inputs;
+    std::vector<SpillRecord> heads(paths.size());
+    for (const auto& path : paths) {
+        inputs.push_back(std::make_unique<SpillFile>(path, "rb", readBufferSize));
+    }
+
+    // Min-heap of the runs by their current record
+    const SpillOrder recordOrder = order;
+    auto later = [&](std::size_t a, std::size_t b) { return less(recordOrder, heads[b], heads[a]); };
+    std::priority_queue<std::size_t, std::vector<std::size_t>, decltype(later)> next(later);
+    for (std::size_t run = 0; run < inputs.size(); ++run) {
+        if (readRecord(*inputs[run], heads[run], withDigest)) {
+            next.push(run);
+        }
+    }
+
+    while (!next.empty()) {
+        const std::size_t run = next.top();
+        next.pop();
+        onRecord(heads[run]);
+        if (readRecord(*inputs[run], heads[run], withDigest)) {
+            next.push(run);
+        }
+    }
+}
+
+void ExternalSorter::merge(const std::function<void(SpillRecord&)>& onRecord) {
+    if (runs.empty()) {
+        // Everything fit the budget, no file was written
+        const SpillOrder recordOrder = order;
+        std::sort(buffer.begin(), buffer.end(), [recordOrder](const SpillRecord& a, const SpillRecord& b) {
+            return less(recordOrder, a, b);
+        });
+        for (auto& record : buffer) {
+            onRecord(record);
+        }
+    } else {
+        if (!buffer.empty()) {
+            spill();
+        }
+
+        // Too many runs to read at once are merged into larger runs first
+        while (runs.size() > kMaxMergeWidth) {
+            const std::vector<std::string> inputs(runs.begin(), runs.begin() + kMaxMergeWidth);
+            const std::string path = newRunPath();
+            {
+                SpillFile out(path, "wb", kWriteBufferSize);
+                mergeRuns(inputs, [&](SpillRecord& record) {
+                    writeRecord(out, record, order == SpillOrder::Digest);
+                });
+                out.close();
+            }
+            runs.erase(runs.begin(), runs.begin() + kMaxMergeWidth);
+            runs.push_back(path);
+            for (const auto& input : inputs) {
+                std::remove(input.c_str());
+            }
+        }
+
+        mergeRuns(runs, onRecord);
+        for (const auto& run : runs) {
+            std::remove(run.c_str());
+        }
+        runs.clear();
+    }
+
+    std::vector<SpillRecord>().swap(buffer);
+    bufferBytes = 0;
+    recordCount = 0;
+}
+
+DuplicateSpool::DuplicateSpool(std::string path)
+        : path(std::move(path)), file(std::make_unique<SpillFile>(this->path, "w+b", kWriteBufferSize)) {
+}
+
+DuplicateSpool::~DuplicateSpool() {
+    file.reset();
+    std::remove(path.c_str());
+}
+
+void DuplicateSpool::append(const DuplicateSet& set) {
+    file->writeString(set.original);
+    file->writeValue(static_cast<std::uint64_t>(set.size));
+    file->writeValue(static_cast<std::uint32_t>(set.paths.size()));
+    file->writeValue(static_cast<std::uint32_t>(set.members.size()));
+    for (const auto& member : set.paths) {
+        file->writeString(member);
+    }
+    for (std::size_t position : set.members) {
+        file->writeValue(static_cast<std::uint32_t>(position));
+    }
+}
+
+void DuplicateSpool::replay(std::size_t chunkBytes, const std::function<void(std::vector<DuplicateSet>&)>& onChunk) {
+    file->rewind();
+    std::vector<DuplicateSet> chunk;
+    std::size_t bytes = 0;
+    std::uint32_t length = 0;
+    while (file->read(&length, sizeof(length))) {
+        DuplicateSet set;
+        set.original.resize(length);
+        if (length != 0 && !file->read(&set.original[0], length)) {
+            throw std::runtime_error("Truncated spill file: " + path);
+        }
+        set.size = file->readValue<std::uint64_t>();
+        const auto pathCount = file->readValue<std::uint32_t>();
+        const auto memberCount = file->readValue<std::uint32_t>();
+        bytes += sizeof(DuplicateSet) + set.original.size() + memberCount * sizeof(std::size_t);
+        for (std::uint32_t p = 0; p < pathCount; ++p) {
+            set.paths.push_back(file->readString());
+            bytes += sizeof(std::string) + set.paths.back().size();
+        }
+        for (std::uint32_t m = 0; m < memberCount; ++m) {
+            set.members.push_back(file->readValue<std::uint32_t>());
+        }
+        chunk.push_back(std::move(set));
+
+        if (bytes >= chunkBytes) {
+            onChunk(chunk);
+            chunk.clear();
+            bytes = 0;
+        }
+    }
+    if (!chunk.empty()) {
+        onChunk(chunk);
+    }
+}
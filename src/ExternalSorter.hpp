@@ -0,0 +1,198 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef EXTERNAL_SORTER_HPP
+#define EXTERNAL_SORTER_HPP
+
+#include "Deduplicator.hpp"
+#include "Digest.hpp"
+#include "FileEntry.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class SpillFile;
+
+/**
+ * @brief A discovered file and, once hashed, its digest.
+ */
+struct SpillRecord {
+    FileEntry file;
+    Digest digest;
+    std::vector<std::string> links;  // Further paths of the inode, only kept in digest order
+};
+
+/**
+ * @brief Orders an ExternalSorter can deliver its records in.
+ */
+enum class SpillOrder {
+    Size,   // By size, then device, inode and path, so the hardlinks of a file are neighbours
+    Digest  // By digest, then path
+};
+
+/**
+ * @brief Sorts records in bounded memory.
+ * @details Records are buffered until their footprint exceeds the budget, then sorted and written
+ *          to a run file. merge() combines the runs with a k-way merge, so only one buffered record
+ *          per run is held at a time. More than kMaxMergeWidth runs are first merged into larger
+ *          runs, which keeps the number of open files bounded however many records are sorted.
+ */
+class ExternalSorter {
+public:
+    // Runs read at the same time by a merge
+    static constexpr std::size_t kMaxMergeWidth = 256;
+
+    /**
+     * @param pathPrefix Run files are created as pathPrefix followed by a number; they must not exist yet.
+     * @param order Order merge() delivers the records in.
+     * @param memoryBudget Bytes of buffered records that trigger a spill to a new run.
+     */
+    ExternalSorter(std::string pathPrefix, SpillOrder order, std::size_t memoryBudget);
+
+    /**
+     * @brief Removes the run files that are left.
+     */
+    ~ExternalSorter();
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    /**
+     * @brief Adds a record, spilling the buffer to a run if it is full.
+     * @throws std::runtime_error If a run file cannot be written.
+     */
+    void add(SpillRecord&& record);
+
+    /**
+     * @brief Delivers all records added so far in order and leaves the sorter empty.
+     * @param onRecord Receives every record once and may move from it.
+     * @throws std::runtime_error If a run file cannot be read or written.
+     */
+    void merge(const std::function<void(SpillRecord&)>& onRecord);
+
+    /**
+     * @brief Number of records added since the last merge.
+     */
+    std::uint64_t size() const { return recordCount; }
+
+    /**
+     * @brief Number of runs written so far, zero while everything fits the budget.
+     */
+    std::size_t runsWritten() const { return spilledRuns; }
+
+    /**
+     * @brief Approximate number of bytes a buffered record occupies.
+     */
+    static std::size_t footprint(const FileEntry& file);
+    static std::size_t footprint(const SpillRecord& record);
+
+    /**
+     * @brief Whether a sorts before b in the given order.
+     */
+    static bool less(SpillOrder order, const SpillRecord& a, const SpillRecord& b);
+
+private:
+    std::string pathPrefix;
+    SpillOrder order;
+    std::size_t memoryBudget;
+    std::vector<SpillRecord> buffer;
+    std::size_t bufferBytes = 0;
+    std::vector<std::string> runs;   // Run files not merged yet
+    std::size_t nextRun = 0;         // Number used for the next run file name
+    std::size_t spilledRuns = 0;
+    std::uint64_t recordCount = 0;
+
+    std::string newRunPath();
+    void spill();
+    void mergeRuns(const std::vector<std::string>& paths, const std::function<void(SpillRecord&)>& onRecord) const;
+};
+
+/**
+ * @brief A private directory for the spill files of one scan, removed with everything in it on destruction.
+ * @details Created with mkdtemp in the temporary directory (TMPDIR), so it is only accessible to the
+ *          current user and its name cannot be predicted. Spill files inside it are created
+ *          exclusively and never through a symbolic link.
+ */
+class SpillDirectory {
+public:
+    /**
+     * @throws std::runtime_error If the directory cannot be created.
+     */
+    SpillDirectory();
+    ~SpillDirectory();
+
+    SpillDirectory(const SpillDirectory&) = delete;
+    SpillDirectory& operator=(const SpillDirectory&) = delete;
+
+    const std::string& path() const { return directory; }
+
+    /**
+     * @brief The path of a file named name inside the directory.
+     */
+    std::string file(const std::string& name) const;
+
+private:
+    std::string directory;
+};
+
+/**
+ * @brief Keeps confirmed duplicate sets in a file until they are acted upon.
+ */
+class DuplicateSpool {
+public:
+    /**
+     * @param path File the sets are written to, which must not exist yet; removed again on destruction.
+     * @throws std::runtime_error If the file cannot be created.
+     */
+    explicit DuplicateSpool(std::string path);
+    ~DuplicateSpool();
+
+    DuplicateSpool(const DuplicateSpool&) = delete;
+    DuplicateSpool& operator=(const DuplicateSpool&) = delete;
+
+    /**
+     * @brief Appends a set.
+     * @throws std::runtime_error If the file cannot be written.
+     */
+    void append(const DuplicateSet& set);
+
+    /**
+     * @brief Reads the sets back in the order they were appended.
+     * @param chunkBytes Approximate number of bytes of the sets handed over at once.
+     * @param onChunk Receives consecutive sets, at least one per call.
+     * @throws std::runtime_error If the file cannot be read.
+     */
+    void replay(std::size_t chunkBytes, const std::function<void(std::vector<DuplicateSet>&)>& onChunk);
+
+private:
+    std::string path;
+    std::unique_ptr<SpillFile> file;
+};
+
+#endif // EXTERNAL_SORTER_HPP
@@ -0,0 +1,44 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ */
+#ifndef FILE_ENTRY_HPP
+#define FILE_ENTRY_HPP
+
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief A regular file discovered during the directory walk.
+ */
+struct FileEntry {
+    std::string path;          // Path of the file as discovered
+    std::uintmax_t size;       // Size of the file in bytes
+    std::uint64_t device = 0;  // Device holding the file (st_dev), zero where unavailable
+    std::uint64_t inode = 0;   // Inode number of the file (st_ino), zero where unavailable
+    std::int64_t mtimeNs = 0;  // Last modification time in nanoseconds since the epoch
+    std::int64_t ctimeNs = 0;  // Last status change time in nanoseconds since the epoch
+};
+
+#endif // FILE_ENTRY_HPP
@@ -0,0 +1,316 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "FileReader.hpp"
+#include "ScanStats.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <ios>
+#include <new>
+#include <stdexcept>
+
+#include "Platform.hpp"
+#if PDCPP_HAS_POSIX_IO
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr std::size_t kBufferAlignment = 4096;
+
+    /**
+     * @brief A page-aligned read buffer owned by one thread and reused for every file it reads.
+     */
+    class ReadBuffer {
+    public:
+        ~ReadBuffer() {
+            release();
+        }
+
+        unsigned char* get(std::size_t size) {
+            if (capacity < size) {
+                release();
+                data = static_cast<unsigned char*>(::operator new[](size, std::align_val_t(kBufferAlignment)));
+                capacity = size;
+            }
+            return data;
+        }
+
+    private:
+        unsigned char* data = nullptr;
+        std::size_t capacity = 0;
+
+        void release() {
+            if (data != nullptr) {
+                ::operator delete[](data, std::align_val_t(kBufferAlignment));
+                data = nullptr;
+                capacity = 0;
+            }
+        }
+    };
+
+    unsigned char* threadBuffer(std::size_t size) {
+        thread_local ReadBuffer buffer;
+        return buffer.get(size);
+    }
+
+    [[noreturn]] void throwReadFailure(const std::string& what, const std::string& filePath) {
+        throw std::ios_base::failure(what + filePath);
+    }
+
+    void streamRange(std::ifstream& file, const std::string& filePath, std::uintmax_t length,
+                     std::size_t bufferSize, const FileReader::ChunkSink& sink) {
+        auto* buffer = threadBuffer(bufferSize);
+        while (length > 0) {
+            const auto wanted = static_cast<std::streamsize>(std::min<std::uintmax_t>(length, bufferSize));
+            file.read(reinterpret_cast<char*>(buffer), wanted);
+            ScanStats::count(StatCounter::ReadCalls);
+            ScanStats::count(StatCounter::BytesRead, static_cast<std::uint64_t>(file.gcount()));
+            if (file.gcount() != wanted) {
+                throwReadFailure("Unexpected end of file: ", filePath);
+            }
+            sink(buffer, static_cast<std::size_t>(wanted));
+            length -= static_cast<std::uintmax_t>(wanted);
+        }
+    }
+
+#if PDCPP_HAS_POSIX_IO
+    /**
+     * @brief Closes the owned file descriptor when leaving scope.
+     */
+    class FileDescriptor {
+    public:
+        explicit FileDescriptor(const std::string& filePath)
+                : fd(::open(filePath.c_str(), O_RDONLY | O_CLOEXEC)) {
+            if (fd < 0) {
+                throwReadFailure("Could not open file: ", filePath);
+            }
+            ScanStats::count(StatCounter::FilesOpened);
+        }
+
+        ~FileDescriptor() {
+            ::close(fd);
+        }
+
+        FileDescriptor(const FileDescriptor&) = delete;
+        FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+        int get() const { return fd; }
+
+    private:
+        int fd;
+    };
+
+    /**
+     * @brief Tells the kernel a file is read once from front to back: aggressive read-ahead, and
+     *        the pages will not be needed again afterwards.
+     */
+    void adviseSequential(int fd) {
+        // Hints only, a failure does not affect correctness
+#if defined(POSIX_FADV_SEQUENTIAL)
+        (void)::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        (void)::posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+#else
+        (void)fd;
+#endif
+    }
+
+    /**
+     * @brief Tells the kernel only a few blocks of a file are needed, read-ahead would be wasted I/O.
+     */
+    void adviseRandom(int fd) {
+#if defined(POSIX_FADV_RANDOM)
+        (void)::posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+#else
+        (void)fd;
+#endif
+    }
+
+    void readSequential(int fd, const std::string& filePath, std::size_t bufferSize, const FileReader::ChunkSink& sink) {
+        auto* buffer = threadBuffer(bufferSize);
+        for (;;) {
+            const ssize_t count = ::read(fd, buffer, bufferSize);
+            ScanStats::count(StatCounter::ReadCalls);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throwReadFailure(std::string("Could not read file (") + std::strerror(errno) + "): ", filePath);
+            }
+            if (count == 0) {
+                return;
+            }
+            ScanStats::count(StatCounter::BytesRead, static_cast<std::uint64_t>(count));
+            sink(buffer, static_cast<std::size_t>(count));
+        }
+    }
+
+    void readMapped(int fd, std::uintmax_t fileSize, const std::string& filePath, std::size_t chunkSize,
+                    const FileReader::ChunkSink& sink) {
+        const auto length = static_cast<std::size_t>(fileSize);
+        void* mapping = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ScanStats::count(StatCounter::MapCalls);
+        if (mapping == MAP_FAILED) {
+            throwReadFailure(std::string("Could not map file (") + std::strerror(errno) + "): ", filePath);
+        }
+        (void)::madvise(mapping, length, MADV_SEQUENTIAL);
+
+        // Hand the mapping out in buffer-sized slices so consumers see the same chunking as with read
+        const auto* data = static_cast<const unsigned char*>(mapping);
+        try {
+            for (std::size_t offset = 0; offset < length; offset += chunkSize) {
+                sink(data + offset, std::min(chunkSize, length - offset));
+            }
+        } catch (...) {
+            ::munmap(mapping, length);
+            throw;
+        }
+        ::munmap(mapping, length);
+        ScanStats::count(StatCounter::BytesRead, length);
+    }
+
+    void preadRange(int fd, const std::string& filePath, const ByteRange& range, std::size_t bufferSize,
+                    const FileReader::ChunkSink& sink) {
+        auto* buffer = threadBuffer(bufferSize);
+        std::uintmax_t offset = range.offset;
+        std::uintmax_t remaining = range.length;
+        while (remaining > 0) {
+            const auto wanted = static_cast<std::size_t>(std::min<std::uintmax_t>(remaining, bufferSize));
+            const ssize_t count = ::pread(fd, buffer, wanted, static_cast<off_t>(offset));
+            ScanStats::count(StatCounter::ReadCalls);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throwReadFailure(std::string("Could not read file (") + std::strerror(errno) + "): ", filePath);
+            }
+            if (count == 0) {
+                throwReadFailure("Unexpected end of file: ", filePath);
+            }
+            ScanStats::count(StatCounter::BytesRead, static_cast<std::uint64_t>(count));
+            sink(buffer, static_cast<std::size_t>(count));
+            offset += static_cast<std::uintmax_t>(count);
+            remaining -= static_cast<std::uintmax_t>(count);
+        }
+    }
+#endif
+}
+
+FileReader::FileReader(ReadBackend backend, std::size_t bufferSize)
+        : readBackend(backend), readBufferSize(bufferSize) {
+    if (readBufferSize == 0) {
+        throw std::invalid_argument("The read buffer size must be greater than zero.");
+    }
+}
+
+void FileReader::readFile(const std::string& filePath, const ChunkSink& sink) const {
+#if PDCPP_HAS_POSIX_IO
+    if (readBackend != ReadBackend::Stream) {
+        FileDescriptor file(filePath);
+
+        struct stat status {};
+        ScanStats::count(StatCounter::StatCalls);
+        if (::fstat(file.get(), &status) != 0) {
+            throwReadFailure(std::string("Could not stat file (") + std::strerror(errno) + "): ", filePath);
+        }
+        const auto fileSize = static_cast<std::uintmax_t>(status.st_size);
+
+        // A length that does not fit in a size_t cannot be mapped as a whole, such files are read instead
+        const bool useMapping = readBackend == ReadBackend::Mmap
+                || (readBackend == ReadBackend::Auto && fileSize >= kAutoMmapThreshold);
+        if (useMapping && fileSize > 0 && fileSize <= kMaxMappedSize) {
+            readMapped(file.get(), fileSize, filePath, readBufferSize, sink);
+            return;
+        }
+
+        adviseSequential(file.get());
+        readSequential(file.get(), filePath, readBufferSize, sink);
+        return;
+    }
+#endif
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        throwReadFailure("Could not open file: ", filePath);
+    }
+    ScanStats::count(StatCounter::FilesOpened);
+
+    auto* buffer = threadBuffer(readBufferSize);
+    const auto bufferLength = static_cast<std::streamsize>(readBufferSize);
+    while (file.read(reinterpret_cast<char*>(buffer), bufferLength) || file.gcount() > 0) {
+        ScanStats::count(StatCounter::ReadCalls);
+        ScanStats::count(StatCounter::BytesRead, static_cast<std::uint64_t>(file.gcount()));
+        sink(buffer, static_cast<std::size_t>(file.gcount()));
+    }
+}
+
+void FileReader::readRanges(const std::string& filePath, const std::vector<ByteRange>& ranges, const ChunkSink& sink) const {
+#if PDCPP_HAS_POSIX_IO
+    if (readBackend != ReadBackend::Stream) {
+        FileDescriptor file(filePath);
+        adviseRandom(file.get());
+        for (const auto& range : ranges) {
+            preadRange(file.get(), filePath, range, readBufferSize, sink);
+        }
+        return;
+    }
+#endif
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        throwReadFailure("Could not open file: ", filePath);
+    }
+    ScanStats::count(StatCounter::FilesOpened);
+    for (const auto& range : ranges) {
+        file.seekg(static_cast<std::streamoff>(range.offset));
+        streamRange(file, filePath, range.length, readBufferSize, sink);
+    }
+}
+
+ReadBackend FileReader::parseBackend(const std::string& name) {
+    for (ReadBackend backend : {ReadBackend::Auto, ReadBackend::Stream, ReadBackend::Pread, ReadBackend::Mmap}) {
+        if (name == backendName(backend)) {
+            return backend;
+        }
+    }
+    throw std::invalid_argument("'" + name + "' is not a known read backend (auto, stream, pread, mmap).");
+}
+
+const char* FileReader::backendName(ReadBackend backend) {
+    switch (backend) {
+        case ReadBackend::Auto:
+            return "auto";
+        case ReadBackend::Stream:
+            return "stream";
+        case ReadBackend::Pread:
+            return "pread";
+        case ReadBackend::Mmap:
+            return "mmap";
+    }
+    return "auto";
+}
@@ -0,0 +1,118 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ */
+#ifndef FILE_READER_HPP
+#define FILE_READER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <string>
+#include <vector>
+
+/**
+ * @brief The system interface used to pull file contents into memory.
+ */
+enum class ReadBackend {
+    Auto,   // pread for regular reads, mmap for very large files
+    Stream, // std::ifstream, available on every platform
+    Pread,  // read/pread into a large aligned buffer with posix_fadvise hints
+    Mmap    // mmap with MADV_SEQUENTIAL
+};
+
+/**
+ * @brief A contiguous part of a file.
+ */
+struct ByteRange {
+    std::uintmax_t offset; // First byte of the range
+    std::uintmax_t length; // Number of bytes in the range
+};
+
+/**
+ * @brief Reads file contents through a selectable backend and hands them out in chunks.
+ * @details Buffers are allocated once per thread and reused for every file, so a reader can be
+ *          shared between the threads of a worker pool. On platforms without POSIX I/O every
+ *          backend falls back to Stream.
+ */
+class FileReader {
+public:
+    using ChunkSink = std::function<void(const unsigned char* data, std::size_t length)>;
+
+    static constexpr std::size_t kDefaultBufferSize = 1 << 20;           // Bytes requested per read call
+    static constexpr std::uintmax_t kAutoMmapThreshold = 64ull << 20;    // Auto maps files at least this large
+#if defined(PDCPP_FORCE_32BIT_PATH)
+    static constexpr std::uintmax_t kMaxMappedSize = 0xFFFFFFFFu;        // Mapping limit of the 32-bit path it simulates
+#else
+    static constexpr std::uintmax_t kMaxMappedSize = std::numeric_limits<std::size_t>::max(); // Larger files are read, not mapped
+#endif
+
+    /**
+     * @brief Constructor to initialize the FileReader object.
+     * @param backend The backend used to read files.
+     * @param bufferSize Bytes requested per read call, also the chunk size handed to the sink.
+     * @throws std::invalid_argument If the buffer size is zero.
+     */
+    explicit FileReader(ReadBackend backend = ReadBackend::Auto, std::size_t bufferSize = kDefaultBufferSize);
+
+    /**
+     * @brief Reads a whole file sequentially.
+     * @param filePath The file to read.
+     * @param sink Receives the content in order, one chunk at a time.
+     * @throws std::ios_base::failure If the file cannot be opened or read.
+     */
+    void readFile(const std::string& filePath, const ChunkSink& sink) const;
+
+    /**
+     * @brief Reads selected parts of a file, opening it only once.
+     * @details Ranges are always read with pread (or the stream fallback), mapping a file for a
+     *          few small blocks would cost more than it saves.
+     * @param filePath The file to read.
+     * @param ranges The parts to read, delivered in the given order.
+     * @param sink Receives the content of the ranges one chunk at a time.
+     * @throws std::ios_base::failure If the file cannot be opened or a range lies beyond its end.
+     */
+    void readRanges(const std::string& filePath, const std::vector<ByteRange>& ranges, const ChunkSink& sink) const;
+
+    ReadBackend backend() const { return readBackend; }
+    std::size_t bufferSize() const { return readBufferSize; }
+
+    /**
+     * @brief Parses a backend name as given on the command line.
+     * @throws std::invalid_argument If the name is unknown.
+     */
+    static ReadBackend parseBackend(const std::string& name);
+
+    /**
+     * @brief Returns the command line name of a backend.
+     */
+    static const char* backendName(ReadBackend backend);
+
+private:
+    ReadBackend readBackend;
+    std::size_t readBufferSize;
+};
+
+#endif // FILE_READER_HPP
@@ -0,0 +1,402 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "FileWalker.hpp"
+#include "Platform.hpp"
+#include "ScanStats.hpp"
+#include "WorkerPool.hpp"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#if PDCPP_HAS_POSIX_IO
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+#endif
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+#if PDCPP_HAS_POSIX_IO
+    constexpr std::size_t kDirentBufferSize = 64 * 1024; // Bytes of directory entries fetched per getdents64 call
+
+    std::int64_t toNanoseconds(std::int64_t seconds, std::int64_t nanoseconds) {
+        return seconds * 1000000000 + nanoseconds;
+    }
+
+    /**
+     * @brief Fills size, identity and timestamps of a file from a stat result.
+     */
+    void describeFile(FileEntry& file, const struct stat& status) {
+        file.size = static_cast<std::uintmax_t>(status.st_size);
+        file.device = static_cast<std::uint64_t>(status.st_dev);
+        file.inode = static_cast<std::uint64_t>(status.st_ino);
+#if defined(__APPLE__)
+        file.mtimeNs = toNanoseconds(status.st_mtimespec.tv_sec, status.st_mtimespec.tv_nsec);
+        file.ctimeNs = toNanoseconds(status.st_ctimespec.tv_sec, status.st_ctimespec.tv_nsec);
+#else
+        file.mtimeNs = toNanoseconds(status.st_mtim.tv_sec, status.st_mtim.tv_nsec);
+        file.ctimeNs = toNanoseconds(status.st_ctim.tv_sec, status.st_ctim.tv_nsec);
+#endif
+    }
+
+    /**
+     * @brief Describes a directory entry relative to its open directory.
+     * @param follow Whether a symbolic link is resolved to its target.
+     * @return The file type bits of the entry, or 0 with errno set if it could not be examined.
+     * @details Uses statx where available and asks only for the fields the pipeline consumes.
+     */
+    mode_t describeEntry(int directoryFd, const char* name, bool follow, FileEntry& file) {
+        const int flags = follow ? 0 : AT_SYMLINK_NOFOLLOW;
+        ScanStats::count(StatCounter::StatCalls);
+#if defined(__linux__) && defined(STATX_BASIC_STATS)
+        struct statx status {};
+        const unsigned int mask = STATX_TYPE | STATX_SIZE | STATX_INO | STATX_MTIME | STATX_CTIME;
+        if (::statx(directoryFd, name, flags | AT_STATX_SYNC_AS_STAT, mask, &status) != 0) {
+            return 0;
+        }
+        file.size = static_cast<std::uintmax_t>(status.stx_size);
+        file.device = static_cast<std::uint64_t>(makedev(status.stx_dev_major, status.stx_dev_minor));
+        file.inode = static_cast<std::uint64_t>(status.stx_ino);
+        file.mtimeNs = toNanoseconds(status.stx_mtime.tv_sec, status.stx_mtime.tv_nsec);
+        file.ctimeNs = toNanoseconds(status.stx_ctime.tv_sec, status.stx_ctime.tv_nsec);
+        return status.stx_mode & S_IFMT;
+#else
+        struct stat status {};
+        if (::fstatat(directoryFd, name, &status, flags) != 0) {
+            return 0;
+        }
+        describeFile(file, status);
+        return status.st_mode & S_IFMT;
+#endif
+    }
+
+    std::string childPath(const std::string& directory, const char* name) {
+        std::string path = directory;
+        if (path.empty() || path.back() != '/') {
+            path += '/';
+        }
+        path += name;
+        return path;
+    }
+
+    /**
+     * @brief Kind of a directory entry as far as the walk is concerned.
+     */
+    enum class EntryKind { Regular, Directory, Symlink, Unknown, Other };
+
+    EntryKind kindOfType(unsigned char type) {
+        switch (type) {
+            case DT_REG: return EntryKind::Regular;
+            case DT_DIR: return EntryKind::Directory;
+            case DT_LNK: return EntryKind::Symlink;
+            case DT_UNKNOWN: return EntryKind::Unknown;
+            default: return EntryKind::Other;
+        }
+    }
+
+    /**
+     * @brief Reads every entry of an open directory and hands its name and kind to the visitor.
+     * @return False with errno set if reading the directory failed part way.
+     */
+    template <typename Visitor>
+    bool readEntries(int directoryFd, Visitor visit) {
+#if defined(__linux__)
+        // Layout of the records returned by getdents64, which glibc only declares for recent versions
+        struct LinuxDirent64 {
+            std::uint64_t d_ino;
+            std::int64_t d_off;
+            unsigned short d_reclen;
+            unsigned char d_type;
+            char d_name[1];
+        };
+        alignas(LinuxDirent64) thread_local char buffer[kDirentBufferSize];
+        for (;;) {
+            const long bytes = ::syscall(SYS_getdents64, directoryFd, buffer, kDirentBufferSize);
+            ScanStats::count(StatCounter::DirectoryReads);
+            if (bytes < 0) {
+                return false;
+            }
+            if (bytes == 0) {
+                return true;
+            }
+            for (long offset = 0; offset < bytes;) {
+                const auto* record = reinterpret_cast<const LinuxDirent64*>(buffer + offset);
+                offset += record->d_reclen;
+                visit(record->d_name, kindOfType(record->d_type));
+            }
+        }
+#else
+        // readdir owns the descriptor from here on, so it works on a duplicate
+        const int ownFd = ::dup(directoryFd);
+        DIR* directory = ownFd >= 0 ? ::fdopendir(ownFd) : nullptr;
+        if (directory == nullptr) {
+            if (ownFd >= 0) {
+                ::close(ownFd);
+            }
+            return false;
+        }
+        errno = 0;
+        while (const struct dirent* record = ::readdir(directory)) {
+            ScanStats::count(StatCounter::DirectoryReads);
+            visit(record->d_name, kindOfType(record->d_type));
+            errno = 0;
+        }
+        const int readError = errno;
+        ::closedir(directory);
+        errno = readError;
+        return readError == 0;
+#endif
+    }
+
+    /**
+     * @brief State shared by the directory tasks of one walk.
+     */
+    class TreeWalk {
+    public:
+        TreeWalk(const FileWalker::EntrySink& onEntry, const FileWalker::ErrorSink& onError,
+                 bool oneFileSystem, dev_t rootDevice, const std::atomic<bool>* cancelled)
+                : onEntry(onEntry), onError(onError), oneFileSystem(oneFileSystem), rootDevice(rootDevice),
+                  cancelled(cancelled) {
+        }
+
+        /**
+         * @brief Opens a directory below the root and walks it, reporting it instead if it cannot be read.
+         */
+        void visitDirectory(std::string path, WorkerPool::TaskGroup& group) {
+            // Queued directories drain without being read once the walk is cancelled
+            if (cancelled != nullptr && cancelled->load(std::memory_order_relaxed)) {
+                return;
+            }
+            const int fd = ::open(path.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            ScanStats::count(StatCounter::DirectoryOpens);
+            if (fd < 0) {
+                report(path, std::strerror(errno));
+                return;
+            }
+            if (oneFileSystem) {
+                struct stat status {};
+                ScanStats::count(StatCounter::StatCalls);
+                if (::fstat(fd, &status) != 0 || status.st_dev != rootDevice) {
+                    ::close(fd);
+                    return;
+                }
+            }
+            walkDirectory(std::move(path), fd, group);
+        }
+
+        /**
+         * @brief Lists an open directory, delivers its files and spawns a task for every subdirectory.
+         * @details Takes ownership of the descriptor.
+         */
+        void walkDirectory(std::string path, int fd, WorkerPool::TaskGroup& group) {
+            std::vector<FileEntry> files;
+            std::vector<std::pair<std::string, std::string>> errors;
+            std::vector<std::string> subdirectories;
+
+            const bool complete = readEntries(fd, [&](const char* name, EntryKind kind) {
+                if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                    return;
+                }
+                if (kind == EntryKind::Directory) {
+                    subdirectories.push_back(childPath(path, name));
+                    return;
+                }
+                if (kind == EntryKind::Other) {
+                    return;
+                }
+
+                // The type is unknown on some file systems, then a single lstat settles it. Symbolic
+                // links to files are listed like the files themselves, links to directories are not followed
+                FileEntry file{std::string(), 0};
+                mode_t type = kind == EntryKind::Regular ? S_IFREG : S_IFLNK;
+                if (kind == EntryKind::Unknown) {
+                    type = describeEntry(fd, name, false, file);
+                    if (type == S_IFDIR) {
+                        subdirectories.push_back(childPath(path, name));
+                        return;
+                    }
+                    if (type == 0) {
+                        errors.emplace_back(childPath(path, name), std::strerror(errno));
+                        return;
+                    }
+                }
+                if (type == S_IFLNK) {
+                    type = describeEntry(fd, name, true, file);
+                    if (type == 0 && (errno == ENOENT || errno == ELOOP)) {
+                        return; // Dangling link
+                    }
+                } else if (type == S_IFREG && kind == EntryKind::Regular) {
+                    type = describeEntry(fd, name, false, file);
+                }
+                if (type == 0) {
+                    errors.emplace_back(childPath(path, name), std::strerror(errno));
+                } else if (type == S_IFREG && (!oneFileSystem || file.device == static_cast<std::uint64_t>(rootDevice))) {
+                    file.path = childPath(path, name);
+                    files.push_back(std::move(file));
+                }
+            });
+            if (!complete) {
+                errors.emplace_back(path, std::strerror(errno));
+            }
+            ::close(fd);
+
+            deliver(files, errors);
+
+            // Spawned last to first so a thread working on its own queue descends in directory order
+            for (auto it = subdirectories.rbegin(); it != subdirectories.rend(); ++it) {
+                group.spawn([this, subdirectory = std::move(*it)](WorkerPool::TaskGroup& spawnedIn) mutable {
+                    visitDirectory(std::move(subdirectory), spawnedIn);
+                });
+            }
+        }
+
+    private:
+        void deliver(std::vector<FileEntry>& files, const std::vector<std::pair<std::string, std::string>>& errors) {
+            if (files.empty() && errors.empty()) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            for (const auto& error : errors) {
+                onError(error.first, error.second);
+            }
+            for (auto& file : files) {
+                onEntry(std::move(file));
+            }
+        }
+
+        void report(const std::string& path, const std::string& message) {
+            std::lock_guard<std::mutex> lock(sinkMutex);
+            onError(path, message);
+        }
+
+        const FileWalker::EntrySink& onEntry;
+        const FileWalker::ErrorSink& onError;
+        const bool oneFileSystem;
+        const dev_t rootDevice;
+        const std::atomic<bool>* cancelled;
+        std::mutex sinkMutex; // Serializes the sinks, which are not expected to be thread-safe
+    };
+#else
+    /**
+     * @brief Fills size and timestamp of a file from its directory entry.
+     */
+    FileEntry describeFile(std::string filePath, const fs::directory_entry& entry) {
+        FileEntry file{std::move(filePath), 0};
+        file.size = entry.file_size();
+        file.mtimeNs = static_cast<std::int64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(entry.last_write_time().time_since_epoch()).count());
+        return file;
+    }
+#endif
+}
+
+FileWalker::FileWalker(std::string root, bool oneFileSystem, const std::atomic<bool>* cancelled)
+        : rootPath(std::move(root)), oneFileSystem(oneFileSystem), cancelled(cancelled) {
+}
+
+void FileWalker::walk(const EntrySink& onEntry, const ErrorSink& onError) const {
+    WorkerPool pool(1);
+    walk(onEntry, onError, pool);
+}
+
+void FileWalker::walk(const EntrySink& onEntry, const ErrorSink& onError, WorkerPool& pool) const {
+#if PDCPP_HAS_POSIX_IO
+    // Only the root is fatal, an unreadable directory further down is reported and skipped
+    const int fd = ::open(rootPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct stat status {};
+    ScanStats::count(StatCounter::DirectoryOpens);
+    ScanStats::count(StatCounter::StatCalls);
+    if (fd < 0 || ::fstat(fd, &status) != 0) {
+        const std::error_code error(errno, std::generic_category());
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        throw fs::filesystem_error("cannot open directory", rootPath, error);
+    }
+
+    TreeWalk tree(onEntry, onError, oneFileSystem, status.st_dev, cancelled);
+    pool.run([&](WorkerPool::TaskGroup& group) {
+        tree.walkDirectory(rootPath, fd, group);
+    });
+#else
+    (void)pool;
+    (void)oneFileSystem;
+    for (const auto& entry : fs::recursive_directory_iterator(rootPath)) {
+        if (cancelled != nullptr && cancelled->load(std::memory_order_relaxed)) {
+            break;
+        }
+        if (entry.is_regular_file()) {
+            std::string filePath = entry.path().string();
+            FileEntry file;
+            try {
+                file = describeFile(filePath, entry);
+            } catch (const std::exception& e) {
+                onError(filePath, e.what());
+                continue;
+            }
+            onEntry(std::move(file));
+        }
+    }
+#endif
+}
+
+bool FileWalker::describe(const std::string& path, FileEntry& file) {
+    file.path = path;
+#if PDCPP_HAS_POSIX_IO
+    struct stat status {};
+    if (::stat(path.c_str(), &status) != 0 || !S_ISREG(status.st_mode)) {
+        return false;
+    }
+    describeFile(file, status);
+    return true;
+#else
+    std::error_code error;
+    const fs::directory_entry entry(path, error);
+    if (error || !entry.is_regular_file(error)) {
+        return false;
+    }
+    try {
+        file = describeFile(path, entry);
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+#endif
+}
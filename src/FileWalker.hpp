@@ -0,0 +1,84 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ */
+#ifndef FILE_WALKER_HPP
+#define FILE_WALKER_HPP
+
+#include "FileEntry.hpp"
+#include <atomic>
+#include <functional>
+#include <string>
+
+class WorkerPool;
+
+/**
+ * @brief Walks a directory tree once and streams every regular file to a consumer.
+ * @details On Linux directories are read with getdents64 and the file type reported with every
+ *          entry decides what to do with it, so only regular files are examined further and only
+ *          through one statx call relative to the open directory. Other POSIX systems fall back
+ *          to readdir and fstatat. Given a pool, directories are read concurrently.
+ */
+class FileWalker {
+public:
+    using EntrySink = std::function<void(FileEntry&& entry)>;
+    using ErrorSink = std::function<void(const std::string& path, const std::string& message)>;
+
+    /**
+     * @brief Constructor to initialize the FileWalker object.
+     * @param root Path to the directory that will be walked.
+     * @param oneFileSystem Whether directories on a different device than the root are skipped.
+     * @param cancelled Once set, directories not opened yet are skipped and the walk returns early.
+     */
+    explicit FileWalker(std::string root, bool oneFileSystem = false, const std::atomic<bool>* cancelled = nullptr);
+
+    /**
+     * @brief Walks the tree, handing every regular file to the sink as soon as it is found.
+     * @param onEntry Receives every regular file together with its size.
+     * @param onError Receives files and directories that could not be read; the walk continues
+     *                without them.
+     * @throws std::filesystem::filesystem_error If the root directory cannot be opened.
+     */
+    void walk(const EntrySink& onEntry, const ErrorSink& onError) const;
+
+    /**
+     * @brief Walks the tree like walk(), reading directories concurrently on the given pool.
+     * @details The sinks are never invoked concurrently, but the order in which directories are
+     *          delivered depends on thread scheduling.
+     */
+    void walk(const EntrySink& onEntry, const ErrorSink& onError, WorkerPool& pool) const;
+
+    /**
+     * @brief Reads size, identity and timestamps of a single regular file, following symbolic links.
+     * @return false if the path is not a regular file or cannot be examined.
+     */
+    static bool describe(const std::string& path, FileEntry& file);
+
+private:
+    std::string rootPath; // The path to the directory being walked
+    bool oneFileSystem;   // Whether the walk stays on the device of the root directory
+    const std::atomic<bool>* cancelled; // Raised by the owner of the walk to stop it, may be null
+};
+
+#endif // FILE_WALKER_HPP
@@ -0,0 +1,290 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "HashCache.hpp"
+#include "Platform.hpp"
+#include "ScanStats.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#if PDCPP_HAS_POSIX_IO
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr char kMagic[8] = {'R', 'M', 'D', 'U', 'P', 'H', 'C', '1'};
+    constexpr std::uint32_t kVersion = 1;
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t recordSize;
+        char algorithm[16];
+        std::uint64_t recordCount;
+        std::uint8_t reserved[24];
+    };
+
+    static_assert(sizeof(Header) == 64, "cache header layout must stay stable");
+    static_assert(sizeof(HashCache::Record) == 112, "cache record layout must stay stable");
+
+    Header makeHeader(const std::string& algorithm, std::uint64_t recordCount) {
+        Header header{};
+        std::memcpy(header.magic, kMagic, sizeof(kMagic));
+        header.version = kVersion;
+        header.recordSize = sizeof(HashCache::Record);
+        std::strncpy(header.algorithm, algorithm.c_str(), sizeof(header.algorithm) - 1);
+        header.recordCount = recordCount;
+        return header;
+    }
+
+    bool keyLess(const HashCache::Record& a, const HashCache::Record& b) {
+        return a.device != b.device ? a.device < b.device : a.inode < b.inode;
+    }
+
+    bool sameKey(const HashCache::Record& a, const HashCache::Record& b) {
+        return a.device == b.device && a.inode == b.inode;
+    }
+
+    bool cacheable(const FileEntry& file) {
+        // Without inode numbers (non-POSIX walks) a file cannot be identified across runs
+        return file.device != 0 || file.inode != 0;
+    }
+}
+
+HashCache::HashCache(std::string path, std::string algorithm)
+        : cachePath(std::move(path)), algorithmName(std::move(algorithm)) {
+    if (algorithmName.size() >= sizeof(Header::algorithm)) {
+        throw std::invalid_argument("Digest algorithm name too long for the hash cache: " + algorithmName);
+    }
+    load();
+}
+
+HashCache::~HashCache() {
+    unmap();
+}
+
+void HashCache::load() {
+    loadMessage.clear();
+#if PDCPP_HAS_POSIX_IO
+    const int fd = ::open(cachePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            loadMessage = std::string("Ignoring unreadable hash cache: ") + std::strerror(errno);
+        }
+        return;
+    }
+    struct stat status {};
+    if (::fstat(fd, &status) == 0 && status.st_size > 0) {
+        mappingSize = static_cast<std::size_t>(status.st_size);
+        void* mapped = ::mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+        mapping = mapped == MAP_FAILED ? nullptr : mapped;
+    }
+    ::close(fd);
+    if (mapping == nullptr) {
+        mappingSize = 0;
+        if (status.st_size > 0) {
+            loadMessage = std::string("Ignoring unreadable hash cache: ") + std::strerror(errno);
+        }
+        return;
+    }
+#else
+    std::ifstream in(cachePath, std::ios::binary | std::ios::ate);
+    if (!in) {
+        return;
+    }
+    mappingSize = static_cast<std::size_t>(in.tellg());
+    mapping = ::operator new(mappingSize);
+    in.seekg(0);
+    if (!in.read(static_cast<char*>(mapping), static_cast<std::streamsize>(mappingSize))) {
+        unmap();
+        return;
+    }
+#endif
+
+    Header header{};
+    bool valid = mappingSize >= sizeof(Header);
+    if (valid) {
+        std::memcpy(&header, mapping, sizeof(Header));
+        valid = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+                && header.version == kVersion
+                && header.recordSize == sizeof(Record)
+                && header.recordCount <= (mappingSize - sizeof(Header)) / sizeof(Record);
+    }
+    if (!valid) {
+        loadMessage = "Ignoring corrupt hash cache; it will be rebuilt.";
+        unmap();
+        return;
+    }
+    header.algorithm[sizeof(header.algorithm) - 1] = '\0';
+    if (algorithmName != header.algorithm) {
+        // Digests of another algorithm can never match; the file is rebuilt on save
+        unmap();
+        return;
+    }
+    records = reinterpret_cast<const Record*>(static_cast<const char*>(mapping) + sizeof(Header));
+    recordCount = static_cast<std::size_t>(header.recordCount);
+    touched.assign(recordCount, 0);
+}
+
+void HashCache::unmap() {
+    if (mapping != nullptr) {
+#if PDCPP_HAS_POSIX_IO
+        ::munmap(mapping, mappingSize);
+#else
+        ::operator delete(mapping);
+#endif
+    }
+    mapping = nullptr;
+    mappingSize = 0;
+    records = nullptr;
+    recordCount = 0;
+    touched.clear();
+}
+
+const HashCache::Record* HashCache::find(const FileEntry& file) const {
+    if (recordCount == 0) {
+        return nullptr;
+    }
+    Record key{};
+    key.device = file.device;
+    key.inode = file.inode;
+    const Record* end = records + recordCount;
+    const Record* found = std::lower_bound(records, end, key, keyLess);
+    if (found == end || !sameKey(*found, key)
+        || found->size != file.size || found->mtimeNs != file.mtimeNs || found->ctimeNs != file.ctimeNs
+        || found->digestLength == 0 || found->digestLength > sizeof(found->digest)) {
+        return nullptr;
+    }
+    return found;
+}
+
+bool HashCache::lookup(const FileEntry& file, Digest& digest) {
+    if (!cacheable(file)) {
+        return false;
+    }
+    const Record* found = find(file);
+    if (found == nullptr) {
+        ScanStats::count(StatCounter::CacheMisses);
+        return false;
+    }
+
+    digest.length = found->digestLength;
+    std::memcpy(digest.bytes.data(), found->digest, found->digestLength);
+    touched[static_cast<std::size_t>(found - records)] = 1;
+    ++hitCount;
+    ScanStats::count(StatCounter::CacheHits);
+    return true;
+}
+
+void HashCache::keep(const FileEntry& file) {
+    if (!cacheable(file)) {
+        return;
+    }
+    const Record* found = find(file);
+    if (found != nullptr) {
+        touched[static_cast<std::size_t>(found - records)] = 1;
+    }
+}
+
+void HashCache::store(const FileEntry& file, const Digest& digest) {
+    if (!cacheable(file) || digest.length == 0) {
+        return;
+    }
+    Record record{};
+    record.device = file.device;
+    record.inode = file.inode;
+    record.size = file.size;
+    record.mtimeNs = file.mtimeNs;
+    record.ctimeNs = file.ctimeNs;
+    record.digestLength = digest.length;
+    std::memcpy(record.digest, digest.bytes.data(), digest.length);
+    pending.push_back(record);
+}
+
+void HashCache::save(bool prune) {
+    // Records are never moved inside the mapping: another run may be reading the same file
+    if (!pending.empty() || mapping == nullptr
+        || (prune && std::find(touched.begin(), touched.end(), 0) != touched.end())) {
+        rewrite(prune);
+    }
+}
+
+void HashCache::rewrite(bool prune) {
+    // The newest record of an inode wins, both among this run's stores and over older records
+    std::stable_sort(pending.begin(), pending.end(), keyLess);
+    std::vector<Record> merged;
+    merged.reserve(recordCount + pending.size());
+    std::size_t oldIndex = 0;
+    for (std::size_t i = 0; i < pending.size(); ++i) {
+        if (i + 1 < pending.size() && sameKey(pending[i], pending[i + 1])) {
+            continue;
+        }
+        for (; oldIndex < recordCount && keyLess(records[oldIndex], pending[i]); ++oldIndex) {
+            if (!prune || touched[oldIndex]) {
+                merged.push_back(records[oldIndex]);
+            }
+        }
+        if (oldIndex < recordCount && sameKey(records[oldIndex], pending[i])) {
+            ++oldIndex;
+        }
+        merged.push_back(pending[i]);
+    }
+    for (; oldIndex < recordCount; ++oldIndex) {
+        if (!prune || touched[oldIndex]) {
+            merged.push_back(records[oldIndex]);
+        }
+    }
+
+    // Write a complete new file next to the old one and swap it in, so a crash never leaves a torn cache
+    const std::string tempPath = cachePath + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        const Header header = makeHeader(algorithmName, merged.size());
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(merged.data()),
+                  static_cast<std::streamsize>(merged.size() * sizeof(Record)));
+        out.flush();
+        if (!out) {
+            out.close();
+            std::remove(tempPath.c_str());
+            throw std::runtime_error("Could not write hash cache: " + tempPath);
+        }
+    }
+    unmap();
+    if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        throw std::runtime_error("Could not replace hash cache: " + cachePath);
+    }
+    pending.clear();
+    load();
+}
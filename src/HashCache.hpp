@@ -0,0 +1,135 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef HASH_CACHE_HPP
+#define HASH_CACHE_HPP
+
+#include "Digest.hpp"
+#include "FileEntry.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Persistent store of full-file digests from previous runs, keyed by file metadata.
+ * @details A digest is reused when device, inode, size, mtime and ctime of a file all still match
+ *          the recorded values, so unchanged files are never read again. The file on disk is a
+ *          fixed-size header followed by fixed-size records sorted by (device, inode): it is
+ *          memory-mapped and searched in place, and never written through the mapping. Records
+ *          written by a different digest algorithm are never returned.
+ *          Lookups and stores must come from a single thread.
+ */
+class HashCache {
+public:
+    /**
+     * @brief Opens the cache file, or starts an empty cache if it does not exist yet.
+     * @param path Location of the cache file.
+     * @param algorithm Name of the digest algorithm the stored digests were computed with.
+     * @details An unreadable, corrupt or foreign cache file is ignored and replaced on save(); why an
+     *          unreadable or corrupt one was ignored is kept in loadError().
+     */
+    HashCache(std::string path, std::string algorithm);
+    ~HashCache();
+
+    HashCache(const HashCache&) = delete;
+    HashCache& operator=(const HashCache&) = delete;
+
+    /**
+     * @brief Looks up the digest of a file.
+     * @param file The file, with the metadata gathered during the walk.
+     * @param digest Receives the digest on a hit.
+     * @return true if a record matches the file's current metadata.
+     */
+    bool lookup(const FileEntry& file, Digest& digest);
+
+    /**
+     * @brief Marks a file as seen during this run, so that a pruning save() keeps its record.
+     * @details For files that are never looked up, such as files of a unique size.
+     * @param file The file, with the metadata gathered during the walk.
+     */
+    void keep(const FileEntry& file);
+
+    /**
+     * @brief Records the digest of a file, replacing any older record of the same inode on save().
+     * @param file The file, with the metadata gathered during the walk.
+     * @param digest The full-file digest.
+     */
+    void store(const FileEntry& file, const Digest& digest);
+
+    /**
+     * @brief Writes the cache back to disk.
+     * @param prune Also drop every record that was neither hit, kept nor stored during this run.
+     * @details The kept and new records are written to a fresh file which atomically replaces the old
+     *          one, so another run that still maps the old file keeps reading consistent records.
+     *          An existing file is left alone when nothing was stored and nothing is pruned.
+     * @throws std::runtime_error If the cache file cannot be written.
+     */
+    void save(bool prune);
+
+    std::size_t hits() const { return hitCount; }
+    std::size_t stores() const { return pending.size(); }
+    std::size_t size() const { return recordCount; }
+
+    /**
+     * @brief Why the cache file could not be used when it was opened, empty if it was used or absent.
+     * @details The cache writes nothing to the console itself, the scan reports this message.
+     */
+    const std::string& loadError() const { return loadMessage; }
+
+    /**
+     * @brief On-disk layout of a cached digest, exposed for tests and tooling.
+     */
+    struct Record {
+        std::uint64_t device;
+        std::uint64_t inode;
+        std::uint64_t size;
+        std::int64_t mtimeNs;
+        std::int64_t ctimeNs;
+        std::uint8_t digestLength;
+        std::uint8_t reserved[7];
+        std::uint8_t digest[Digest::kMaxSize];
+    };
+
+private:
+    std::string cachePath;
+    std::string algorithmName;
+    void* mapping = nullptr;        // Mapped cache file, or heap copy where mmap is unavailable
+    std::size_t mappingSize = 0;
+    const Record* records = nullptr;
+    std::size_t recordCount = 0;
+    std::vector<char> touched;      // Records hit or kept during this run
+    std::vector<Record> pending;    // Records stored during this run
+    std::size_t hitCount = 0;
+    std::string loadMessage;        // Why the file was ignored by the last load()
+
+    void load();
+    const Record* find(const FileEntry& file) const;
+    void unmap();
+    void rewrite(bool prune);
+};
+
+#endif // HASH_CACHE_HPP
@@ -0,0 +1,303 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "Hasher.hpp"
+#include "Platform.hpp"
+#include <openssl/evp.h>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#if PDCPP_HAVE_XXHASH
+#include <xxhash.h>
+#endif
+#if PDCPP_HAVE_BLAKE3
+#include <blake3.h>
+#endif
+
+namespace {
+    /**
+     * @brief Looks up an OpenSSL digest once per process.
+     * @details On OpenSSL 3 every EVP_DigestInit_ex() with a legacy EVP_blake2b512() style handle
+     *          performs an implicit fetch, with a provider lookup and locking, for every file. The
+     *          explicitly fetched EVP_MD is kept for the lifetime of the process instead.
+     */
+    const EVP_MD* fetchDigest(const std::string& name) {
+        static std::mutex mutex;
+        static std::map<std::string, const EVP_MD*> fetched;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto known = fetched.find(name);
+        if (known != fetched.end()) {
+            return known->second;
+        }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        const EVP_MD* md = EVP_MD_fetch(nullptr, name.c_str(), nullptr);
+#else
+        const EVP_MD* md = EVP_get_digestbyname(name.c_str());
+#endif
+        if (md == nullptr) {
+            throw std::runtime_error("OpenSSL does not provide the digest " + name + ".");
+        }
+        fetched.emplace(name, md);
+        return md;
+    }
+
+    /**
+     * @brief Any digest provided by OpenSSL through the EVP interface, reusing one context for every message.
+     */
+    class EvpHasher : public Hasher {
+    public:
+        explicit EvpHasher(const std::string& name) : context(EVP_MD_CTX_new()), md(nullptr) {
+            if (context == nullptr) {
+                throw std::runtime_error("Failed to create EVP_MD_CTX.");
+            }
+            try {
+                md = fetchDigest(name);
+            } catch (...) {
+                EVP_MD_CTX_free(context);
+                throw;
+            }
+        }
+
+        ~EvpHasher() override {
+            EVP_MD_CTX_free(context);
+        }
+
+        EvpHasher(const EvpHasher&) = delete;
+        EvpHasher& operator=(const EvpHasher&) = delete;
+
+        void update(const unsigned char* data, std::size_t length) override {
+            if (!started) {
+                start();
+            }
+            if (EVP_DigestUpdate(context, data, length) != 1) {
+                throw std::runtime_error("Failed to update hash during file processing.");
+            }
+        }
+
+        Digest finish() override {
+            static_assert(Digest::kMaxSize >= EVP_MAX_MD_SIZE, "Digest cannot hold every EVP digest");
+            if (!started) {
+                start();
+            }
+            Digest digest;
+            unsigned int hashLength = 0;
+            started = false;
+            if (EVP_DigestFinal_ex(context, digest.bytes.data(), &hashLength) != 1) {
+                throw std::runtime_error("Failed to finalize hash.");
+            }
+            digest.length = static_cast<std::uint8_t>(hashLength);
+            return digest;
+        }
+
+        void reset() override {
+            if (started) {
+                EVP_MD_CTX_reset(context);
+                started = false;
+            }
+        }
+
+    private:
+        EVP_MD_CTX* context;
+        const EVP_MD* md;
+        bool started = false; // A message is in progress, otherwise the next update initialises the context
+
+        void start() {
+            // Re-initialising with the same EVP_MD keeps the context's allocations
+            if (EVP_DigestInit_ex(context, md, nullptr) != 1) {
+                throw std::runtime_error("Failed to initialize digest.");
+            }
+            started = true;
+        }
+    };
+
+#if PDCPP_HAVE_XXHASH
+    /**
+     * @brief XXH3 with a 64-bit or a 128-bit result, stored in canonical (big-endian) byte order.
+     */
+    class Xxh3Hasher : public Hasher {
+    public:
+        explicit Xxh3Hasher(bool wide) : state(XXH3_createState()), wide(wide) {
+            if (state == nullptr) {
+                throw std::runtime_error("Failed to create XXH3 state.");
+            }
+            start();
+        }
+
+        ~Xxh3Hasher() override {
+            XXH3_freeState(state);
+        }
+
+        Xxh3Hasher(const Xxh3Hasher&) = delete;
+        Xxh3Hasher& operator=(const Xxh3Hasher&) = delete;
+
+        void update(const unsigned char* data, std::size_t length) override {
+            const XXH_errorcode result = wide ? XXH3_128bits_update(state, data, length)
+                                              : XXH3_64bits_update(state, data, length);
+            if (result != XXH_OK) {
+                throw std::runtime_error("Failed to update hash during file processing.");
+            }
+        }
+
+        Digest finish() override {
+            Digest digest;
+            if (wide) {
+                XXH128_canonical_t canonical;
+                XXH128_canonicalFromHash(&canonical, XXH3_128bits_digest(state));
+                std::memcpy(digest.bytes.data(), canonical.digest, sizeof(canonical.digest));
+                digest.length = sizeof(canonical.digest);
+            } else {
+                XXH64_canonical_t canonical;
+                XXH64_canonicalFromHash(&canonical, XXH3_64bits_digest(state));
+                std::memcpy(digest.bytes.data(), canonical.digest, sizeof(canonical.digest));
+                digest.length = sizeof(canonical.digest);
+            }
+            start();
+            return digest;
+        }
+
+        void reset() override {
+            start();
+        }
+
+    private:
+        XXH3_state_t* state;
+        bool wide;
+
+        void start() {
+            if ((wide ? XXH3_128bits_reset(state) : XXH3_64bits_reset(state)) != XXH_OK) {
+                throw std::runtime_error("Failed to initialize digest.");
+            }
+        }
+    };
+#endif
+
+#if PDCPP_HAVE_BLAKE3
+    /**
+     * @brief BLAKE3 with its default 256-bit output, using the SIMD kernels the library selects at runtime.
+     */
+    class Blake3Hasher : public Hasher {
+    public:
+        Blake3Hasher() {
+            blake3_hasher_init(&state);
+        }
+
+        void update(const unsigned char* data, std::size_t length) override {
+            blake3_hasher_update(&state, data, length);
+        }
+
+        Digest finish() override {
+            Digest digest;
+            blake3_hasher_finalize(&state, digest.bytes.data(), BLAKE3_OUT_LEN);
+            digest.length = BLAKE3_OUT_LEN;
+            blake3_hasher_init(&state);
+            return digest;
+        }
+
+        void reset() override {
+            blake3_hasher_init(&state);
+        }
+
+    private:
+        blake3_hasher state;
+    };
+#endif
+
+    std::unique_ptr<Hasher> createEvpHasher(const HashAlgorithm& algorithm) {
+        return std::make_unique<EvpHasher>(algorithm.name());
+    }
+
+    const std::vector<HashAlgorithm>& registry() {
+        static const std::vector<HashAlgorithm> algorithms = {
+                HashAlgorithm("blake2b512", true, createEvpHasher),
+                HashAlgorithm("blake2s256", true, createEvpHasher),
+                HashAlgorithm("sha256", true, createEvpHasher),
+#if PDCPP_HAVE_BLAKE3
+                HashAlgorithm("blake3", true, [](const HashAlgorithm&) -> std::unique_ptr<Hasher> {
+                    return std::make_unique<Blake3Hasher>();
+                }),
+#endif
+#if PDCPP_HAVE_XXHASH
+                HashAlgorithm("xxh3", false, [](const HashAlgorithm&) -> std::unique_ptr<Hasher> {
+                    return std::make_unique<Xxh3Hasher>(false);
+                }),
+                HashAlgorithm("xxh128", false, [](const HashAlgorithm&) -> std::unique_ptr<Hasher> {
+                    return std::make_unique<Xxh3Hasher>(true);
+                }),
+#endif
+        };
+        return algorithms;
+    }
+}
+
+HashAlgorithm::HashAlgorithm(std::string name, bool cryptographic, Factory factory)
+        : algorithmName(std::move(name)), cryptographic(cryptographic), factory(factory) {
+}
+
+const HashAlgorithm& HashAlgorithm::byName(const std::string& name) {
+    for (const auto& algorithm : registry()) {
+        if (algorithm.name() == name) {
+            return algorithm;
+        }
+    }
+
+    std::string available;
+    for (const auto& algorithm : registry()) {
+        available += (available.empty() ? "" : ", ") + algorithm.name();
+    }
+    throw std::invalid_argument("Unknown hash algorithm '" + name + "', available: " + available + ".");
+}
+
+const HashAlgorithm& HashAlgorithm::platformDefault() {
+#if PDCPP_USE_64BIT_HASH_ALGORITHM
+    return byName("blake2b512");
+#else
+    return byName("blake2s256");
+#endif
+}
+
+Hasher& HashAlgorithm::threadHasher(std::size_t slot) const {
+    thread_local std::unordered_map<const HashAlgorithm*, std::vector<std::unique_ptr<Hasher>>> hashers;
+    auto& owned = hashers[this];
+    if (owned.size() <= slot) {
+        owned.resize(slot + 1);
+    }
+    if (!owned[slot]) {
+        owned[slot] = createHasher();
+    }
+    return *owned[slot];
+}
+
+std::vector<std::string> HashAlgorithm::names() {
+    std::vector<std::string> result;
+    for (const auto& algorithm : registry()) {
+        result.push_back(algorithm.name());
+    }
+    return result;
+}
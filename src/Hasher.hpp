@@ -0,0 +1,113 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef HASHER_HPP
+#define HASHER_HPP
+
+#include "Digest.hpp"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Incremental digest computation over a stream of bytes.
+ */
+class Hasher {
+public:
+    virtual ~Hasher() = default;
+
+    /**
+     * @brief Feeds the next bytes of the message.
+     * @throws std::runtime_error If the underlying implementation fails.
+     */
+    virtual void update(const unsigned char* data, std::size_t length) = 0;
+
+    /**
+     * @brief Returns the digest of everything fed so far and starts over with an empty message.
+     * @throws std::runtime_error If the underlying implementation fails.
+     */
+    virtual Digest finish() = 0;
+
+    /**
+     * @brief Abandons a partially fed message, e.g. after a read error, without releasing resources.
+     */
+    virtual void reset() = 0;
+};
+
+/**
+ * @brief A digest algorithm selectable at runtime with --hash.
+ * @details OpenSSL provides the cryptographic algorithms. BLAKE3 and the xxh3 family are only
+ *          available when the build found their libraries. Non-cryptographic algorithms are fast
+ *          but a collision can be crafted or happen by chance, so callers must confirm their
+ *          matches by other means before acting on them.
+ */
+class HashAlgorithm {
+public:
+    using Factory = std::unique_ptr<Hasher> (*)(const HashAlgorithm&);
+
+    HashAlgorithm(std::string name, bool cryptographic, Factory factory);
+
+    /**
+     * @brief Looks up an algorithm built into this binary.
+     * @throws std::invalid_argument If no algorithm of that name is available.
+     */
+    static const HashAlgorithm& byName(const std::string& name);
+
+    /**
+     * @brief Blake2b512 on 64-bit platforms and Blake2s256 on 32-bit platforms.
+     */
+    static const HashAlgorithm& platformDefault();
+
+    /**
+     * @brief Names of all algorithms built into this binary.
+     */
+    static std::vector<std::string> names();
+
+    const std::string& name() const { return algorithmName; }
+    bool isCryptographic() const { return cryptographic; }
+
+    /**
+     * @brief Creates a hasher, each one must only be used by one thread at a time.
+     * @throws std::runtime_error If the algorithm cannot be initialised.
+     */
+    std::unique_ptr<Hasher> createHasher() const { return factory(*this); }
+
+    /**
+     * @brief Returns a hasher owned by the calling thread, created on first use and reused afterwards.
+     * @param slot Selects one of several hashers of the thread, for messages that are fed interleaved.
+     * @details The returned hasher may hold the remains of an abandoned message; call Hasher::reset()
+     *          before starting a new one.
+     */
+    Hasher& threadHasher(std::size_t slot = 0) const;
+
+private:
+    std::string algorithmName;
+    bool cryptographic;
+    Factory factory;
+};
+
+#endif // HASHER_HPP
@@ -0,0 +1,155 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "PathStore.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+PathStore::PathStore(std::string root) : rootPath(std::move(root)) {
+    nodes.push_back({store(rootPath.data(), rootPath.size()), kNoParent});
+}
+
+bool PathStore::NodeKey::operator==(const NodeKey& other) const {
+    return parent == other.parent && std::strcmp(name, other.name) == 0;
+}
+
+std::size_t PathStore::NodeKeyHash::operator()(const NodeKey& key) const {
+    // FNV-1a over the name, mixed with the parent
+    std::uint64_t hash = 0xcbf29ce484222325ull ^ key.parent;
+    for (const char* c = key.name; *c != '\0'; ++c) {
+        hash = (hash ^ static_cast<unsigned char>(*c)) * 0x100000001b3ull;
+    }
+    return static_cast<std::size_t>(hash);
+}
+
+std::uint64_t PathStore::store(const char* data, std::size_t length) {
+    if (chunkUsed + length + 1 > kChunkSize) {
+        // Oversized texts, only ever paths outside of the root, get a chunk of their own size
+        chunks.emplace_back(new char[std::max(kChunkSize, length + 1)]);
+        chunkUsed = 0;
+    }
+    char* target = chunks.back().get() + chunkUsed;
+    std::memcpy(target, data, length);
+    target[length] = '\0';
+    const std::uint64_t offset = static_cast<std::uint64_t>(chunks.size() - 1) * kChunkSize + chunkUsed;
+    // An oversized text fills its chunk on its own, offsets only address kChunkSize bytes of a chunk
+    chunkUsed = std::min(kChunkSize, chunkUsed + length + 1);
+    return offset;
+}
+
+const char* PathStore::text(std::uint64_t offset) const {
+    return chunks[static_cast<std::size_t>(offset / kChunkSize)].get() + offset % kChunkSize;
+}
+
+std::uint32_t PathStore::child(std::uint32_t parent, const char* name, std::size_t length) {
+    const std::string key(name, length);
+    auto found = nodeOf.find({parent, key.c_str()});
+    if (found != nodeOf.end()) {
+        return found->second;
+    }
+    if (nodes.size() >= kNoParent) {
+        throw std::length_error("Too many directories for the path store.");
+    }
+    const auto node = static_cast<std::uint32_t>(nodes.size());
+    nodes.push_back({store(name, length), parent});
+    nodeOf.emplace(NodeKey{parent, text(nodes.back().name)}, node);
+    return node;
+}
+
+std::uint32_t PathStore::directoryOf(const std::string& path, std::size_t length) {
+    if (length == rootPath.size() && path.compare(0, length, rootPath) == 0) {
+        return 0;
+    }
+
+    // Below the root every component is a node of its own, the walker joins them with one slash
+    std::size_t begin = rootPath.size();
+    const bool belowRoot = length > begin && path.compare(0, begin, rootPath) == 0
+            && (rootPath.empty() || rootPath.back() == '/' || path[begin++] == '/');
+    if (!belowRoot) {
+        return child(kNoParent, path.data(), length);
+    }
+
+    std::uint32_t node = 0;
+    while (begin <= length) {
+        std::size_t end = path.find('/', begin);
+        if (end == std::string::npos || end > length) {
+            end = length;
+        }
+        node = child(node, path.data() + begin, end - begin);
+        begin = end + 1;
+    }
+    return node;
+}
+
+PathRef PathStore::intern(const std::string& path) {
+    const std::size_t slash = path.rfind('/');
+    // A file right below "/" keeps the slash as its directory
+    const std::size_t directoryLength = slash == std::string::npos ? 0 : std::max<std::size_t>(slash, 1);
+    const std::size_t nameBegin = slash == std::string::npos ? 0 : slash + 1;
+
+    // Files of one directory usually arrive together
+    if (lastDirectory == kNoParent || directoryLength != lastDirectoryPath.size()
+            || path.compare(0, directoryLength, lastDirectoryPath) != 0) {
+        lastDirectory = directoryOf(path, directoryLength);
+        lastDirectoryPath.assign(path, 0, directoryLength);
+    }
+    return {store(path.data() + nameBegin, path.size() - nameBegin), lastDirectory};
+}
+
+void PathStore::appendDirectory(std::uint32_t node, std::string& out) const {
+    const Node& directory = nodes[node];
+    if (directory.parent != kNoParent) {
+        appendDirectory(directory.parent, out);
+        if (!out.empty() && out.back() != '/') {
+            out += '/';
+        }
+    }
+    out += text(directory.name);
+}
+
+void PathStore::appendPath(const PathRef& ref, std::string& out) const {
+    appendDirectory(ref.directory, out);
+    if (!out.empty() && out.back() != '/') {
+        out += '/';
+    }
+    out += text(ref.name);
+}
+
+std::string PathStore::path(const PathRef& ref) const {
+    std::string out;
+    appendPath(ref, out);
+    return out;
+}
+
+std::size_t PathStore::memoryUsage() const {
+    std::size_t bytes = chunks.size() * kChunkSize + nodes.capacity() * sizeof(Node);
+    // Every map entry costs a node with the key, the value and the bucket link
+    bytes += nodeOf.size() * (sizeof(NodeKey) + sizeof(std::uint32_t) + 2 * sizeof(void*));
+    bytes += nodeOf.bucket_count() * sizeof(void*);
+    return bytes;
+}
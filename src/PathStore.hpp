@@ -0,0 +1,126 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef PATH_STORE_HPP
+#define PATH_STORE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief A path kept in a PathStore: the directory it lives in and where its name is stored.
+ */
+struct PathRef {
+    std::uint64_t name = 0;       // Offset of the file name in the arena of the store
+    std::uint32_t directory = 0;  // Directory node the file lives in
+};
+
+/**
+ * @brief Stores many paths below a common root in a fraction of the memory of separate strings.
+ * @details Every directory is interned once as a node holding its parent and its own name, and
+ *          every file is reduced to a PathRef: the node of its directory and the offset of its name.
+ *          Names live NUL-terminated in an arena of large chunks, so storing a path costs no heap
+ *          allocation of its own. Full paths are rebuilt on demand and match the interned text
+ *          byte for byte. Paths of one directory added in a row take a fast path that neither
+ *          splits nor looks up their directory.
+ */
+class PathStore {
+public:
+    // Bytes per arena chunk; names never span two chunks
+    static constexpr std::size_t kChunkSize = 64 * 1024;
+
+    /**
+     * @param root Directory the paths are expected below; others are stored with less sharing.
+     */
+    explicit PathStore(std::string root);
+
+    PathStore(const PathStore&) = delete;
+    PathStore& operator=(const PathStore&) = delete;
+
+    /**
+     * @brief Stores a path of a file.
+     */
+    PathRef intern(const std::string& path);
+
+    /**
+     * @brief Rebuilds the full path of a stored file.
+     */
+    std::string path(const PathRef& ref) const;
+
+    /**
+     * @brief Appends the full path of a stored file to out.
+     */
+    void appendPath(const PathRef& ref, std::string& out) const;
+
+    /**
+     * @brief Number of directories interned.
+     */
+    std::size_t directories() const { return nodes.size(); }
+
+    /**
+     * @brief Approximate number of bytes held by the store.
+     */
+    std::size_t memoryUsage() const;
+
+private:
+    static constexpr std::uint32_t kNoParent = 0xFFFFFFFFu;
+
+    struct Node {
+        std::uint64_t name;     // Offset of the name, the full path for nodes without a parent
+        std::uint32_t parent;   // kNoParent for the root and for directories outside of it
+    };
+
+    struct NodeKey {
+        std::uint32_t parent;
+        const char* name;
+
+        bool operator==(const NodeKey& other) const;
+    };
+
+    struct NodeKeyHash {
+        std::size_t operator()(const NodeKey& key) const;
+    };
+
+    std::string rootPath;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::size_t chunkUsed = kChunkSize;  // Bytes used of the last chunk
+    std::vector<Node> nodes;
+    std::unordered_map<NodeKey, std::uint32_t, NodeKeyHash> nodeOf;
+    std::string lastDirectoryPath;       // Full path of the directory of the last interned file
+    std::uint32_t lastDirectory = kNoParent;
+
+    std::uint64_t store(const char* text, std::size_t length);
+    const char* text(std::uint64_t offset) const;
+    std::uint32_t child(std::uint32_t parent, const char* name, std::size_t length);
+    std::uint32_t directoryOf(const std::string& path, std::size_t length);
+    void appendDirectory(std::uint32_t node, std::string& out) const;
+};
+
+#endif // PATH_STORE_HPP
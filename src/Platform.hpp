@@ -0,0 +1,49 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ */
+#ifndef PLATFORM_HPP
+#define PLATFORM_HPP
+
+// POSIX file APIs (open/pread/mmap/stat) are available on Linux and the BSDs including macOS;
+// other platforms fall back to std::filesystem and iostreams
+#if defined(__unix__) || defined(__APPLE__)
+#define PDCPP_HAS_POSIX_IO 1
+#else
+#define PDCPP_HAS_POSIX_IO 0
+#endif
+
+//depending on architecture we load blake2s256 for 32-bit Platforms and blake2b512 for 64-bit platforms
+#if defined(PDCPP_FORCE_32BIT_PATH)
+// Force 32-bit path for testing
+    #define PDCPP_USE_64BIT_HASH_ALGORITHM 0
+#elif defined(__x86_64__) || defined(_M_X64) || defined(__amd64) || defined(__aarch64__) || defined(_M_ARM64)
+// Normal 64-bit detection
+#define PDCPP_USE_64BIT_HASH_ALGORITHM 1
+#else
+// Real 32-bit systems
+    #define PDCPP_USE_64BIT_HASH_ALGORITHM 0
+#endif
+
+#endif // PLATFORM_HPP
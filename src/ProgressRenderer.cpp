@@ -0,0 +1,184 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "ProgressRenderer.hpp"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+    constexpr int kBarWidth = 30;
+
+    std::string formatBytes(double bytes) {
+        static const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+        std::size_t unit = 0;
+        while (bytes >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0])) {
+            bytes /= 1024.0;
+            ++unit;
+        }
+        char text[32];
+        std::snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", bytes, units[unit]);
+        return text;
+    }
+
+    std::string formatDuration(double seconds) {
+        const auto total = static_cast<long long>(seconds + 0.5);
+        char text[32];
+        if (total >= 3600) {
+            std::snprintf(text, sizeof(text), "%lld:%02lld:%02lld", total / 3600, total / 60 % 60, total % 60);
+        } else {
+            std::snprintf(text, sizeof(text), "%02lld:%02lld", total / 60, total % 60);
+        }
+        return text;
+    }
+}
+
+ProgressRenderer::ProgressRenderer(std::ostream& out, bool enabled)
+        : out(out), enabled(enabled), startTime(std::chrono::steady_clock::now()) {
+    if (enabled) {
+        thread = std::thread(&ProgressRenderer::loop, this);
+    }
+}
+
+ProgressRenderer::~ProgressRenderer() {
+    stop();
+}
+
+void ProgressRenderer::finishWalk(std::uint64_t totalBytes) {
+    state.totalBytes.store(totalBytes, std::memory_order_relaxed);
+    state.resolvedBytes.store(0, std::memory_order_relaxed);
+    walkEndNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - startTime).count());
+    state.walking.store(false);
+}
+
+void ProgressRenderer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+        draw();
+        out << std::endl;
+    }
+}
+
+ProgressRenderer::Snapshot ProgressRenderer::snapshot() const {
+    Snapshot copy;
+    copy.walking = state.walking.load();
+    copy.discoveredFiles = state.discoveredFiles.load(std::memory_order_relaxed);
+    copy.resolvedFiles = state.resolvedFiles.load(std::memory_order_relaxed);
+    copy.totalBytes = state.totalBytes.load(std::memory_order_relaxed);
+    copy.resolvedBytes = state.resolvedBytes.load(std::memory_order_relaxed);
+    copy.bytesRead = state.bytesRead.load(std::memory_order_relaxed);
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    const std::int64_t walkEnd = walkEndNs.load();
+    copy.walkSeconds = walkEnd < 0 ? elapsed : static_cast<double>(walkEnd) / 1e9;
+    copy.hashSeconds = walkEnd < 0 ? 0.0 : elapsed - copy.walkSeconds;
+    return copy;
+}
+
+std::string ProgressRenderer::render(const Snapshot& snapshot) {
+    char text[256];
+    if (snapshot.walking) {
+        const double rate = snapshot.walkSeconds > 0 ? static_cast<double>(snapshot.discoveredFiles) / snapshot.walkSeconds : 0.0;
+        std::snprintf(text, sizeof(text), "Scanning: %llu files found (%.0f files/s)",
+                      static_cast<unsigned long long>(snapshot.discoveredFiles), rate);
+        return text;
+    }
+
+    const double fraction = snapshot.totalBytes == 0
+            ? 1.0 : std::min(1.0, static_cast<double>(snapshot.resolvedBytes) / static_cast<double>(snapshot.totalBytes));
+    const int filled = static_cast<int>(fraction * kBarWidth);
+    std::string line = "[";
+    line.append(static_cast<std::size_t>(filled), '=');
+    if (filled < kBarWidth) {
+        line += '>';
+        line.append(static_cast<std::size_t>(kBarWidth - filled - 1), ' ');
+    }
+
+    const double seconds = snapshot.hashSeconds;
+    const double readRate = seconds > 0 ? static_cast<double>(snapshot.bytesRead) / seconds : 0.0;
+    const double fileRate = seconds > 0 ? static_cast<double>(snapshot.resolvedFiles) / seconds : 0.0;
+    std::snprintf(text, sizeof(text), "] %3d%% %llu/%llu files | %s read, %.1f MB/s | %.0f files/s | ETA ",
+                  static_cast<int>(fraction * 100.0), static_cast<unsigned long long>(snapshot.resolvedFiles),
+                  static_cast<unsigned long long>(snapshot.discoveredFiles), formatBytes(static_cast<double>(snapshot.bytesRead)).c_str(),
+                  readRate / 1e6, fileRate);
+    line += text;
+
+    // The byte rate of settled files predicts the rest; file counts mislead when sizes vary
+    if (snapshot.resolvedBytes > 0 && seconds > 0 && snapshot.resolvedBytes < snapshot.totalBytes) {
+        const double remaining = static_cast<double>(snapshot.totalBytes - snapshot.resolvedBytes);
+        line += formatDuration(remaining * seconds / static_cast<double>(snapshot.resolvedBytes));
+    } else if (fraction >= 1.0) {
+        line += formatDuration(0);
+    } else {
+        line += "--:--";
+    }
+    return line;
+}
+
+std::string ProgressRenderer::padded(std::string line) {
+    const std::size_t length = line.size();
+    if (length < lastLength) {
+        line.append(lastLength - length, ' ');
+    }
+    lastLength = length;
+    return "\r" + line;
+}
+
+void ProgressRenderer::draw() {
+    const std::string line = render(snapshot());
+    std::lock_guard<std::mutex> lock(drawMutex);
+    // One write per frame, so the line never shows half drawn
+    out << padded(line);
+    out.flush();
+}
+
+void ProgressRenderer::print(const std::string& message) {
+    if (!enabled) {
+        out << message << std::endl;
+        return;
+    }
+    std::lock_guard<std::mutex> lock(drawMutex);
+    out << padded(message) << '\n';
+    lastLength = 0;
+    out.flush();
+}
+
+void ProgressRenderer::loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!wakeUp.wait_for(lock, kInterval, [this]() { return stopping; })) {
+        lock.unlock();
+        draw();
+        lock.lock();
+    }
+}
@@ -0,0 +1,136 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef PROGRESS_RENDERER_HPP
+#define PROGRESS_RENDERER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+/**
+ * @brief Draws the progress line on its own thread at a fixed rate.
+ * @details The scan only bumps relaxed atomic counters; a background thread samples them every
+ *          kInterval and redraws the line with a single write. The cost of progress therefore
+ *          no longer grows with the number of files, and the terminal is never flushed from the
+ *          hot loop.
+ */
+class ProgressRenderer {
+public:
+    static constexpr std::chrono::milliseconds kInterval{100};
+
+    /**
+     * @brief Counters updated by the scan, read by the renderer.
+     */
+    struct Counters {
+        std::atomic<bool> walking{true};               // Files are still being discovered
+        std::atomic<std::uint64_t> discoveredFiles{0}; // Regular files found by the walk
+        std::atomic<std::uint64_t> resolvedFiles{0};   // Files whose fate is settled
+        std::atomic<std::uint64_t> totalBytes{0};      // Combined size of the files left after the size filter
+        std::atomic<std::uint64_t> resolvedBytes{0};   // Combined size of those settled so far
+        std::atomic<std::uint64_t> bytesRead{0};       // Bytes read for hashing and comparison
+    };
+
+    /**
+     * @brief A consistent-enough copy of the counters with the time they were taken at.
+     */
+    struct Snapshot {
+        bool walking = true;
+        std::uint64_t discoveredFiles = 0;
+        std::uint64_t resolvedFiles = 0;
+        std::uint64_t totalBytes = 0;
+        std::uint64_t resolvedBytes = 0;
+        std::uint64_t bytesRead = 0;
+        double walkSeconds = 0;   // Time spent discovering files
+        double hashSeconds = 0;   // Time spent since the walk ended
+    };
+
+    /**
+     * @param out Stream the line is drawn on.
+     * @param enabled Whether anything is drawn at all; the counters work either way.
+     */
+    ProgressRenderer(std::ostream& out, bool enabled);
+
+    /**
+     * @brief Stops the renderer if it is still running.
+     */
+    ~ProgressRenderer();
+
+    ProgressRenderer(const ProgressRenderer&) = delete;
+    ProgressRenderer& operator=(const ProgressRenderer&) = delete;
+
+    Counters& counters() { return state; }
+
+    /**
+     * @brief Ends the walk phase; from here on progress is measured in bytes.
+     * @param totalBytes Combined size of the files that may have to be read.
+     */
+    void finishWalk(std::uint64_t totalBytes);
+
+    /**
+     * @brief Writes a message on a line of its own; the progress line is redrawn below it.
+     */
+    void print(const std::string& message);
+
+    /**
+     * @brief Draws the final state, ends the line and stops the thread.
+     */
+    void stop();
+
+    /**
+     * @brief Formats the progress line for a snapshot.
+     * @details While walking it shows the files found; afterwards a bar of the settled bytes, the
+     *          files settled, the bytes read with their rate, the files per second and an ETA from
+     *          the byte rate.
+     */
+    static std::string render(const Snapshot& snapshot);
+
+private:
+    std::ostream& out;
+    bool enabled;
+    Counters state;
+    std::chrono::steady_clock::time_point startTime;
+    std::atomic<std::int64_t> walkEndNs{-1}; // Nanoseconds after startTime the walk ended, -1 while walking
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool stopping = false;
+    std::mutex drawMutex;                    // Serializes writes to out
+    std::size_t lastLength = 0;              // Length of the line drawn last, to blank leftovers
+    std::thread thread;
+
+    Snapshot snapshot() const;
+    void draw();
+    std::string padded(std::string line);
+    void loop();
+};
+
+#endif // PROGRESS_RENDERER_HPP
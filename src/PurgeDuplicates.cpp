@@ -25,174 +25,1760 @@
  *
  */
 #include "PurgeDuplicates.hpp"
+#include "ContentComparer.hpp"
+#include "Deduplicator.hpp"
+#include "DigestTable.hpp"
+#include "ExternalSorter.hpp"
+#include "FileWalker.hpp"
+#include "HashCache.hpp"
+#include "Hasher.hpp"
+#include "PathStore.hpp"
+#include "Platform.hpp"
+#include "ProgressRenderer.hpp"
+#include "ReadScheduler.hpp"
+#include "ReferenceIndex.hpp"
+#include "ReportWriter.hpp"
+#include "ScanStats.hpp"
+#include "UringReader.hpp"
+#include "WorkerPool.hpp"
+#include <functional>
 #include <iostream>
-#include <fstream>
-#include <iomanip>
+#include <iterator>
 #include <unordered_map>
 #include <utility>
 #include <vector>
-#include <openssl/evp.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <numeric>
 #include <filesystem>
+#include <fstream>
 #include <stdexcept>
-#include <sstream>
-
-//depending on architecture we load blake2s256 for 32-bit Platforms and blake2b512 for 64-bit platforms
-#if defined(PDCPP_FORCE_32BIT_PATH)
-// Force 32-bit path for testing
-    #define PDCPP_USE_64BIT_HASH_ALGORITHM 0
-#elif defined(__x86_64__) || defined(_M_X64) || defined(__amd64) || defined(__aarch64__) || defined(_M_ARM64)
-// Normal 64-bit detection
-#define PDCPP_USE_64BIT_HASH_ALGORITHM 1
-#else
-// Real 32-bit systems
-    #define PDCPP_USE_64BIT_HASH_ALGORITHM 0
-#endif
+#include <cstdint>
 
 namespace fs = std::filesystem;
 
+namespace {
+    // Number of candidate files pushed through the hash tiers at once
+    constexpr size_t kBatchFiles = 4096;
+    // Batch size when reads are sorted by disk location, where every batch costs a sweep across the disk
+    constexpr size_t kOrderedBatchFiles = 256 * 1024;
+    // Largest file read through io_uring in full, larger files are bandwidth bound
+    constexpr std::uintmax_t kUringMaxFileSize = 1 << 20;
+    // Number of files handed to one io_uring instance per task
+    constexpr size_t kUringChunkFiles = 256;
+    // Confirmed sets whose paths are rebuilt at once for the action phase
+    constexpr size_t kActionChunkSets = 4096;
+    // Error recorded for a file left unread because the scan was cancelled, never reported
+    const std::string kCancelledError = "scan cancelled";
+
+    /**
+     * @brief Identity of a file on disk, shared by all hardlinks to it.
+     */
+    struct InodeKey {
+        std::uint64_t device;
+        std::uint64_t inode;
+
+        bool operator==(const InodeKey& other) const {
+            return device == other.device && inode == other.inode;
+        }
+    };
+
+    /**
+     * @brief A discovered file whose path is kept in the path store.
+     */
+    struct StoredFile {
+        PathRef path;
+        std::uintmax_t size;
+        std::uint64_t device;
+        std::uint64_t inode;
+        std::int64_t mtimeNs;
+        std::int64_t ctimeNs;
+    };
+
+    /**
+     * @brief A confirmed set of identical files, as references into the path store.
+     */
+    struct StoredSet {
+        PathRef original;
+        std::uintmax_t size;
+        std::vector<PathRef> paths;   // Paths of the other members, each followed by its hardlinks
+        std::vector<size_t> members;  // Position in paths of every other member
+    };
+
+    struct InodeKeyHash {
+        size_t operator()(const InodeKey& key) const {
+            return std::hash<std::uint64_t>()(key.inode * 0x9E3779B97F4A7C15ull ^ key.device);
+        }
+    };
+
+    /**
+     * @brief Returns the parts of a file covered by the partial hash, empty when it covers the whole file.
+     */
+    std::vector<ByteRange> sampleRanges(std::uintmax_t fileSize, std::size_t blockSize) {
+        // Head and tail would overlap or touch, the sample is the whole file
+        if (fileSize <= 2 * static_cast<std::uintmax_t>(blockSize)) {
+            return {};
+        }
+        return {{0, blockSize}, {fileSize - blockSize, blockSize}};
+    }
+
+    /**
+     * @brief Splits every group into sub-groups of members sharing the same hash.
+     * @param groups Groups of indices into the discovered files, replaced by the resulting sub-groups.
+     * @param computeHashes Fills the hash, or the error message, of every listed file.
+     * @param onResolved Invoked for every file that leaves the pipeline during this stage.
+     * @param onError Receives the path and the error message of every file that could not be hashed.
+     * @return The number of files that ended up without a partner and were eliminated.
+     * @details Hashes may be computed concurrently but the split itself walks the members in their
+     *          original order, so the first member of a sub-group is always the file discovered first
+     *          regardless of how the threads were scheduled.
+     */
+    template <typename HashesFunction, typename ResolvedCallback, typename ErrorCallback>
+    size_t splitGroupsByHash(std::vector<std::vector<size_t>>& groups, const std::vector<FileEntry>& files,
+                             HashesFunction computeHashes, ResolvedCallback onResolved, ErrorCallback onError) {
+        std::vector<size_t> members;
+        for (const auto& group : groups) {
+            members.insert(members.end(), group.begin(), group.end());
+        }
+
+        std::vector<Digest> hashes(members.size());
+        std::vector<std::string> errors(members.size());
+        computeHashes(members, hashes, errors);
+
+        std::vector<std::vector<size_t>> subGroups;
+        size_t eliminated = 0;
+        size_t member = 0;
+        DigestTable firstWithHash(hashes);
+        // Sub-group of every position that was the first one with its hash, indexed like hashes
+        std::vector<std::uint32_t> subGroupAt(members.size());
+
+        for (const auto& group : groups) {
+            std::vector<std::vector<size_t>> groupSplit;
+            firstWithHash.reset(group.size());
+
+            for (size_t index : group) {
+                const auto position = static_cast<std::uint32_t>(member++);
+                if (!errors[position].empty()) {
+                    onError(files[index].path, errors[position]);
+                    onResolved(index);
+                    continue;
+                }
+                const std::uint32_t first = firstWithHash.findOrInsert(position);
+                if (first == position) {
+                    subGroupAt[position] = static_cast<std::uint32_t>(groupSplit.size());
+                    groupSplit.emplace_back();
+                }
+                groupSplit[subGroupAt[first]].push_back(index);
+            }
+
+            for (auto& subGroup : groupSplit) {
+                if (subGroup.size() < 2) {
+                    ++eliminated;
+                    onResolved(subGroup.front());
+                } else {
+                    subGroups.push_back(std::move(subGroup));
+                }
+            }
+        }
+
+        groups = std::move(subGroups);
+        return eliminated;
+    }
+
+    /**
+     * @brief Splits every group into sub-groups of byte-identical members.
+     * @param groups Groups of indices into the discovered files, replaced by the resulting sub-groups.
+     * @param onResolved Invoked for every file that leaves the pipeline during this stage.
+     * @param onError Receives the path and the error message of every file that could not be read.
+     * @param bytesRead Incremented by the size of every compared member.
+     * @return The number of files that ended up without a partner and were eliminated.
+     * @details Groups are compared concurrently on the pool; like splitGroupsByHash() the first
+     *          member of a sub-group is always the file discovered first.
+     */
+    template <typename ResolvedCallback, typename ErrorCallback>
+    size_t splitGroupsByContent(std::vector<std::vector<size_t>>& groups, const std::vector<FileEntry>& files,
+                                WorkerPool& pool, ResolvedCallback onResolved, ErrorCallback onError,
+                                std::atomic<std::uint64_t>& bytesRead) {
+        std::vector<std::vector<std::vector<size_t>>> classes(groups.size());
+        std::vector<std::vector<std::string>> errors(groups.size());
+        pool.parallelFor(groups.size(), [&](size_t g) {
+            std::vector<const std::string*> paths;
+            for (size_t index : groups[g]) {
+                paths.push_back(&files[index].path);
+            }
+            const std::uintmax_t size = files[groups[g].front()].size;
+            classes[g] = ContentComparer().split(paths, size, errors[g]);
+            bytesRead.fetch_add(size * paths.size(), std::memory_order_relaxed);
+        });
+
+        std::vector<std::vector<size_t>> subGroups;
+        size_t eliminated = 0;
+        for (size_t g = 0; g < groups.size(); ++g) {
+            for (size_t i = 0; i < groups[g].size(); ++i) {
+                if (!errors[g][i].empty()) {
+                    onError(files[groups[g][i]].path, errors[g][i]);
+                    onResolved(groups[g][i]);
+                }
+            }
+            for (const auto& positions : classes[g]) {
+                if (positions.size() < 2) {
+                    ++eliminated;
+                    onResolved(groups[g][positions.front()]);
+                    continue;
+                }
+                subGroups.emplace_back();
+                for (size_t position : positions) {
+                    subGroups.back().push_back(groups[g][position]);
+                }
+            }
+        }
+
+        groups = std::move(subGroups);
+        return eliminated;
+    }
+
+    ScanOptions progressAndLiveRun(bool showProgress, bool liveRun) {
+        ScanOptions options;
+        options.showProgress = showProgress;
+        options.liveRun = liveRun;
+        return options;
+    }
+}
+
 PurgeDuplicates::PurgeDuplicates(std::string  directory, bool showProgress, bool liveRun)
-        : directoryPath(std::move(directory)), showProgress(showProgress), liveRun(liveRun) {
-#if PDCPP_USE_64BIT_HASH_ALGORITHM
-    std::cout << "Optimized for 64-Bit Architecture : Using Blake5b512" << std::endl;
-#else
-    std::cout << "Optimized for 32-Bit Architecture : Using Blake2s256" << std::endl;
-#endif
+        : PurgeDuplicates(std::move(directory), progressAndLiveRun(showProgress, liveRun)) {
 }
 
-std::string PurgeDuplicates::generateHash(const std::string& filePath) {
-    EVP_MD_CTX* context = EVP_MD_CTX_new();
-    if (context == nullptr) {
-        throw std::runtime_error("Failed to create EVP_MD_CTX.");
+PurgeDuplicates::PurgeDuplicates(std::string  directory, const ScanOptions& options)
+        : PurgeDuplicates(std::move(directory), options, ScanListener()) {
+}
+
+PurgeDuplicates::PurgeDuplicates(std::string  directory, const ScanOptions& options, ScanListener listener)
+        : directoryPath(std::move(directory)), options(options), listener(std::move(listener)),
+          embedded(this->listener.onGroup || this->listener.onError),
+          console(embedded ? silentConsole : options.reportFormat == ReportFormat::Text ? std::cout : std::cerr),
+          reader(options.readBackend, options.readBufferSize),
+          algorithm(options.hashAlgorithm.empty() ? &HashAlgorithm::platformDefault()
+                                                  : &HashAlgorithm::byName(options.hashAlgorithm)),
+          uringEnabled(options.ioEngine == IoEngine::Uring) {
+    if (embedded) {
+        this->options.showProgress = false;
     }
+    if (!options.referenceIndex.empty()) {
+        // The digest is the one the reference index was built with, announced once it is opened
+    } else if (options.hashAlgorithm.empty()) {
 #if PDCPP_USE_64BIT_HASH_ALGORITHM
-    if (EVP_DigestInit_ex(context, EVP_blake2b512(), nullptr) != 1) {
+        console << "Optimized for 64-Bit Architecture : Using Blake5b512" << std::endl;
 #else
-    if (EVP_DigestInit_ex(context, EVP_blake2s256(), nullptr) != 1) {
+        console << "Optimized for 32-Bit Architecture : Using Blake2s256" << std::endl;
 #endif
-        EVP_MD_CTX_free(context);
-        throw std::runtime_error("Failed to initialize digest with Blake2.");
+    } else {
+        console << "Using hash algorithm " << algorithm->name()
+                  << (algorithm->isCryptographic() ? "" : " (non-cryptographic, matches are verified byte by byte)")
+                  << std::endl;
+    }
+    if (options.sampleBlockSize == 0) {
+        throw std::invalid_argument("The partial hash sample size must be greater than zero.");
     }
+    if (uringEnabled && !UringReader::isSupported()) {
+        (embedded ? console : std::cerr) << "io_uring is not available, falling back to synchronous reads." << std::endl;
+        uringEnabled = false;
+    }
+}
+
+void PurgeDuplicates::shareReport(ReportWriter& report) {
+    sharedReport = &report;
+}
+
+std::string PurgeDuplicates::generateHash(const std::string& filePath) {
+    return generateHash(filePath, FileReader());
+}
 
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file.is_open()) {
-        EVP_MD_CTX_free(context);
-        throw std::ios_base::failure("Could not open file: " + filePath);
+std::string PurgeDuplicates::generateHash(const std::string& filePath, const FileReader& reader) {
+    return generateDigest(filePath, reader, HashAlgorithm::platformDefault().threadHasher()).toHex();
+}
+
+Digest PurgeDuplicates::generateDigest(const std::string& filePath, const FileReader& reader, Hasher& hasher) {
+    hasher.reset();
+    reader.readFile(filePath, [&hasher](const unsigned char* data, size_t length) {
+        hasher.update(data, length);
+    });
+    return hasher.finish();
+}
+
+std::string PurgeDuplicates::generatePartialHash(const std::string& filePath, std::uintmax_t fileSize, std::size_t blockSize) {
+    return generatePartialHash(filePath, fileSize, blockSize, FileReader());
+}
+
+std::string PurgeDuplicates::generatePartialHash(const std::string& filePath, std::uintmax_t fileSize, std::size_t blockSize,
+                                                 const FileReader& reader) {
+    return generatePartialDigest(filePath, fileSize, blockSize, reader, HashAlgorithm::platformDefault().threadHasher()).toHex();
+}
+
+Digest PurgeDuplicates::generatePartialDigest(const std::string& filePath, std::uintmax_t fileSize, std::size_t blockSize,
+                                              const FileReader& reader, Hasher& hasher) {
+    const std::vector<ByteRange> ranges = sampleRanges(fileSize, blockSize);
+    if (ranges.empty()) {
+        return generateDigest(filePath, reader, hasher);
     }
 
-    char buffer[4096];
-    while (file.read(buffer, sizeof(buffer))) {
-        if (EVP_DigestUpdate(context, buffer, file.gcount()) != 1) {
-            EVP_MD_CTX_free(context);
-            throw std::runtime_error("Failed to update Blake2 hash during file processing.");
+    hasher.reset();
+    reader.readRanges(filePath, ranges, [&hasher](const unsigned char* data, size_t length) {
+        hasher.update(data, length);
+    });
+    return hasher.finish();
+}
+
+void PurgeDuplicates::hashFiles(const std::vector<FileEntry>& files, const std::vector<size_t>& members, bool sampled,
+                                WorkerPool& pool, const ReadScheduler& scheduler,
+                                std::vector<Digest>& hashes, std::vector<std::string>& errors,
+                                std::atomic<std::uint64_t>& bytesRead) const {
+    const std::size_t blockSize = options.sampleBlockSize;
+    // One relaxed add per file keeps the progress counters out of the read loop
+    auto countRead = [&](const FileEntry& file) {
+        const std::uintmax_t bytes = sampled && !sampleRanges(file.size, blockSize).empty()
+                ? 2 * static_cast<std::uintmax_t>(blockSize) : file.size;
+        bytesRead.fetch_add(bytes, std::memory_order_relaxed);
+    };
+    const StatLatency latency = sampled ? StatLatency::PartialHash : StatLatency::FullHash;
+    auto hashSynchronously = [&](size_t i) {
+        const FileEntry& file = files[members[i]];
+        if (isCancelled()) {
+            errors[i] = kCancelledError;
+            return;
         }
-    }
+        try {
+            const auto started = std::chrono::steady_clock::now();
+            Hasher& hasher = algorithm->threadHasher();
+            hashes[i] = sampled ? generatePartialDigest(file.path, file.size, blockSize, reader, hasher)
+                                : generateDigest(file.path, reader, hasher);
+            ScanStats::recordLatency(latency, std::chrono::steady_clock::now() - started);
+            countRead(file);
+        } catch (const std::exception& e) {
+            errors[i] = e.what();
+        }
+    };
 
-    if (file.gcount() > 0) {
-        if (EVP_DigestUpdate(context, buffer, file.gcount()) != 1) {
-            EVP_MD_CTX_free(context);
-            throw std::runtime_error("Failed to update Blake2 hash with final bytes.");
+    // Sorted by disk location, items are started in order so that concurrent reads stay neighbours
+    const std::vector<size_t> order = scheduler.sort(files, members);
+    auto forEach = [&](size_t count, const std::function<void(size_t)>& task) {
+        if (scheduler.isActive()) {
+            pool.parallelForOrdered(count, task);
+        } else {
+            pool.parallelFor(count, task);
         }
+    };
+
+    if (!uringEnabled) {
+        forEach(order.size(), [&](size_t k) { hashSynchronously(order[k]); });
+        return;
     }
 
-    unsigned char hash[EVP_MAX_MD_SIZE];
-    unsigned int hashLength = 0;
-    if (EVP_DigestFinal_ex(context, hash, &hashLength) != 1) {
-        EVP_MD_CTX_free(context);
-        throw std::runtime_error("Failed to finalize Blake2 hash.");
+    // Samples and small files go through io_uring where per-file latency dominates, large files
+    // are bandwidth bound and stay on the synchronous reader
+    std::vector<size_t> uringItems;
+    std::vector<size_t> syncItems;
+    for (size_t i : order) {
+        if (sampled || files[members[i]].size <= kUringMaxFileSize) {
+            uringItems.push_back(i);
+        } else {
+            syncItems.push_back(i);
+        }
     }
 
-    EVP_MD_CTX_free(context);
+    const size_t uringChunks = (uringItems.size() + kUringChunkFiles - 1) / kUringChunkFiles;
+    forEach(uringChunks + syncItems.size(), [&](size_t task) {
+        if (task >= uringChunks) {
+            hashSynchronously(syncItems[task - uringChunks]);
+            return;
+        }
 
-    std::ostringstream result;
-    for (unsigned int i = 0; i < hashLength; i++) {
-        result << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(hash[i]);
-    }
-    return result.str();
+        const size_t begin = task * kUringChunkFiles;
+        const size_t end = std::min(uringItems.size(), begin + kUringChunkFiles);
+
+        // Every thread drives its own ring. Setting one up can fail where the probe succeeded, e.g. on
+        // the locked memory limit with many jobs: the chunk is then read synchronously
+        thread_local std::unique_ptr<UringReader> uring;
+        if (!uring) {
+            try {
+                uring = std::make_unique<UringReader>();
+            } catch (const std::exception&) {
+                for (size_t k = begin; k < end; ++k) {
+                    hashSynchronously(uringItems[k]);
+                }
+                return;
+            }
+        }
+        if (isCancelled()) {
+            for (size_t k = begin; k < end; ++k) {
+                errors[uringItems[k]] = kCancelledError;
+            }
+            return;
+        }
+        std::vector<UringReadJob> jobs;
+        for (size_t k = begin; k < end; ++k) {
+            const FileEntry& file = files[members[uringItems[k]]];
+            jobs.push_back({&file.path, sampled ? sampleRanges(file.size, blockSize) : std::vector<ByteRange>()});
+        }
+
+        // Reads of different files interleave, every job feeds its own hasher; slot 0 is left to
+        // the synchronous path of this thread
+        for (size_t job = 0; job < jobs.size(); ++job) {
+            algorithm->threadHasher(job + 1).reset();
+        }
+        // The ring starts its first jobs together and every further job on a completion, so a job
+        // waits for the completion queueDepth places before it
+        const auto chunkStarted = std::chrono::steady_clock::now();
+        std::vector<std::chrono::steady_clock::time_point> completions;
+        uring->run(jobs, [&](size_t job, const unsigned char* data, size_t length) {
+            algorithm->threadHasher(job + 1).update(data, length);
+        }, [&](size_t job, const std::string& error) {
+            const size_t i = uringItems[begin + job];
+            Hasher& hasher = algorithm->threadHasher(job + 1);
+            const auto completed = std::chrono::steady_clock::now();
+            const auto started = job < UringReader::kDefaultQueueDepth
+                    ? chunkStarted : completions[job - UringReader::kDefaultQueueDepth];
+            completions.push_back(completed);
+            if (!error.empty()) {
+                errors[i] = error;
+                hasher.reset();
+                return;
+            }
+            try {
+                hashes[i] = hasher.finish();
+                ScanStats::recordLatency(latency, completed - started);
+                countRead(files[members[i]]);
+            } catch (const std::exception& e) {
+                errors[i] = e.what();
+                hasher.reset();
+            }
+        });
+    });
 }
 
-void PurgeDuplicates::displayProgress(size_t current, size_t total) {
+void PurgeDuplicates::displayProgress(size_t current, size_t total, std::ostream& out) {
     static const int barWidth = 50;
-    float progress = static_cast<float>(current) / static_cast<float>(total);
+    float progress = total == 0 ? 0.0f : static_cast<float>(current) / static_cast<float>(total);
     int pos = static_cast<int>(barWidth * progress);
 
-    std::cout << "\r[";
+    out << "\r[";
     for (int i = 0; i < barWidth; ++i) {
-        if (i < pos) std::cout << "=";
-        else if (i == pos) std::cout << ">";
-        else std::cout << " ";
+        if (i < pos) out << "=";
+        else if (i == pos) out << ">";
+        else out << " ";
     }
-    std::cout << "] " << int(progress * 100.0) << "%";
-    std::cout.flush();
+    out << "] " << int(progress * 100.0) << "% (" << current << "/" << total << " files)";
+    out.flush();
 }
 
 void PurgeDuplicates::identifyAndRemoveDuplicates() {
-    std::unordered_map<std::string, std::string> fileHashes;
-    std::vector<std::string> duplicates;
-    size_t totalFiles = 0;
+    std::unique_ptr<ReportWriter> ownReport;
+    if (sharedReport == nullptr) {
+        ownReport = std::make_unique<ReportWriter>(options.reportFormat, std::cout);
+    }
+    ReportWriter& report = sharedReport != nullptr ? *sharedReport : *ownReport;
+    report.scan(directoryPath, algorithm->name());
 
-    // Count total files for progress display
-    if (showProgress) {
-        for (const auto& entry : fs::recursive_directory_iterator(directoryPath)) {
-            if (entry.is_regular_file()) {
-                ++totalFiles;
-            }
+    // Single walk: every regular file is grouped by size as soon as it is discovered and the
+    // progress total grows with it, so showing progress never costs a second traversal. Paths are
+    // interned in the store; full strings only exist for the batch being hashed
+    PathStore paths(directoryPath);
+    std::vector<StoredFile> stored;
+    std::unordered_map<std::uintmax_t, size_t> groupOfSize;
+    std::vector<std::vector<size_t>> sizeGroups;
+    // Further paths of an inode already listed are never hashed, they share its content and its fate
+    std::unordered_map<InodeKey, size_t, InodeKeyHash> fileOfInode;
+    std::unordered_map<size_t, std::vector<PathRef>> aliasesOf;
+    size_t hardlinkedPaths = 0;
+    // The batch going through the hash tiers: its files with full paths, its size groups as indices
+    // into them, the further paths of each file and, unless sorted on disk, where the files are stored
+    std::vector<FileEntry> files;
+    std::vector<std::vector<size_t>> groups;
+    std::unordered_map<size_t, std::vector<std::string>> hardlinksOf;
+    std::vector<size_t> storedIndex;
+    // With a memory limit the walk only collects the files; they are sorted by size on disk and
+    // grouped while the sorted runs are merged
+    std::unique_ptr<SpillDirectory> spillDirectory;
+    std::unique_ptr<ExternalSorter> sizeSorter;
+    if (options.maxMemory != 0) {
+        spillDirectory = std::make_unique<SpillDirectory>();
+        sizeSorter = std::make_unique<ExternalSorter>(spillDirectory->file("size-"), SpillOrder::Size, options.maxMemory / 2);
+    }
+    std::uintmax_t discoveredBytes = 0;
+    WorkerPool pool(options.jobs);
+    ProgressRenderer progress(console, options.showProgress);
+    ProgressRenderer::Counters& counters = progress.counters();
+    std::unique_ptr<HashCache> cache;
+    if (!options.cachePath.empty()) {
+        cache = std::make_unique<HashCache>(options.cachePath, algorithm->name());
+        if (!cache->loadError().empty()) {
+            reportError(ScanErrorKind::Cache, options.cachePath, cache->loadError());
         }
-        if (totalFiles == 0) {
-            std::cout << "No files found in the directory." << std::endl;
+    }
+    FileWalker walker(directoryPath, options.oneFileSystem, &cancelled);
+    scanStats.enterPhase(ScanPhase::Traversal);
+    walker.walk([&](FileEntry&& file) {
+        // Pruning keeps the records of every file walked, even of those that are never looked up
+        if (cache && options.cachePrune) {
+            cache->keep(file);
+        }
+        if (sizeSorter) {
+            discoveredBytes += file.size;
+            SpillRecord record;
+            record.file = std::move(file);
+            sizeSorter->add(std::move(record));
+            counters.discoveredFiles.store(sizeSorter->size(), std::memory_order_relaxed);
             return;
         }
+
+        // Directories are read concurrently, so an inode is listed under its smallest path, whichever
+        // of its paths arrives first
+        if (file.device != 0 || file.inode != 0) {
+            auto known = fileOfInode.emplace(InodeKey{file.device, file.inode}, stored.size());
+            if (!known.second) {
+                StoredFile& listed = stored[known.first->second];
+                PathRef alias = paths.intern(file.path);
+                if (file.path < paths.path(listed.path)) {
+                    std::swap(alias, listed.path);
+                }
+                aliasesOf[known.first->second].push_back(alias);
+                ++hardlinkedPaths;
+                return;
+            }
+        }
+
+        auto inserted = groupOfSize.emplace(file.size, sizeGroups.size());
+        if (inserted.second) {
+            sizeGroups.emplace_back();
+        }
+        sizeGroups[inserted.first->second].push_back(stored.size());
+        stored.push_back({paths.intern(file.path), file.size, file.device, file.inode, file.mtimeNs, file.ctimeNs});
+        counters.discoveredFiles.store(stored.size(), std::memory_order_relaxed);
+    }, [this](const std::string& filePath, const std::string& message) {
+        reportError(ScanErrorKind::Walk, filePath, message);
+    }, pool);
+    checkCancelled();
+
+    if (options.showProgress && (sizeSorter ? sizeSorter->size() == 0 : stored.empty())) {
+        progress.stop();
+        console << "No files found in the directory." << std::endl;
+        return;
     }
 
+    // Workers only bump counters, the renderer thread decides when they are drawn
     size_t processedFiles = 0;
+    auto resolve = [&](std::uintmax_t size) {
+        ++processedFiles;
+        counters.resolvedFiles.store(processedFiles, std::memory_order_relaxed);
+        counters.resolvedBytes.fetch_add(size, std::memory_order_relaxed);
+    };
+    auto onResolved = [&](size_t index) {
+        resolve(files[index].size);
+    };
+    auto onError = [this](const std::string& filePath, const std::string& message) {
+        reportError(ScanErrorKind::Read, filePath, message);
+    };
 
-    // Identify duplicates
-    for (const auto& entry : fs::recursive_directory_iterator(directoryPath)) {
-        if (entry.is_regular_file()) {
-            const std::string filePath = entry.path().string();
-            try {
-                std::string fileHash = generateHash(filePath);
+    // Tier 0: a file with a unique size can never have a duplicate
+    scanStats.enterPhase(ScanPhase::SizeGrouping);
+    size_t uniqueSizeFiles = 0;
+    std::uintmax_t uniqueSizeBytes = 0;
+    {
+        std::vector<std::vector<size_t>> candidateGroups;
+        for (auto& group : sizeGroups) {
+            if (group.size() < 2) {
+                ++uniqueSizeFiles;
+                uniqueSizeBytes += stored[group.front()].size;
+                resolve(stored[group.front()].size);
+            } else {
+                candidateGroups.push_back(std::move(group));
+            }
+        }
+        sizeGroups = std::move(candidateGroups);
+        // The walk is over, the lookup tables are not needed any more
+        std::unordered_map<std::uintmax_t, size_t>().swap(groupOfSize);
+        std::unordered_map<InodeKey, size_t, InodeKeyHash>().swap(fileOfInode);
+    }
+
+    // From here on progress is measured by the bytes of the remaining candidates, which is what the
+    // hash tiers spend their time on. Sorted files only reach tier 0 during the merge, so all count
+    std::uintmax_t candidateBytes = discoveredBytes;
+    for (const auto& group : sizeGroups) {
+        candidateBytes += stored[group.front()].size * group.size();
+    }
+    progress.finishWalk(candidateBytes);
+    scanStats.enterPhase(ScanPhase::Other);
+
+    // Files are located batch by batch, right before their reads are put in disk order
+    ReadScheduler scheduler(options.readOrder, directoryPath);
+    if (scheduler.isActive() && options.readOrder == ReadOrder::Auto) {
+        progress.print("Rotational disk detected, reading files in physical order.");
+    }
+
+
+    const std::size_t blockSize = options.sampleBlockSize;
+    size_t partialHashCandidates = 0;
+    size_t partialHashEliminated = 0;
+    size_t fullHashCandidates = 0;
+    size_t fullHashEliminated = 0;
+    size_t compareCandidates = 0;
+    size_t compareEliminated = 0;
+    size_t verifyCandidates = 0;
+    size_t verifyEliminated = 0;
+    size_t duplicateFiles = 0;
 
-                if (fileHashes.count(fileHash)) {
-                    duplicates.push_back(filePath);
+    // Confirmed sets wait for the action phase as references into the path store, or on disk when
+    // memory is limited. A listener gets every set as it is confirmed, so a dry run keeps none
+    const bool retainSets = !embedded || options.liveRun;
+    std::vector<StoredSet> storedSets;
+    std::unique_ptr<DuplicateSpool> spool;
+    if (sizeSorter) {
+        spool = std::make_unique<DuplicateSpool>(spillDirectory->file("duplicates"));
+    }
+    size_t duplicateSetCount = 0;
+    auto keepSet = [&](DuplicateSet&& set, const Digest* digest) {
+        // Streamed right away so a consumer can start on the group while the scan goes on
+        if (report.isMachineReadable()) {
+            std::vector<const std::string*> paths;
+            for (const auto& path : set.paths) {
+                paths.push_back(&path);
+            }
+            report.group(digest, set.size, set.original, paths);
+        }
+        if (listener.onGroup) {
+            listener.onGroup(set, digest);
+        }
+        if (spool && retainSets) {
+            spool->append(set);
+        }
+    };
+
+    // Full hashes of the listed files, taken from the cache where it is still valid and recorded in it otherwise
+    std::unordered_map<size_t, Digest> cachedDigests;
+    // Full digests of the current batch, kept only to label the groups of a machine-readable report or a listener
+    const bool labelSets = report.isMachineReadable() || listener.onGroup;
+    std::unordered_map<size_t, Digest> fullDigests;
+    auto computeFullHashes = [&](const std::vector<size_t>& members,
+            std::vector<Digest>& hashes, std::vector<std::string>& errors) {
+        std::vector<size_t> uncached;
+        std::vector<size_t> uncachedPositions;
+        for (size_t i = 0; i < members.size(); ++i) {
+            auto cached = cachedDigests.find(members[i]);
+            if (cached != cachedDigests.end()) {
+                hashes[i] = cached->second;
+            } else {
+                uncached.push_back(members[i]);
+                uncachedPositions.push_back(i);
+            }
+        }
+        std::vector<Digest> uncachedHashes(uncached.size());
+        std::vector<std::string> uncachedErrors(uncached.size());
+        hashFiles(files, uncached, false, pool, scheduler, uncachedHashes, uncachedErrors, counters.bytesRead);
+        for (size_t k = 0; k < uncached.size(); ++k) {
+            if (cache && uncachedErrors[k].empty()) {
+                cache->store(files[uncached[k]], uncachedHashes[k]);
+            }
+            hashes[uncachedPositions[k]] = uncachedHashes[k];
+            errors[uncachedPositions[k]] = std::move(uncachedErrors[k]);
+        }
+        for (size_t i = 0; labelSets && i < members.size(); ++i) {
+            if (errors[i].empty()) {
+                fullDigests[members[i]] = hashes[i];
+            }
+        }
+    };
+
+    // Runs a batch of size groups through the hash tiers and keeps the confirmed sets
+    auto processBatch = [&](std::vector<std::vector<size_t>>& batch) {
+        // Groups whose members are all cached go straight to the full hash, which is then free. In any
+        // other group the files without a record would be read in full, their samples are far cheaper
+        std::vector<std::vector<size_t>> partialHashGroups;
+        std::vector<std::vector<size_t>> fullHashGroups;
+        std::vector<std::vector<size_t>> confirmedGroups;
+        cachedDigests.clear();
+        fullDigests.clear();
+        for (auto& group : batch) {
+            size_t cachedMembers = 0;
+            for (size_t index : group) {
+                Digest digest;
+                if (cache && cache->lookup(files[index], digest)) {
+                    cachedDigests.emplace(index, digest);
+                    ++cachedMembers;
+                }
+            }
+            if (cachedMembers == group.size()) {
+                fullHashCandidates += group.size();
+                fullHashGroups.push_back(std::move(group));
+            } else {
+                partialHashCandidates += group.size();
+                partialHashGroups.push_back(std::move(group));
+            }
+        }
+
+        // Tier 1: split the size groups by a cheap hash of the first and last block
+        const ScanPhase outerPhase = scanStats.enterPhase(ScanPhase::PartialHash);
+        partialHashEliminated += splitGroupsByHash(partialHashGroups, files, [&](const std::vector<size_t>& members,
+                std::vector<Digest>& hashes, std::vector<std::string>& errors) {
+            hashFiles(files, members, true, pool, scheduler, hashes, errors, counters.bytesRead);
+            // A sample covering the whole file is a full digest worth keeping
+            for (size_t i = 0; (cache || labelSets) && i < members.size(); ++i) {
+                const FileEntry& file = files[members[i]];
+                if (errors[i].empty() && sampleRanges(file.size, blockSize).empty()) {
+                    if (cache) {
+                        cache->store(file, hashes[i]);
+                    }
+                    if (labelSets) {
+                        fullDigests[members[i]] = hashes[i];
+                    }
+                }
+            }
+        }, onResolved, onError);
+
+        // Tier 2: only files that still collide are read in full, unless the sample already covered
+        // them. Depending on the comparison mode a group is hashed or compared byte by byte
+        std::vector<std::vector<size_t>> compareGroups;
+        for (auto& group : partialHashGroups) {
+            const std::uintmax_t size = files[group.front()].size;
+            if (size <= 2 * static_cast<std::uintmax_t>(blockSize)) {
+                confirmedGroups.push_back(std::move(group));
+            } else if (options.compareMode == CompareMode::Bytes
+                       || (options.compareMode == CompareMode::Auto && !cache
+                           && ContentComparer::prefersBytes(group.size(), size))) {
+                compareCandidates += group.size();
+                compareGroups.push_back(std::move(group));
+            } else {
+                fullHashCandidates += group.size();
+                fullHashGroups.push_back(std::move(group));
+            }
+        }
+        scanStats.enterPhase(ScanPhase::FullHash);
+        fullHashEliminated += splitGroupsByHash(fullHashGroups, files, computeFullHashes, onResolved, onError);
+        for (auto& group : fullHashGroups) {
+            confirmedGroups.push_back(std::move(group));
+        }
+
+        // A non-cryptographic digest only nominates duplicates, the bytes have the final word
+        scanStats.enterPhase(ScanPhase::Compare);
+        if (!algorithm->isCryptographic()) {
+            for (const auto& group : confirmedGroups) {
+                verifyCandidates += group.size();
+            }
+            verifyEliminated += splitGroupsByContent(confirmedGroups, files, pool, onResolved, onError, counters.bytesRead);
+        }
+
+        compareEliminated += splitGroupsByContent(compareGroups, files, pool, onResolved, onError, counters.bytesRead);
+        for (auto& group : compareGroups) {
+            confirmedGroups.push_back(std::move(group));
+        }
+        scanStats.enterPhase(outerPhase);
+
+        // Directories are read concurrently, so the order of discovery varies between runs. The member
+        // with the lexicographically smallest path is kept as the original to make the choice stable. A
+        // duplicate only frees its space once every path to it is gone, so its hardlinks go with it.
+        // Path strings are only copied into the set when they are streamed out right away
+        const bool keepStrings = spool || labelSets;
+        const bool keepRefs = !spool && retainSets;
+        for (const auto& group : confirmedGroups) {
+            size_t kept = 0;
+            for (size_t i = 1; i < group.size(); ++i) {
+                if (files[group[i]].path < files[group[kept]].path) {
+                    kept = i;
+                }
+            }
+            DuplicateSet set;
+            StoredSet storedSet;
+            set.original = keepStrings ? files[group[kept]].path : std::string();
+            set.size = files[group[kept]].size;
+            if (keepRefs) {
+                storedSet.original = stored[storedIndex[group[kept]]].path;
+                storedSet.size = set.size;
+            }
+            for (size_t i = 0; i < group.size(); ++i) {
+                if (i != kept) {
+                    ++duplicateFiles;
+                    if (keepStrings) {
+                        set.members.push_back(set.paths.size());
+                        set.paths.push_back(files[group[i]].path);
+                        auto links = hardlinksOf.find(group[i]);
+                        if (links != hardlinksOf.end()) {
+                            set.paths.insert(set.paths.end(), links->second.begin(), links->second.end());
+                        }
+                    }
+                    if (keepRefs) {
+                        storedSet.members.push_back(storedSet.paths.size());
+                        storedSet.paths.push_back(stored[storedIndex[group[i]]].path);
+                        auto aliases = aliasesOf.find(storedIndex[group[i]]);
+                        if (aliases != aliasesOf.end()) {
+                            storedSet.paths.insert(storedSet.paths.end(), aliases->second.begin(), aliases->second.end());
+                        }
+                    }
+                }
+                onResolved(group[i]);
+            }
+            if (keepStrings) {
+                auto digest = fullDigests.find(group[kept]);
+                keepSet(std::move(set), digest != fullDigests.end() ? &digest->second : nullptr);
+            }
+            if (keepRefs) {
+                storedSets.push_back(std::move(storedSet));
+            }
+            ++duplicateSetCount;
+        }
+    };
+
+    // Batches are bounded by count, and by memory as well when a limit is set; whatever is left of
+    // the budget once the sorted runs are being merged is shared by the batch and the set being confirmed
+    const std::size_t batchBudget = std::max<std::size_t>(options.maxMemory / 4, 1);
+    const size_t batchLimit = scheduler.isActive() ? kOrderedBatchFiles : kBatchFiles;
+    std::size_t batchBytes = 0;
+    auto flushBatch = [&]() {
+        checkCancelled();
+        if (!groups.empty()) {
+            if (scheduler.isActive()) {
+                std::vector<size_t> candidates(files.size());
+                std::iota(candidates.begin(), candidates.end(), 0);
+                scheduler.locate(files, candidates, pool);
+            }
+            processBatch(groups);
+        }
+        // Release the memory, not just the elements
+        std::vector<FileEntry>().swap(files);
+        std::vector<std::vector<size_t>>().swap(groups);
+        std::unordered_map<size_t, std::vector<std::string>>().swap(hardlinksOf);
+        std::vector<size_t>().swap(storedIndex);
+        batchBytes = 0;
+    };
+
+    if (!sizeSorter) {
+        // Candidate groups go through the hash tiers in batches so progress keeps moving on large
+        // trees; only the files of the current batch have their full paths rebuilt
+        for (auto& group : sizeGroups) {
+            groups.emplace_back();
+            for (size_t index : group) {
+                const StoredFile& file = stored[index];
+                auto aliases = aliasesOf.find(index);
+                if (aliases != aliasesOf.end()) {
+                    auto& links = hardlinksOf[files.size()];
+                    for (const auto& alias : aliases->second) {
+                        links.push_back(paths.path(alias));
+                    }
+                    std::sort(links.begin(), links.end());
+                }
+                groups.back().push_back(files.size());
+                storedIndex.push_back(index);
+                files.push_back({paths.path(file.path), file.size, file.device, file.inode, file.mtimeNs, file.ctimeNs});
+            }
+            std::vector<size_t>().swap(group);
+            if (files.size() >= batchLimit) {
+                flushBatch();
+            }
+        }
+        flushBatch();
+    } else {
+        // Sorting by size happens while the runs are merged, which drives everything below
+        scanStats.enterPhase(ScanPhase::SizeGrouping);
+        // Files of the current size, one entry per inode, with the further paths of each inode
+        std::vector<FileEntry> pending;
+        std::vector<std::vector<std::string>> pendingLinks;
+        std::size_t pendingBytes = 0;
+        // A size with more files than a batch holds is sorted by full digest instead, on disk
+        std::unique_ptr<ExternalSorter> digestSorter;
+
+        // The last entry may stay pending, so further paths of its inode still find it
+        auto spillPendingByDigest = [&](bool keepLast) {
+            checkCancelled();
+            ScanStats::PhaseScope phase(scanStats, ScanPhase::FullHash);
+            FileEntry last;
+            std::vector<std::string> lastLinks;
+            if (keepLast) {
+                last = std::move(pending.back());
+                lastLinks = std::move(pendingLinks.back());
+                pending.pop_back();
+                pendingLinks.pop_back();
+            }
+            if (!digestSorter) {
+                digestSorter = std::make_unique<ExternalSorter>(spillDirectory->file("digest-"), SpillOrder::Digest, batchBudget);
+            }
+            std::vector<size_t> members(pending.size());
+            std::iota(members.begin(), members.end(), 0);
+            if (scheduler.isActive()) {
+                scheduler.locate(pending, members, pool);
+            }
+            std::vector<Digest> hashes(pending.size());
+            std::vector<std::string> errors(pending.size());
+            std::vector<size_t> uncached;
+            for (size_t i = 0; i < pending.size(); ++i) {
+                if (!cache || !cache->lookup(pending[i], hashes[i])) {
+                    uncached.push_back(i);
+                }
+            }
+            std::vector<Digest> uncachedHashes(uncached.size());
+            std::vector<std::string> uncachedErrors(uncached.size());
+            hashFiles(pending, uncached, false, pool, scheduler, uncachedHashes, uncachedErrors, counters.bytesRead);
+            for (size_t k = 0; k < uncached.size(); ++k) {
+                if (cache && uncachedErrors[k].empty()) {
+                    cache->store(pending[uncached[k]], uncachedHashes[k]);
+                }
+                hashes[uncached[k]] = uncachedHashes[k];
+                errors[uncached[k]] = std::move(uncachedErrors[k]);
+            }
+
+            fullHashCandidates += pending.size();
+            for (size_t i = 0; i < pending.size(); ++i) {
+                if (!errors[i].empty()) {
+                    reportError(ScanErrorKind::Read, pending[i].path, errors[i]);
+                    resolve(pending[i].size);
+                    continue;
+                }
+                // Further paths of the inode travel along with it
+                SpillRecord record;
+                record.file = std::move(pending[i]);
+                record.digest = hashes[i];
+                record.links = std::move(pendingLinks[i]);
+                digestSorter->add(std::move(record));
+            }
+            pending.clear();
+            pendingLinks.clear();
+            pendingBytes = 0;
+            if (keepLast) {
+                pendingBytes = ExternalSorter::footprint(last);
+                pending.push_back(std::move(last));
+                pendingLinks.push_back(std::move(lastLinks));
+            }
+        };
+
+        // Members of a digest arrive by path, so the first one is kept like in a regular batch and
+        // the set is streamed out in pieces that fit the budget
+        auto confirmByDigest = [&]() {
+            ScanStats::PhaseScope phase(scanStats, ScanPhase::FullHash);
+            spillPendingByDigest(false);
+            bool open = false;
+            bool keptSet = false;
+            FileEntry original;
+            Digest digest;
+            size_t groupMembers = 0;
+            DuplicateSet set;
+            std::size_t setBytes = 0;
+            auto flushSet = [&]() {
+                if (!set.paths.empty()) {
+                    keptSet = true;
+                    keepSet(std::move(set), &digest);
+                }
+                set = DuplicateSet();
+                set.original = original.path;
+                set.size = original.size;
+                setBytes = 0;
+            };
+            auto closeGroup = [&]() {
+                if (!open) {
+                    return;
+                }
+                flushSet();
+                if (keptSet) {
+                    ++duplicateSetCount;
+                } else if (groupMembers == 1) {
+                    ++fullHashEliminated;
                 } else {
-                    fileHashes[fileHash] = filePath;
+                    ++verifyEliminated;
+                }
+                if (!algorithm->isCryptographic() && groupMembers > 1) {
+                    verifyCandidates += groupMembers;
+                }
+                resolve(original.size);
+                open = false;
+            };
+
+            digestSorter->merge([&](SpillRecord& record) {
+                checkCancelled();
+                if (!open || record.digest != digest) {
+                    closeGroup();
+                    open = true;
+                    keptSet = false;
+                    digest = record.digest;
+                    original = std::move(record.file);
+                    groupMembers = 1;
+                    flushSet();
+                    return;
+                }
+
+                ++groupMembers;
+                if (!algorithm->isCryptographic()) {
+                    ScanStats::PhaseScope comparePhase(scanStats, ScanPhase::Compare);
+                    std::vector<std::string> compareErrors;
+                    const auto classes = ContentComparer().split({&original.path, &record.file.path},
+                                                                 original.size, compareErrors);
+                    counters.bytesRead.fetch_add(2 * original.size, std::memory_order_relaxed);
+                    if (classes.size() != 1 || classes.front().size() != 2) {
+                        if (!compareErrors[1].empty()) {
+                            reportError(ScanErrorKind::Read, record.file.path, compareErrors[1]);
+                        } else {
+                            ++verifyEliminated;
+                        }
+                        resolve(record.file.size);
+                        return;
+                    }
+                }
+                // A duplicate only frees its space once every path to it is gone, so its hardlinks go with it
+                ++duplicateFiles;
+                set.members.push_back(set.paths.size());
+                setBytes += ExternalSorter::footprint(record);
+                set.paths.push_back(std::move(record.file.path));
+                std::move(record.links.begin(), record.links.end(), std::back_inserter(set.paths));
+                resolve(record.file.size);
+                if (setBytes >= batchBudget) {
+                    flushSet();
+                }
+            });
+            closeGroup();
+        };
+
+        // Ends the files of one size: tier 0, a regular batch entry, or the digest sort
+        auto finishSize = [&]() {
+            if (digestSorter && digestSorter->size() > 0) {
+                confirmByDigest();
+            } else if (pending.size() == 1) {
+                ++uniqueSizeFiles;
+                uniqueSizeBytes += pending.front().size;
+                resolve(pending.front().size);
+            } else if (pending.size() > 1) {
+                groups.emplace_back();
+                for (size_t i = 0; i < pending.size(); ++i) {
+                    groups.back().push_back(files.size());
+                    if (!pendingLinks[i].empty()) {
+                        hardlinksOf[files.size()] = std::move(pendingLinks[i]);
+                    }
+                    files.push_back(std::move(pending[i]));
+                }
+                batchBytes += pendingBytes;
+                if (files.size() >= batchLimit || batchBytes >= batchBudget) {
+                    flushBatch();
                 }
-            } catch (const std::exception& e) {
-                std::cerr << "Error processing file: " << filePath << " - " << e.what() << std::endl;
             }
-            //we need the following for the progress bar
-            ++processedFiles;
+            pending.clear();
+            pendingLinks.clear();
+            pendingBytes = 0;
+        };
+
+        sizeSorter->merge([&](SpillRecord& record) {
+            checkCancelled();
+            FileEntry& file = record.file;
+            if (!pending.empty() && file.size != pending.back().size) {
+                finishSize();
+            }
+            const FileEntry* previous = pending.empty() ? nullptr : &pending.back();
+            if (previous != nullptr && (file.device != 0 || file.inode != 0)
+                    && file.device == previous->device && file.inode == previous->inode) {
+                pendingBytes += ExternalSorter::footprint(file);
+                pendingLinks.back().push_back(std::move(file.path));
+                ++hardlinkedPaths;
+                counters.discoveredFiles.fetch_sub(1, std::memory_order_relaxed);
+                counters.resolvedBytes.fetch_add(file.size, std::memory_order_relaxed);
+                return;
+            }
+            pendingBytes += ExternalSorter::footprint(file);
+            pending.push_back(std::move(file));
+            pendingLinks.emplace_back();
+            if (pending.size() >= batchLimit || pendingBytes >= batchBudget) {
+                spillPendingByDigest(true);
+            }
+        });
+        finishSize();
+        flushBatch();
+        scanStats.enterPhase(ScanPhase::Other);
+    }
+    checkCancelled();
+    const size_t uniqueFiles = processedFiles - duplicateFiles;
+    progress.stop();
+
+    console << std::endl;
+    console << "Hardlinks: " << hardlinkedPaths << " paths share their inode with another listed path and were not hashed." << std::endl;
+    console << "Size filter: skipped " << uniqueSizeFiles << " files with a unique size ("
+              << uniqueSizeBytes << " bytes not read)." << std::endl;
+    console << "Partial hash: eliminated " << partialHashEliminated << " of " << partialHashCandidates
+              << " candidate files by sampling " << blockSize << " bytes from head and tail." << std::endl;
+    console << "Full hash: eliminated " << fullHashEliminated << " of " << fullHashCandidates
+              << " remaining files." << std::endl;
+    if (compareCandidates > 0) {
+        console << "Byte comparison: eliminated " << compareEliminated << " of " << compareCandidates
+                  << " remaining files." << std::endl;
+    }
+    if (!algorithm->isCryptographic()) {
+        console << "Verification: byte comparison eliminated " << verifyEliminated << " of " << verifyCandidates
+                  << " files matched by " << algorithm->name() << "." << std::endl;
+    }
+    if (cache) {
+        const size_t hits = cache->hits();
+        const size_t stored = cache->stores();
+        try {
+            cache->save(options.cachePrune);
+        } catch (const std::exception& e) {
+            reportError(ScanErrorKind::Cache, options.cachePath, e.what());
         }
+        console << "Hash cache: " << hits << " hits, " << stored << " new entries, "
+                  << cache->size() << " entries stored." << std::endl;
+    }
+    if (sizeSorter) {
+        console << "Memory limit: file lists spilled to " << sizeSorter->runsWritten() << " sorted runs in "
+                << spillDirectory->path() << "." << std::endl;
+    }
 
-        if (showProgress) {
-            displayProgress(processedFiles, totalFiles);
+    // Sets are acted upon in chunks, rebuilt from the path store or replayed from the spool
+    scanStats.enterPhase(ScanPhase::Action);
+    ActionTotals totals;
+    printActionHeader();
+    if (spool) {
+        spool->replay(std::max<std::size_t>(options.maxMemory / 4, 1), [&](std::vector<DuplicateSet>& sets) {
+            applyAction(sets, pool, report, totals);
+        });
+    } else {
+        // Paths are rebuilt from the store a chunk of sets at a time
+        for (size_t begin = 0; begin < storedSets.size(); begin += kActionChunkSets) {
+            const size_t end = std::min(storedSets.size(), begin + kActionChunkSets);
+            std::vector<DuplicateSet> sets(end - begin);
+            for (size_t s = begin; s < end; ++s) {
+                DuplicateSet& set = sets[s - begin];
+                set.original = paths.path(storedSets[s].original);
+                set.size = storedSets[s].size;
+                set.members = storedSets[s].members;
+                for (const auto& ref : storedSets[s].paths) {
+                    set.paths.push_back(paths.path(ref));
+                }
+            }
+            applyAction(sets, pool, report, totals);
         }
     }
+    printActionResult(totals, uniqueFiles);
 
-    std::cout << std::endl;
+    report.summary(processedFiles, uniqueFiles, duplicateFiles, duplicateSetCount, options.liveRun);
+}
 
-    // Handle duplicates based on --live-run flag
-    if (liveRun) {
-        for (const auto& duplicate : duplicates) {
-            try {
-                fs::remove(duplicate);
-                std::cout << "Removed duplicate: " << duplicate << std::endl;
-            } catch (const std::exception& e) {
-                std::cerr << "Error deleting file: " << duplicate << " - " << e.what() << std::endl;
+void PurgeDuplicates::buildReferenceIndex() {
+    // Paths in the index have to stay valid wherever the targets are checked from
+    const std::string rootPath = fs::weakly_canonical(directoryPath).string();
+
+    // One entry per inode, under its smallest path, so the index of an unchanged tree is always the same
+    std::vector<FileEntry> files;
+    std::unordered_map<InodeKey, size_t, InodeKeyHash> fileOfInode;
+    std::uintmax_t discoveredBytes = 0;
+    WorkerPool pool(options.jobs);
+    ProgressRenderer progress(console, options.showProgress);
+    ProgressRenderer::Counters& counters = progress.counters();
+    FileWalker walker(rootPath, options.oneFileSystem, &cancelled);
+    scanStats.enterPhase(ScanPhase::Traversal);
+    walker.walk([&](FileEntry&& file) {
+        if (file.device != 0 || file.inode != 0) {
+            auto known = fileOfInode.emplace(InodeKey{file.device, file.inode}, files.size());
+            if (!known.second) {
+                std::string& kept = files[known.first->second].path;
+                if (file.path < kept) {
+                    kept = std::move(file.path);
+                }
+                return;
+            }
+        }
+        discoveredBytes += file.size;
+        files.push_back(std::move(file));
+        counters.discoveredFiles.store(files.size(), std::memory_order_relaxed);
+    }, [this](const std::string& filePath, const std::string& message) {
+        reportError(ScanErrorKind::Walk, filePath, message);
+    }, pool);
+    checkCancelled();
+    std::unordered_map<InodeKey, size_t, InodeKeyHash>().swap(fileOfInode);
+    progress.finishWalk(discoveredBytes);
+    scanStats.enterPhase(ScanPhase::Other);
+
+    ReadScheduler scheduler(options.readOrder, rootPath);
+    std::unique_ptr<HashCache> cache;
+    if (!options.cachePath.empty()) {
+        cache = std::make_unique<HashCache>(options.cachePath, algorithm->name());
+        if (!cache->loadError().empty()) {
+            reportError(ScanErrorKind::Cache, options.cachePath, cache->loadError());
+        }
+    }
+
+    // Every file gets the sample digest targets are first checked with, and its full digest
+    const std::size_t blockSize = options.sampleBlockSize;
+    const size_t batchLimit = scheduler.isActive() ? kOrderedBatchFiles : kBatchFiles;
+    std::vector<ReferenceIndex::Entry> entries;
+    entries.reserve(files.size());
+    size_t resolvedFiles = 0;
+    for (size_t begin = 0; begin < files.size(); begin += batchLimit) {
+        checkCancelled();
+        std::vector<size_t> members(std::min(batchLimit, files.size() - begin));
+        std::iota(members.begin(), members.end(), begin);
+        if (scheduler.isActive()) {
+            scheduler.locate(files, members, pool);
+        }
+        std::vector<Digest> samples(members.size());
+        std::vector<std::string> errors(members.size());
+        scanStats.enterPhase(ScanPhase::PartialHash);
+        hashFiles(files, members, true, pool, scheduler, samples, errors, counters.bytesRead);
+
+        scanStats.enterPhase(ScanPhase::FullHash);
+        std::vector<Digest> digests(samples);
+        std::vector<size_t> uncached;
+        std::vector<size_t> uncachedPositions;
+        for (size_t i = 0; i < members.size(); ++i) {
+            const FileEntry& file = files[members[i]];
+            if (!errors[i].empty()) {
+                continue;
+            }
+            if (sampleRanges(file.size, blockSize).empty()) {
+                if (cache) {
+                    cache->store(file, samples[i]);
+                }
+            } else if (!cache || !cache->lookup(file, digests[i])) {
+                uncached.push_back(members[i]);
+                uncachedPositions.push_back(i);
+            }
+        }
+        std::vector<Digest> uncachedHashes(uncached.size());
+        std::vector<std::string> uncachedErrors(uncached.size());
+        hashFiles(files, uncached, false, pool, scheduler, uncachedHashes, uncachedErrors, counters.bytesRead);
+        for (size_t k = 0; k < uncached.size(); ++k) {
+            if (cache && uncachedErrors[k].empty()) {
+                cache->store(files[uncached[k]], uncachedHashes[k]);
+            }
+            digests[uncachedPositions[k]] = uncachedHashes[k];
+            errors[uncachedPositions[k]] = std::move(uncachedErrors[k]);
+        }
+
+        for (size_t i = 0; i < members.size(); ++i) {
+            FileEntry& file = files[members[i]];
+            counters.resolvedFiles.store(++resolvedFiles, std::memory_order_relaxed);
+            counters.resolvedBytes.fetch_add(file.size, std::memory_order_relaxed);
+            if (!errors[i].empty()) {
+                reportError(ScanErrorKind::Read, file.path, errors[i]);
+                continue;
+            }
+            entries.push_back({std::move(file), samples[i], digests[i]});
+        }
+        scanStats.enterPhase(ScanPhase::Other);
+    }
+    checkCancelled();
+    progress.stop();
+
+    // Writing the index is what this mode does instead of acting on duplicates
+    scanStats.enterPhase(ScanPhase::Action);
+    const size_t hashedFiles = entries.size();
+    const size_t written = ReferenceIndex::write(options.buildReference, algorithm->name(), blockSize, rootPath, entries);
+    console << std::endl;
+    scanStats.enterPhase(ScanPhase::Other);
+    console << "Reference index: " << hashedFiles << " files of " << rootPath << " hashed, " << written
+            << " distinct contents written to " << options.buildReference << "." << std::endl;
+    if (cache) {
+        const size_t hits = cache->hits();
+        const size_t stored = cache->stores();
+        try {
+            cache->save(options.cachePrune);
+        } catch (const std::exception& e) {
+            reportError(ScanErrorKind::Cache, options.cachePath, e.what());
+        }
+        console << "Hash cache: " << hits << " hits, " << stored << " new entries, "
+                << cache->size() << " entries stored." << std::endl;
+    }
+}
+
+void PurgeDuplicates::removeReferencedDuplicates() {
+    ReferenceIndex index(options.referenceIndex);
+    if (!options.hashAlgorithm.empty() && options.hashAlgorithm != index.algorithm()) {
+        throw std::invalid_argument("The reference index was built with " + index.algorithm() + ", not "
+                                    + options.hashAlgorithm + ".");
+    }
+    algorithm = &HashAlgorithm::byName(index.algorithm());
+    options.sampleBlockSize = index.sampleBlockSize();
+    const std::string rootPath = fs::weakly_canonical(directoryPath).string();
+    if (index.covers(rootPath)) {
+        throw std::invalid_argument("The directory " + rootPath + " lies inside the reference tree " + index.root() + ".");
+    }
+    console << "Reference index: " << index.size() << " distinct contents of " << index.root() << ", hashed with "
+            << algorithm->name() << (algorithm->isCryptographic() ? "" : " (non-cryptographic, matches are verified byte by byte)")
+            << std::endl;
+
+    std::unique_ptr<ReportWriter> ownReport;
+    if (sharedReport == nullptr) {
+        ownReport = std::make_unique<ReportWriter>(options.reportFormat, std::cout);
+    }
+    ReportWriter& report = sharedReport != nullptr ? *sharedReport : *ownReport;
+    report.scan(rootPath, algorithm->name());
+
+    // Only files with a size found in the index are kept, each inode once with its further paths
+    std::vector<FileEntry> files;
+    std::unordered_map<InodeKey, size_t, InodeKeyHash> fileOfInode;
+    std::unordered_map<size_t, std::vector<std::string>> hardlinksOf;
+    size_t protectedFiles = 0;
+    size_t hardlinkedPaths = 0;
+    size_t unmatchedSizeFiles = 0;
+    std::uintmax_t unmatchedSizeBytes = 0;
+    std::uintmax_t candidateBytes = 0;
+    size_t discoveredFiles = 0;
+    size_t processedFiles = 0;
+    WorkerPool pool(options.jobs);
+    ProgressRenderer progress(console, options.showProgress);
+    ProgressRenderer::Counters& counters = progress.counters();
+    auto resolve = [&](std::uintmax_t size) {
+        ++processedFiles;
+        counters.resolvedFiles.store(processedFiles, std::memory_order_relaxed);
+        counters.resolvedBytes.fetch_add(size, std::memory_order_relaxed);
+    };
+    std::unique_ptr<HashCache> cache;
+    if (!options.cachePath.empty()) {
+        cache = std::make_unique<HashCache>(options.cachePath, algorithm->name());
+        if (!cache->loadError().empty()) {
+            reportError(ScanErrorKind::Cache, options.cachePath, cache->loadError());
+        }
+    }
+    FileWalker walker(rootPath, options.oneFileSystem, &cancelled);
+    scanStats.enterPhase(ScanPhase::Traversal);
+    walker.walk([&](FileEntry&& file) {
+        // Pruning keeps the records of every file walked, even of those that are never looked up
+        if (cache && options.cachePrune) {
+            cache->keep(file);
+        }
+        // The reference tree may lie inside the directory, its files are never touched
+        if (index.covers(file.path)) {
+            ++protectedFiles;
+            return;
+        }
+        if (!index.hasSize(file.size)) {
+            ++unmatchedSizeFiles;
+            unmatchedSizeBytes += file.size;
+            counters.discoveredFiles.store(++discoveredFiles, std::memory_order_relaxed);
+            resolve(file.size);
+            return;
+        }
+        if (file.device != 0 || file.inode != 0) {
+            auto known = fileOfInode.emplace(InodeKey{file.device, file.inode}, files.size());
+            if (!known.second) {
+                // Listed under its smallest path like in a scan within the directory
+                std::string& listed = files[known.first->second].path;
+                if (file.path < listed) {
+                    std::swap(file.path, listed);
+                }
+                hardlinksOf[known.first->second].push_back(std::move(file.path));
+                ++hardlinkedPaths;
+                return;
+            }
+        }
+        candidateBytes += file.size;
+        files.push_back(std::move(file));
+        counters.discoveredFiles.store(++discoveredFiles, std::memory_order_relaxed);
+    }, [this](const std::string& filePath, const std::string& message) {
+        reportError(ScanErrorKind::Walk, filePath, message);
+    }, pool);
+    checkCancelled();
+    std::unordered_map<InodeKey, size_t, InodeKeyHash>().swap(fileOfInode);
+    progress.finishWalk(candidateBytes);
+    scanStats.enterPhase(ScanPhase::Other);
+
+    ReadScheduler scheduler(options.readOrder, rootPath);
+
+    const std::size_t blockSize = options.sampleBlockSize;
+    const size_t batchLimit = scheduler.isActive() ? kOrderedBatchFiles : kBatchFiles;
+    size_t partialHashCandidates = 0;
+    size_t partialHashEliminated = 0;
+    size_t fullHashCandidates = 0;
+    size_t fullHashEliminated = 0;
+    size_t verifyCandidates = 0;
+    size_t verifyEliminated = 0;
+    size_t changedReferences = 0;
+    size_t duplicateFiles = 0;
+
+    // Every matched reference file heads one set; a reference file changed since it was indexed heads none
+    constexpr size_t kStaleReference = SIZE_MAX;
+    std::vector<DuplicateSet> sets;
+    std::vector<Digest> setDigests;
+    std::unordered_map<const ReferenceIndex::Record*, size_t> setOf;
+    for (size_t begin = 0; begin < files.size(); begin += batchLimit) {
+        checkCancelled();
+        std::vector<size_t> members(std::min(batchLimit, files.size() - begin));
+        std::iota(members.begin(), members.end(), begin);
+        if (scheduler.isActive()) {
+            scheduler.locate(files, members, pool);
+        }
+
+        // Tier 1: the head/tail sample has to be in the index as well
+        scanStats.enterPhase(ScanPhase::PartialHash);
+        std::vector<Digest> samples(members.size());
+        std::vector<std::string> errors(members.size());
+        hashFiles(files, members, true, pool, scheduler, samples, errors, counters.bytesRead);
+        partialHashCandidates += members.size();
+        std::vector<Digest> digests(samples);
+        std::vector<size_t> matched;
+        std::vector<size_t> uncached;
+        std::vector<size_t> uncachedPositions;
+        for (size_t i = 0; i < members.size(); ++i) {
+            const FileEntry& file = files[members[i]];
+            if (!errors[i].empty()) {
+                reportError(ScanErrorKind::Read, file.path, errors[i]);
+                resolve(file.size);
+            } else if (!index.hasSample(file.size, samples[i])) {
+                ++partialHashEliminated;
+                resolve(file.size);
+            } else if (sampleRanges(file.size, blockSize).empty() || (cache && cache->lookup(file, digests[i]))) {
+                matched.push_back(i);
+            } else {
+                uncached.push_back(members[i]);
+                uncachedPositions.push_back(i);
+            }
+        }
+
+        // Tier 2: files still matching are read in full
+        scanStats.enterPhase(ScanPhase::FullHash);
+        std::vector<Digest> uncachedHashes(uncached.size());
+        std::vector<std::string> uncachedErrors(uncached.size());
+        hashFiles(files, uncached, false, pool, scheduler, uncachedHashes, uncachedErrors, counters.bytesRead);
+        for (size_t k = 0; k < uncached.size(); ++k) {
+            const FileEntry& file = files[uncached[k]];
+            if (!uncachedErrors[k].empty()) {
+                reportError(ScanErrorKind::Read, file.path, uncachedErrors[k]);
+                resolve(file.size);
+                continue;
+            }
+            if (cache) {
+                cache->store(file, uncachedHashes[k]);
+            }
+            digests[uncachedPositions[k]] = uncachedHashes[k];
+            matched.push_back(uncachedPositions[k]);
+        }
+
+        fullHashCandidates += matched.size();
+        for (size_t i : matched) {
+            FileEntry& file = files[members[i]];
+            const ReferenceIndex::Record* match = index.find(file.size, samples[i], digests[i]);
+            if (match == nullptr) {
+                ++fullHashEliminated;
+                resolve(file.size);
+                continue;
+            }
+            // The reference file itself, reached through a path outside of the reference tree
+            if ((file.device != 0 || file.inode != 0) && match->device == file.device && match->inode == file.inode) {
+                ++protectedFiles;
+                resolve(file.size);
+                continue;
+            }
+
+            auto found = setOf.find(match);
+            if (found == setOf.end()) {
+                // A reference file is only trusted as long as it still looks the way it was indexed. The
+                // inode and the status change time catch contents replaced with the old size and mtime
+                const std::string referencePath = index.path(*match);
+                FileEntry reference;
+                const bool current = FileWalker::describe(referencePath, reference)
+                        && reference.device == match->device && reference.inode == match->inode
+                        && reference.size == match->size && reference.mtimeNs == match->mtimeNs
+                        && reference.ctimeNs == match->ctimeNs;
+                if (!current) {
+                    reportError(ScanErrorKind::Reference, referencePath, "changed since it was indexed");
+                }
+                found = setOf.emplace(match, current ? sets.size() : kStaleReference).first;
+                if (current) {
+                    sets.emplace_back();
+                    sets.back().original = referencePath;
+                    sets.back().size = match->size;
+                    setDigests.push_back(digests[i]);
+                }
+            }
+            if (found->second == kStaleReference) {
+                ++changedReferences;
+                resolve(file.size);
+                continue;
+            }
+
+            DuplicateSet& set = sets[found->second];
+            if (!algorithm->isCryptographic()) {
+                ScanStats::PhaseScope comparePhase(scanStats, ScanPhase::Compare);
+                ++verifyCandidates;
+                std::vector<std::string> compareErrors;
+                const auto classes = ContentComparer().split({&set.original, &file.path}, file.size, compareErrors);
+                counters.bytesRead.fetch_add(2 * file.size, std::memory_order_relaxed);
+                if (classes.size() != 1 || classes.front().size() != 2) {
+                    for (size_t k = 0; k < compareErrors.size(); ++k) {
+                        if (!compareErrors[k].empty()) {
+                            reportError(ScanErrorKind::Read, k == 0 ? set.original : file.path, compareErrors[k]);
+                        }
+                    }
+                    if (compareErrors[0].empty() && compareErrors[1].empty()) {
+                        ++verifyEliminated;
+                    }
+                    resolve(file.size);
+                    continue;
+                }
+            }
+            // A duplicate only frees its space once every path to it is gone, so its hardlinks go with it
+            ++duplicateFiles;
+            set.members.push_back(set.paths.size());
+            set.paths.push_back(std::move(file.path));
+            auto links = hardlinksOf.find(members[i]);
+            if (links != hardlinksOf.end()) {
+                std::move(links->second.begin(), links->second.end(), std::back_inserter(set.paths));
+            }
+            resolve(file.size);
+        }
+        scanStats.enterPhase(ScanPhase::Other);
+    }
+    checkCancelled();
+    const size_t uniqueFiles = processedFiles - duplicateFiles;
+    progress.stop();
+
+    console << std::endl;
+    console << "Reference tree: skipped " << protectedFiles << " files inside " << index.root() << "." << std::endl;
+    console << "Hardlinks: " << hardlinkedPaths << " paths share their inode with another listed path and were not hashed." << std::endl;
+    console << "Size filter: skipped " << unmatchedSizeFiles << " files with a size not in the reference index ("
+            << unmatchedSizeBytes << " bytes not read)." << std::endl;
+    console << "Partial hash: eliminated " << partialHashEliminated << " of " << partialHashCandidates
+            << " candidate files by sampling " << blockSize << " bytes from head and tail." << std::endl;
+    console << "Full hash: eliminated " << fullHashEliminated << " of " << fullHashCandidates
+            << " remaining files." << std::endl;
+    if (!algorithm->isCryptographic()) {
+        console << "Verification: byte comparison eliminated " << verifyEliminated << " of " << verifyCandidates
+                << " files matched by " << algorithm->name() << "." << std::endl;
+    }
+    if (changedReferences > 0) {
+        console << "Changed references: kept " << changedReferences
+                << " files whose reference file changed since it was indexed." << std::endl;
+    }
+    if (cache) {
+        const size_t hits = cache->hits();
+        const size_t stored = cache->stores();
+        try {
+            cache->save(options.cachePrune);
+        } catch (const std::exception& e) {
+            reportError(ScanErrorKind::Cache, options.cachePath, e.what());
+        }
+        console << "Hash cache: " << hits << " hits, " << stored << " new entries, "
+                << cache->size() << " entries stored." << std::endl;
+    }
+
+    // A set whose every match failed verification has nothing to act upon
+    size_t kept = 0;
+    for (size_t s = 0; s < sets.size(); ++s) {
+        if (!sets[s].paths.empty()) {
+            if (kept != s) {
+                sets[kept] = std::move(sets[s]);
+                setDigests[kept] = setDigests[s];
+            }
+            ++kept;
+        }
+    }
+    sets.resize(kept);
+    // Members of a set trickle in across batches, so sets are only complete at the end
+    for (size_t s = 0; s < sets.size(); ++s) {
+        if (report.isMachineReadable()) {
+            std::vector<const std::string*> paths;
+            for (const auto& path : sets[s].paths) {
+                paths.push_back(&path);
+            }
+            report.group(&setDigests[s], sets[s].size, sets[s].original, paths);
+        }
+        if (listener.onGroup) {
+            listener.onGroup(sets[s], &setDigests[s]);
+        }
+    }
+
+    scanStats.enterPhase(ScanPhase::Action);
+    ActionTotals totals;
+    printActionHeader();
+    applyAction(sets, pool, report, totals);
+    printActionResult(totals, uniqueFiles);
+
+    report.summary(processedFiles, uniqueFiles, duplicateFiles, sets.size(), options.liveRun);
+}
+
+void PurgeDuplicates::applyAction(const std::vector<DuplicateSet>& sets, WorkerPool& pool, ReportWriter& report,
+                                  ActionTotals& totals) const {
+    checkCancelled();
+    // Sharing extents keeps every path, so hardlinks of a duplicate need no treatment of their own
+    if (options.action == DuplicateAction::Reflink && !options.liveRun) {
+        for (const auto& set : sets) {
+            for (size_t member : set.members) {
+                console << "  " << set.paths[member] << " -> " << set.original << '\n';
+            }
+        }
+    } else if (options.action == DuplicateAction::Reflink) {
+        std::vector<std::vector<std::uint64_t>> shared(sets.size());
+        std::vector<std::vector<std::string>> errors(sets.size());
+        pool.parallelFor(sets.size(), [&](size_t s) {
+            std::vector<const std::string*> paths;
+            for (size_t member : sets[s].members) {
+                paths.push_back(&sets[s].paths[member]);
+            }
+            Deduplicator::shareExtents(sets[s].original, paths, sets[s].size, shared[s], errors[s]);
+        });
+
+        for (size_t s = 0; s < sets.size(); ++s) {
+            for (size_t d = 0; d < sets[s].members.size(); ++d) {
+                const std::string& path = sets[s].paths[sets[s].members[d]];
+                report.action(DuplicateAction::Reflink, path, shared[s][d], errors[s][d]);
+                if (!errors[s][d].empty()) {
+                    reportError(ScanErrorKind::Reflink, path, errors[s][d]);
+                }
+                if (shared[s][d] > 0) {
+                    ++totals.sharedFiles;
+                    totals.sharedBytes += shared[s][d];
+                    console << "Shared extents: " << path << " (" << shared[s][d] << " bytes)" << '\n';
+                }
+            }
+        }
+    } else if (options.action == DuplicateAction::Hardlink) {
+        // Every path of a duplicate, hardlinks included, becomes a link to the original so its space is freed
+        std::vector<std::pair<const std::string*, const std::string*>> replacements;
+        for (const auto& set : sets) {
+            for (const auto& path : set.paths) {
+                replacements.emplace_back(&path, &set.original);
+            }
+        }
+        if (!options.liveRun) {
+            for (const auto& replacement : replacements) {
+                console << "  " << *replacement.first << " -> " << *replacement.second << '\n';
+            }
+        } else {
+            std::vector<std::string> errors;
+            Deduplicator::replaceWithHardlinks(replacements, errors);
+            for (size_t i = 0; i < replacements.size(); ++i) {
+                report.action(DuplicateAction::Hardlink, *replacements[i].first, 0, errors[i]);
+                if (errors[i].empty()) {
+                    ++totals.replaced;
+                    console << "Replaced with hardlink: " << *replacements[i].first << " -> "
+                            << *replacements[i].second << '\n';
+                } else {
+                    reportError(ScanErrorKind::Hardlink, *replacements[i].first, errors[i]);
+                }
+            }
+        }
+    } else if (options.liveRun) {
+        // Handle duplicates based on --live-run flag
+        std::vector<const std::string*> paths;
+        for (const auto& set : sets) {
+            for (const auto& path : set.paths) {
+                paths.push_back(&path);
+            }
+        }
+        std::vector<std::string> errors;
+        Deduplicator::removeFiles(paths, errors);
+        for (size_t i = 0; i < paths.size(); ++i) {
+            report.action(DuplicateAction::Delete, *paths[i], 0, errors[i]);
+            if (errors[i].empty()) {
+                console << "Removed duplicate: " << *paths[i] << '\n';
+            } else {
+                reportError(ScanErrorKind::Delete, *paths[i], errors[i]);
             }
         }
-        std::cout << "Duplicate removal complete. Processed " << fileHashes.size() << " unique files." << std::endl;
     } else {
         // Dry-run: List duplicate files without deletion
-        std::cout << "Dry Run: The following files would be deleted:" << std::endl;
-        for (const auto& duplicate : duplicates) {
-            std::cout << "  " << duplicate << std::endl;
+        for (const auto& set : sets) {
+            for (const auto& path : set.paths) {
+                console << "  " << path << '\n';
+            }
+        }
+    }
+}
+
+void PurgeDuplicates::printActionHeader() const {
+    if (!options.liveRun) {
+        if (options.action == DuplicateAction::Reflink) {
+            console << "Dry Run: The following files would share the extents of the kept original:" << std::endl;
+        } else if (options.action == DuplicateAction::Hardlink) {
+            console << "Dry Run: The following files would be replaced by a hardlink to the kept original:" << std::endl;
+        } else {
+            console << "Dry Run: The following files would be deleted:" << std::endl;
         }
-        std::cout << "Dry run complete. No files were deleted." << std::endl;
-        std::cout << "To perform the actual deletion, re-run the command with the --live-run flag." << std::endl;
+    }
+}
+
+void PurgeDuplicates::printActionResult(const ActionTotals& totals, size_t uniqueFiles) const {
+    if (!options.liveRun) {
+        if (options.action == DuplicateAction::Delete) {
+            console << "Dry run complete. No files were deleted." << std::endl;
+            console << "To perform the actual deletion, re-run the command with the --live-run flag." << std::endl;
+        } else {
+            console << "Dry run complete. No files were modified." << std::endl;
+            console << (options.action == DuplicateAction::Reflink ? "To share the extents" : "To replace the files")
+                    << ", re-run the command with the --live-run flag." << std::endl;
+        }
+    } else if (options.action == DuplicateAction::Reflink) {
+        console << "Reflink complete. " << totals.sharedBytes << " bytes of " << totals.sharedFiles
+                << " duplicate files now share the extents of their original. Processed " << uniqueFiles
+                << " unique files." << std::endl;
+    } else if (options.action == DuplicateAction::Hardlink) {
+        console << "Hardlink replacement complete. " << totals.replaced << " paths now link to their original. Processed "
+                << uniqueFiles << " unique files." << std::endl;
+    } else {
+        console << "Duplicate removal complete. Processed " << uniqueFiles << " unique files." << std::endl;
     }
 }
 
 void PurgeDuplicates::execute() {
-    identifyAndRemoveDuplicates();
+    scanStats.start();
+    try {
+        if (!options.buildReference.empty()) {
+            buildReferenceIndex();
+        } else if (!options.referenceIndex.empty()) {
+            removeReferencedDuplicates();
+        } else {
+            identifyAndRemoveDuplicates();
+        }
+    } catch (const Cancelled&) {
+        console << std::endl << "Scan cancelled." << std::endl;
+    }
+    scanStats.finish();
+
+    if (options.printStats) {
+        console << std::endl;
+        scanStats.print(console);
+    }
+    if (!options.statsPath.empty()) {
+        std::ofstream out(options.statsPath, std::ios::app);
+        out << scanStats.toJson() << '\n';
+        if (!out) {
+            throw std::runtime_error("Could not write the statistics to " + options.statsPath + ".");
+        }
+    }
+}
+
+void PurgeDuplicates::cancel() {
+    cancelled.store(true, std::memory_order_relaxed);
+}
+
+bool PurgeDuplicates::isCancelled() const {
+    return cancelled.load(std::memory_order_relaxed);
+}
+
+void PurgeDuplicates::checkCancelled() const {
+    if (isCancelled()) {
+        throw Cancelled();
+    }
+}
+
+void PurgeDuplicates::reportError(ScanErrorKind kind, const std::string& path, const std::string& message) const {
+    if (message == kCancelledError) {
+        return;
+    }
+    ScanStats::countError(kind);
+    if (listener.onError) {
+        listener.onError(path, message);
+        return;
+    }
+    const char* action = "processing file";
+    switch (kind) {
+        case ScanErrorKind::Delete:
+            action = "deleting file";
+            break;
+        case ScanErrorKind::Hardlink:
+            action = "replacing file";
+            break;
+        case ScanErrorKind::Reflink:
+            action = "sharing extents of file";
+            break;
+        case ScanErrorKind::Cache:
+            action = "using hash cache";
+            break;
+        case ScanErrorKind::Reference:
+            action = "using reference file";
+            break;
+        default:
+            break;
+    }
+    std::cerr << "Error " << action << ": " << path << " - " << message << std::endl;
 }
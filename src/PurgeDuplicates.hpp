@@ -26,10 +26,27 @@
 #ifndef PURGE_DUPLICATES_HPP
 #define PURGE_DUPLICATES_HPP
 
+#include "Digest.hpp"
+#include "FileEntry.hpp"
+#include "FileReader.hpp"
+#include "Hasher.hpp"
+#include "ScanListener.hpp"
+#include "ScanOptions.hpp"
+#include "ScanStats.hpp"
+#include <atomic>
+#include <cstdint>
+#include <iostream>
 #include <string>
+#include <vector>
+
+class ReadScheduler;
+class WorkerPool;
 
 class PurgeDuplicates {
 public:
+    // Smallest memory limit accepted, below it the sorted runs would be too small to be worthwhile
+    static constexpr std::size_t kMinMaxMemory = 16 << 20;
+
     /**
      * @brief Constructor to initialize the PurgeDuplicates object.
      * @param directory Path to the directory that will be processed.
@@ -37,11 +54,54 @@ public:
      * @param liveRun Must be passed and set as true to force a real run
      */
     PurgeDuplicates(std::string  directory, bool showProgress, bool liveRun = false);
+    /**
+     * @brief Constructor to initialize the PurgeDuplicates object with the full set of scan options.
+     * @param directory Path to the directory that will be processed.
+     * @param options Settings controlling the scan.
+     */
+    PurgeDuplicates(std::string  directory, const ScanOptions& options);
+    /**
+     * @brief Constructor for a scan embedded in another program, which receives its results through callbacks.
+     * @param directory Path to the directory that will be processed.
+     * @param options Settings controlling the scan; progress is never drawn.
+     * @param listener Receives duplicate sets and errors while the scan runs. Without any callback the
+     *                 scan behaves like the command-line tool.
+     * @details In a dry run the sets are not retained once handed to the listener, so memory does not
+     *          grow with the number of duplicates.
+     */
+    PurgeDuplicates(std::string  directory, const ScanOptions& options, ScanListener listener);
     /**
      * @brief Executes the logic for identifying and removing duplicates.
+     * @details Returns early, without acting on any set, if the scan is cancelled.
      */
     void execute();
 
+    /**
+     * @brief Writes the records of execute() to a report shared with the scans of other directories.
+     * @details Without it every scan opens a report of its own on stdout, which for the binary format
+     *          repeats the leading magic. The report must outlive execute().
+     */
+    void shareReport(ReportWriter& report);
+
+    /**
+     * @brief Asks a running scan to stop.
+     * @details Safe to call from any thread and from the listener callbacks. The walk and the hashing
+     *          stop at the next file, the scan ends after the batch being confirmed, and no set is acted
+     *          upon afterwards. Sets already delivered to the listener stay valid duplicates.
+     */
+    void cancel();
+
+    /**
+     * @brief Whether cancel() was called.
+     */
+    bool isCancelled() const;
+
+    /**
+     * @brief Time per phase, I/O counters, errors and hashing latencies of the last execute().
+     * @details Always recorded; --stats and --stats-json only decide whether they are written out.
+     */
+    const ScanStats& stats() const { return scanStats; }
+
 /**
  * @brief Generates a cryptographic hash of a file's contents using Blake2 algorithm.
  * @param filePath The file to generate the hash for.
@@ -55,23 +115,155 @@ public:
  */
     static std::string generateHash(const std::string& filePath);
 
+/**
+ * @brief Generates the Blake2 hash of a file's contents, reading it through the given reader.
+ * @param filePath The file to generate the hash for.
+ * @param reader The reader backend used to pull the file contents.
+ * @return The hash as a hexadecimal string.
+ * @throws std::runtime_error If the hash generation fails.
+ * @throws std::ios_base::failure If the file cannot be opened or read.
+ */
+    static std::string generateHash(const std::string& filePath, const FileReader& reader);
+
+/**
+ * @brief Generates the digest of a file's contents in binary form with the given hasher.
+ * @param filePath The file to generate the digest for.
+ * @param reader The reader backend used to pull the file contents.
+ * @param hasher A hasher at the start of a message; its state is unspecified after an exception.
+ * @see generateHash(const std::string&, const FileReader&)
+ */
+    static Digest generateDigest(const std::string& filePath, const FileReader& reader, Hasher& hasher);
+
+/**
+ * @brief Generates a cheap hash of a file from its first and last block only.
+ * @param filePath The file to generate the hash for.
+ * @param fileSize The size of the file in bytes.
+ * @param blockSize Number of bytes sampled from the head and from the tail of the file.
+ * @return The hash as a hexadecimal string.
+ * @details Files no larger than two blocks are hashed in full, so for those the result
+ *          already identifies the whole content.
+ * @throws std::runtime_error If the hash generation fails.
+ * @throws std::ios_base::failure If the file cannot be opened or read.
+ */
+    static std::string generatePartialHash(const std::string& filePath, std::uintmax_t fileSize, std::size_t blockSize);
+
+/**
+ * @brief Generates the partial hash of a file, reading it through the given reader.
+ * @see generatePartialHash(const std::string&, std::uintmax_t, std::size_t)
+ */
+    static std::string generatePartialHash(const std::string& filePath, std::uintmax_t fileSize, std::size_t blockSize,
+                                           const FileReader& reader);
+
+/**
+ * @brief Generates the partial hash of a file in binary form with the given hasher.
+ * @see generatePartialHash(const std::string&, std::uintmax_t, std::size_t)
+ * @see generateDigest(const std::string&, const FileReader&, Hasher&)
+ */
+    static Digest generatePartialDigest(const std::string& filePath, std::uintmax_t fileSize, std::size_t blockSize,
+                                        const FileReader& reader, Hasher& hasher);
+
 /**
  * @brief Displays a progress bar in the console.
  * @param current The current progress count.
- * @param total The total number of files to process.
+ * @param total The total number of files to process, which may still grow while the tree is walked.
+ * @param out Stream the bar is drawn on.
  */
-void displayProgress(size_t current, size_t total);
+void displayProgress(size_t current, size_t total, std::ostream& out = std::cout);
 
 private:
     std::string directoryPath; // The path to the target directory
-    bool showProgress;         // Flag to indicate if a progress bar is displayed
-    bool liveRun;              // Force a real deletion of files instead of a dry run
+    ScanOptions options;       // Settings controlling the scan
+    ScanListener listener;     // Callbacks of an embedding program, empty for the command-line tool
+    bool embedded;             // Whether the listener has a callback, which silences the console
+    std::ostream silentConsole{nullptr}; // Discards the human readable messages of an embedded scan
+    std::ostream& console;     // Human readable messages, stderr when stdout carries a machine-readable report
+    std::atomic<bool> cancelled{false}; // Raised by cancel(), polled between files and batches
+    FileReader reader;         // Reader backend shared by all hashing threads
+    const HashAlgorithm* algorithm; // Digest used by the partial and the full hash tiers
+    bool uringEnabled;         // Read small files through io_uring instead of the synchronous reader
+    ScanStats scanStats;       // Instrumentation of the last execute()
+    ReportWriter* sharedReport = nullptr; // Report shared with other scans, null opens one on stdout
+
+    /**
+     * @brief Totals of a live run, accumulated over every chunk of sets acted upon.
+     */
+    struct ActionTotals {
+        std::uintmax_t sharedBytes = 0; // Bytes of duplicates now sharing the extents of their original
+        size_t sharedFiles = 0;         // Duplicates sharing at least some of their extents
+        size_t replaced = 0;            // Paths replaced by a hardlink
+    };
+
+    /**
+     * @brief Thrown at the checkpoints of a cancelled scan and caught by execute().
+     */
+    struct Cancelled {};
+
+    /**
+     * @brief Unwinds the scan if it was cancelled; only called outside of worker tasks.
+     */
+    void checkCancelled() const;
+
+    /**
+     * @brief Reports a file that could not be processed, to the listener or else to stderr.
+     * @param kind What failed; it is counted in the statistics and names the action in
+     *             "Error <action>: <path> - <message>".
+     * @details Files left unread by a cancelled scan fail with a marker message that is not reported.
+     */
+    void reportError(ScanErrorKind kind, const std::string& path, const std::string& message) const;
 
     /**
      * @brief Identifies and removes duplicate files in a directory.
      * This is the main logic for processing the directory.
      */
     void identifyAndRemoveDuplicates();
+
+    /**
+     * @brief Hashes every file of the directory and writes the reference index.
+     * @details Each inode is hashed once, under its smallest path. Nothing is removed.
+     */
+    void buildReferenceIndex();
+
+    /**
+     * @brief Removes the files of the directory whose content is in the reference index.
+     * @details The index decides the digest and the sample size. Only files whose size and sample
+     *          match an indexed file are read in full, and the reference tree is never read, except
+     *          to verify matches of a non-cryptographic digest. Files inside the reference tree are
+     *          skipped, and so are matches whose reference file changed since it was indexed.
+     */
+    void removeReferencedDuplicates();
+
+    /**
+     * @brief Applies the configured action to confirmed sets, or lists them in a dry run.
+     * @param totals Receives the outcome of a live run.
+     */
+    void applyAction(const std::vector<DuplicateSet>& sets, WorkerPool& pool, ReportWriter& report,
+                     ActionTotals& totals) const;
+
+    /**
+     * @brief Announces what a dry run lists.
+     */
+    void printActionHeader() const;
+
+    /**
+     * @brief Concludes the action phase with the totals of a live run or a hint on how to start one.
+     */
+    void printActionResult(const ActionTotals& totals, size_t uniqueFiles) const;
+
+    /**
+     * @brief Hashes files on the worker pool through the configured I/O engine.
+     * @param files All discovered files.
+     * @param members Indices into files of the files to hash.
+     * @param sampled Compute the partial head/tail hash instead of the full hash.
+     * @param pool Worker pool the hashes are computed on.
+     * @param scheduler Decides the order in which the files are read.
+     * @param hashes Receives the digest of members[i] at position i.
+     * @param errors Receives the error message of members[i] at position i if it could not be hashed.
+     * @param bytesRead Incremented by the bytes hashed for every file that could be hashed.
+     */
+    void hashFiles(const std::vector<FileEntry>& files, const std::vector<size_t>& members, bool sampled,
+                   WorkerPool& pool, const ReadScheduler& scheduler,
+                   std::vector<Digest>& hashes, std::vector<std::string>& errors,
+                   std::atomic<std::uint64_t>& bytesRead) const;
 };
 
 #endif // PURGE_DUPLICATES_HPP
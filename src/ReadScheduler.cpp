@@ -0,0 +1,195 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "ReadScheduler.hpp"
+#include "Platform.hpp"
+#include "ScanStats.hpp"
+#include "WorkerPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+
+#if PDCPP_HAS_POSIX_IO
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#if defined(__linux__)
+#include <linux/fiemap.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sysmacros.h>
+#endif
+
+ReadScheduler::ReadScheduler(ReadOrder order, const std::string& root)
+        : resolvedOrder(order) {
+    if (resolvedOrder == ReadOrder::Auto) {
+        resolvedOrder = isRotational(root) ? ReadOrder::Extent : ReadOrder::Discovery;
+    }
+}
+
+void ReadScheduler::locate(const std::vector<FileEntry>& files, const std::vector<std::size_t>& indices, WorkerPool& pool) {
+    if (!isActive()) {
+        return;
+    }
+    keys.assign(files.size(), 0);
+
+    if (resolvedOrder == ReadOrder::Extent) {
+        // Extent maps live next to the inodes, so they are fetched in inode order
+        std::vector<std::size_t> byInode(indices);
+        std::sort(byInode.begin(), byInode.end(), [&](std::size_t a, std::size_t b) {
+            return files[a].device != files[b].device ? files[a].device < files[b].device
+                                                      : files[a].inode < files[b].inode;
+        });
+        std::atomic<bool> unsupported{false};
+        pool.parallelForOrdered(byInode.size(), [&](std::size_t k) {
+            if (unsupported.load(std::memory_order_relaxed)) {
+                return;
+            }
+            const std::size_t index = byInode[k];
+            try {
+                if (!firstExtent(files[index].path, keys[index])) {
+                    unsupported = true;
+                }
+            } catch (const std::exception&) {
+                // The hash tier reports the file; reading it first lets it fail early
+                keys[index] = 0;
+            }
+        });
+        if (!unsupported) {
+            return;
+        }
+        resolvedOrder = ReadOrder::Inode;
+    }
+
+    for (std::size_t index : indices) {
+        keys[index] = files[index].inode;
+    }
+}
+
+std::vector<std::size_t> ReadScheduler::sort(const std::vector<FileEntry>& files,
+                                             const std::vector<std::size_t>& members) const {
+    std::vector<std::size_t> positions(members.size());
+    std::iota(positions.begin(), positions.end(), 0);
+    if (!isActive() || keys.empty()) {
+        return positions;
+    }
+    std::sort(positions.begin(), positions.end(), [&](std::size_t a, std::size_t b) {
+        const std::size_t left = members[a];
+        const std::size_t right = members[b];
+        if (files[left].device != files[right].device) {
+            return files[left].device < files[right].device;
+        }
+        if (keys[left] != keys[right]) {
+            return keys[left] < keys[right];
+        }
+        return a < b;
+    });
+    return positions;
+}
+
+bool ReadScheduler::firstExtent(const std::string& path, std::uint64_t& physicalOffset) {
+#if defined(__linux__)
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    ScanStats::count(StatCounter::LocateCalls);
+    if (fd < 0) {
+        throw std::runtime_error(std::strerror(errno));
+    }
+
+    // One extent is all it takes to place the start of the file
+    alignas(struct fiemap) unsigned char buffer[sizeof(struct fiemap) + sizeof(struct fiemap_extent)] = {};
+    auto* map = reinterpret_cast<struct fiemap*>(buffer);
+    map->fm_start = 0;
+    map->fm_length = FIEMAP_MAX_OFFSET;
+    map->fm_extent_count = 1;
+    const int result = ::ioctl(fd, FS_IOC_FIEMAP, map);
+    ScanStats::count(StatCounter::LocateCalls);
+    const int error = errno;
+    ::close(fd);
+    if (result != 0) {
+        if (error == EOPNOTSUPP || error == ENOTTY || error == EINVAL) {
+            return false;
+        }
+        throw std::runtime_error(std::strerror(error));
+    }
+    physicalOffset = map->fm_mapped_extents == 0 ? 0 : map->fm_extents[0].fe_physical;
+    return true;
+#else
+    (void)path;
+    (void)physicalOffset;
+    return false;
+#endif
+}
+
+bool ReadScheduler::isRotational(const std::string& path) {
+#if defined(__linux__)
+    struct stat status {};
+    if (::stat(path.c_str(), &status) != 0) {
+        return false;
+    }
+    // A partition has no queue of its own, its parent disk does
+    const std::string device = "/sys/dev/block/" + std::to_string(major(status.st_dev)) + ":"
+                               + std::to_string(minor(status.st_dev));
+    for (const char* queue : {"/queue/rotational", "/../queue/rotational"}) {
+        std::ifstream flag(device + queue);
+        int rotational = 0;
+        if (flag >> rotational) {
+            return rotational != 0;
+        }
+    }
+    return false;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+ReadOrder ReadScheduler::parseOrder(const std::string& name) {
+    for (ReadOrder order : {ReadOrder::Auto, ReadOrder::Discovery, ReadOrder::Inode, ReadOrder::Extent}) {
+        if (name == orderName(order)) {
+            return order;
+        }
+    }
+    throw std::invalid_argument("'" + name + "' is not a known read order (auto, discovery, inode, extent).");
+}
+
+const char* ReadScheduler::orderName(ReadOrder order) {
+    switch (order) {
+        case ReadOrder::Auto:
+            return "auto";
+        case ReadOrder::Discovery:
+            return "discovery";
+        case ReadOrder::Inode:
+            return "inode";
+        case ReadOrder::Extent:
+            return "extent";
+    }
+    return "auto";
+}
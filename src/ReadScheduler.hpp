@@ -0,0 +1,117 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef READ_SCHEDULER_HPP
+#define READ_SCHEDULER_HPP
+
+#include "FileEntry.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class WorkerPool;
+
+/**
+ * @brief Order in which the files of a hash tier are read.
+ */
+enum class ReadOrder {
+    Auto,      // Physical order on rotational disks, discovery order otherwise
+    Discovery, // The order in which the walk found the files
+    Inode,     // Ascending inode number, which most file systems allocate close to the data
+    Extent     // Ascending physical offset of the first extent, falling back to Inode where unknown
+};
+
+/**
+ * @brief Sorts read work by where the data lives on disk.
+ * @details On a rotational disk every jump between files costs a seek of several milliseconds, so
+ *          reading a batch in the order of its physical location turns a random access pattern
+ *          into a few sweeps across the platter. The first extent of every file is obtained with
+ *          the Linux FIEMAP ioctl; where that is unsupported the inode number stands in for it.
+ */
+class ReadScheduler {
+public:
+    /**
+     * @param order Requested order; Auto is resolved by looking at the disk holding root.
+     * @param root Directory being scanned.
+     */
+    ReadScheduler(ReadOrder order, const std::string& root);
+
+    /**
+     * @brief The order in effect, never Auto.
+     */
+    ReadOrder order() const { return resolvedOrder; }
+
+    /**
+     * @brief Whether reads are reordered at all.
+     */
+    bool isActive() const { return resolvedOrder != ReadOrder::Discovery; }
+
+    /**
+     * @brief Determines the location of the listed files, which must precede sort().
+     * @param files All discovered files.
+     * @param indices The files that may be read later on.
+     * @details Extents are looked up in inode order, so fetching them seeks as little as possible.
+     *          If the file system does not report extents the scheduler switches to inode order.
+     */
+    void locate(const std::vector<FileEntry>& files, const std::vector<std::size_t>& indices, WorkerPool& pool);
+
+    /**
+     * @brief Positions into members in the order they should be read.
+     * @param members Indices into files of the files about to be read.
+     */
+    std::vector<std::size_t> sort(const std::vector<FileEntry>& files, const std::vector<std::size_t>& members) const;
+
+    /**
+     * @brief Physical offset of the first byte of a file on its device.
+     * @param physicalOffset Receives the offset, zero for files without allocated extents.
+     * @return False if the platform or the file system cannot report extents.
+     * @throws std::runtime_error If the file cannot be opened.
+     */
+    static bool firstExtent(const std::string& path, std::uint64_t& physicalOffset);
+
+    /**
+     * @brief Whether the block device holding path reports itself as rotational.
+     */
+    static bool isRotational(const std::string& path);
+
+    /**
+     * @brief Parses the value of --read-order.
+     * @throws std::invalid_argument If the name is not a known order.
+     */
+    static ReadOrder parseOrder(const std::string& name);
+
+    /**
+     * @brief Name of an order as accepted by parseOrder().
+     */
+    static const char* orderName(ReadOrder order);
+
+private:
+    ReadOrder resolvedOrder;          // Order in effect after resolving Auto and missing extent support
+    std::vector<std::uint64_t> keys;  // Location of every located file, indexed like the discovered files
+};
+
+#endif // READ_SCHEDULER_HPP
@@ -0,0 +1,301 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "ReferenceIndex.hpp"
+#include "Platform.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#if PDCPP_HAS_POSIX_IO
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr char kMagic[8] = {'R', 'M', 'D', 'U', 'P', 'R', 'I', '1'};
+    constexpr std::uint32_t kVersion = 2;
+
+    struct Header {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t recordSize;
+        char algorithm[16];
+        std::uint64_t recordCount;
+        std::uint64_t sampleBlockSize;
+        std::uint64_t pathBytes;      // Bytes of path text following the records, the root first
+        std::uint32_t rootLength;
+        std::uint8_t reserved[4];
+    };
+
+    static_assert(sizeof(Header) == 64, "reference index header layout must stay stable");
+    static_assert(sizeof(ReferenceIndex::Record) == 184, "reference index record layout must stay stable");
+
+    /**
+     * @brief Orders digests by length, then by bytes; a corrupt length never reads past the digest.
+     */
+    int compareDigest(const std::uint8_t* a, std::uint8_t aLength, const std::uint8_t* b, std::uint8_t bLength) {
+        if (aLength != bLength) {
+            return aLength < bLength ? -1 : 1;
+        }
+        return std::memcmp(a, b, std::min<std::size_t>(aLength, Digest::kMaxSize));
+    }
+
+    /**
+     * @brief A lookup key; a null digest ends the comparison before it.
+     */
+    struct Key {
+        std::uint64_t size;
+        const Digest* sample;
+        const Digest* digest;
+    };
+
+    /**
+     * @brief Compares a record to a key, considering only the fields the key sets.
+     */
+    int compareRecord(const ReferenceIndex::Record& record, const Key& key) {
+        if (record.size != key.size) {
+            return record.size < key.size ? -1 : 1;
+        }
+        if (key.sample == nullptr) {
+            return 0;
+        }
+        const int sample = compareDigest(record.sample, record.sampleLength, key.sample->bytes.data(), key.sample->length);
+        if (sample != 0 || key.digest == nullptr) {
+            return sample;
+        }
+        return compareDigest(record.digest, record.digestLength, key.digest->bytes.data(), key.digest->length);
+    }
+
+    const ReferenceIndex::Record* lowerBound(const ReferenceIndex::Record* begin, const ReferenceIndex::Record* end,
+                                             const Key& key) {
+        return std::lower_bound(begin, end, key, [](const ReferenceIndex::Record& record, const Key& k) {
+            return compareRecord(record, k) < 0;
+        });
+    }
+}
+
+ReferenceIndex::ReferenceIndex(const std::string& path) : indexPath(path) {
+#if PDCPP_HAS_POSIX_IO
+    const int fd = ::open(indexPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open reference index " + indexPath + ": " + std::strerror(errno));
+    }
+    struct stat status {};
+    if (::fstat(fd, &status) == 0 && status.st_size > 0) {
+        mappingSize = static_cast<std::size_t>(status.st_size);
+        void* mapped = ::mmap(nullptr, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+        mapping = mapped == MAP_FAILED ? nullptr : mapped;
+    }
+    const int mapError = errno;
+    ::close(fd);
+    if (mapping == nullptr) {
+        mappingSize = 0;
+        throw std::runtime_error("Could not map reference index " + indexPath + ": "
+                                 + (status.st_size > 0 ? std::strerror(mapError) : "empty file"));
+    }
+#else
+    std::ifstream in(indexPath, std::ios::binary | std::ios::ate);
+    if (!in) {
+        throw std::runtime_error("Could not open reference index " + indexPath);
+    }
+    mappingSize = static_cast<std::size_t>(in.tellg());
+    mapping = ::operator new(mappingSize);
+    in.seekg(0);
+    if (!in.read(static_cast<char*>(mapping), static_cast<std::streamsize>(mappingSize))) {
+        unmap();
+        throw std::runtime_error("Could not read reference index " + indexPath);
+    }
+#endif
+
+    Header header{};
+    bool valid = mappingSize >= sizeof(Header);
+    if (valid) {
+        std::memcpy(&header, mapping, sizeof(Header));
+        const std::size_t available = mappingSize - sizeof(Header);
+        valid = std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+                && header.version == kVersion
+                && header.recordSize == sizeof(Record)
+                && header.recordCount <= available / sizeof(Record)
+                && header.pathBytes <= available - header.recordCount * sizeof(Record)
+                && header.rootLength <= header.pathBytes
+                && header.sampleBlockSize > 0;
+    }
+    if (!valid) {
+        unmap();
+        if (mappingSize >= sizeof(Header) && std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0
+                && header.version != kVersion) {
+            throw std::runtime_error("The reference index " + indexPath
+                                     + " was written by another version of rmdup, build it again.");
+        }
+        throw std::runtime_error("Not a valid reference index: " + indexPath);
+    }
+    header.algorithm[sizeof(header.algorithm) - 1] = '\0';
+    algorithmName = header.algorithm;
+    blockSize = static_cast<std::size_t>(header.sampleBlockSize);
+    records = reinterpret_cast<const Record*>(static_cast<const char*>(mapping) + sizeof(Header));
+    recordCount = static_cast<std::size_t>(header.recordCount);
+    paths = reinterpret_cast<const char*>(records + recordCount);
+    pathBytes = static_cast<std::size_t>(header.pathBytes);
+    rootPath.assign(paths, header.rootLength);
+}
+
+ReferenceIndex::~ReferenceIndex() {
+    unmap();
+}
+
+void ReferenceIndex::unmap() {
+    if (mapping != nullptr) {
+#if PDCPP_HAS_POSIX_IO
+        ::munmap(mapping, mappingSize);
+#else
+        ::operator delete(mapping);
+#endif
+    }
+    mapping = nullptr;
+    mappingSize = 0;
+    records = nullptr;
+    recordCount = 0;
+}
+
+std::size_t ReferenceIndex::write(const std::string& path, const std::string& algorithm, std::size_t sampleBlockSize,
+                                   const std::string& root, std::vector<Entry>& entries) {
+    if (algorithm.size() >= sizeof(Header::algorithm)) {
+        throw std::invalid_argument("Digest algorithm name too long for the reference index: " + algorithm);
+    }
+
+    // Equal contents end up next to each other, the smallest path first
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        if (a.file.size != b.file.size) {
+            return a.file.size < b.file.size;
+        }
+        const int sample = compareDigest(a.sample.bytes.data(), a.sample.length, b.sample.bytes.data(), b.sample.length);
+        if (sample != 0) {
+            return sample < 0;
+        }
+        const int digest = compareDigest(a.digest.bytes.data(), a.digest.length, b.digest.bytes.data(), b.digest.length);
+        if (digest != 0) {
+            return digest < 0;
+        }
+        return a.file.path < b.file.path;
+    });
+
+    std::vector<Record> written;
+    written.reserve(entries.size());
+    std::string text = root;
+    for (std::size_t i = 0; i < entries.size(); ++i) {
+        const Entry& entry = entries[i];
+        if (i > 0 && entry.file.size == entries[i - 1].file.size && entry.sample == entries[i - 1].sample
+                && entry.digest == entries[i - 1].digest) {
+            continue;
+        }
+        Record record{};
+        record.size = entry.file.size;
+        record.device = entry.file.device;
+        record.inode = entry.file.inode;
+        record.mtimeNs = entry.file.mtimeNs;
+        record.ctimeNs = entry.file.ctimeNs;
+        record.pathOffset = text.size();
+        record.pathLength = static_cast<std::uint32_t>(entry.file.path.size());
+        record.sampleLength = entry.sample.length;
+        record.digestLength = entry.digest.length;
+        std::memcpy(record.sample, entry.sample.bytes.data(), entry.sample.length);
+        std::memcpy(record.digest, entry.digest.bytes.data(), entry.digest.length);
+        written.push_back(record);
+        text += entry.file.path;
+    }
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.recordSize = sizeof(Record);
+    std::strncpy(header.algorithm, algorithm.c_str(), sizeof(header.algorithm) - 1);
+    header.recordCount = written.size();
+    header.sampleBlockSize = sampleBlockSize;
+    header.pathBytes = text.size();
+    header.rootLength = static_cast<std::uint32_t>(root.size());
+
+    // Write a complete new file next to the old one and swap it in, so readers never see a torn index
+    const std::string tempPath = path + ".tmp";
+    {
+        std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(written.data()),
+                  static_cast<std::streamsize>(written.size() * sizeof(Record)));
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        out.flush();
+        if (!out) {
+            out.close();
+            std::remove(tempPath.c_str());
+            throw std::runtime_error("Could not write reference index: " + tempPath);
+        }
+    }
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        throw std::runtime_error("Could not replace reference index: " + path);
+    }
+    return written.size();
+}
+
+bool ReferenceIndex::hasSize(std::uintmax_t size) const {
+    const Key key{size, nullptr, nullptr};
+    const Record* end = records + recordCount;
+    const Record* found = lowerBound(records, end, key);
+    return found != end && compareRecord(*found, key) == 0;
+}
+
+bool ReferenceIndex::hasSample(std::uintmax_t size, const Digest& sample) const {
+    const Key key{size, &sample, nullptr};
+    const Record* end = records + recordCount;
+    const Record* found = lowerBound(records, end, key);
+    return found != end && compareRecord(*found, key) == 0;
+}
+
+const ReferenceIndex::Record* ReferenceIndex::find(std::uintmax_t size, const Digest& sample, const Digest& digest) const {
+    const Key key{size, &sample, &digest};
+    const Record* end = records + recordCount;
+    const Record* found = lowerBound(records, end, key);
+    return found != end && compareRecord(*found, key) == 0 ? found : nullptr;
+}
+
+std::string ReferenceIndex::path(const Record& record) const {
+    if (record.pathOffset > pathBytes || record.pathLength > pathBytes - record.pathOffset) {
+        throw std::runtime_error("Corrupt path in reference index: " + indexPath);
+    }
+    return std::string(paths + record.pathOffset, record.pathLength);
+}
+
+bool ReferenceIndex::covers(const std::string& path) const {
+    if (path.compare(0, rootPath.size(), rootPath) != 0) {
+        return false;
+    }
+    return path.size() == rootPath.size() || rootPath.empty() || rootPath.back() == '/' || path[rootPath.size()] == '/';
+}
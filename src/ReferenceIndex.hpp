@@ -0,0 +1,146 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef REFERENCE_INDEX_HPP
+#define REFERENCE_INDEX_HPP
+
+#include "Digest.hpp"
+#include "FileEntry.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Persistent digest index of a reference tree that other directories are checked against.
+ * @details Built once from every file of the reference tree, the index holds the size, the head/tail
+ *          sample digest and the full digest of each distinct content, together with the path, the
+ *          device, the inode and the modification and status change times of the file it was
+ *          taken from. The file on disk is a
+ *          fixed-size header, fixed-size records sorted by (size, sample, digest) and the path texts:
+ *          it is memory-mapped and searched in place, so checking a target costs no reads of the
+ *          reference tree.
+ */
+class ReferenceIndex {
+public:
+    /**
+     * @brief A reference file to be written to an index.
+     */
+    struct Entry {
+        FileEntry file;  // The file, with the metadata gathered during the walk
+        Digest sample;   // Digest of the head and tail sample, the full digest of small files
+        Digest digest;   // Digest of the whole file
+    };
+
+    /**
+     * @brief On-disk layout of an indexed file, exposed for tests and tooling.
+     */
+    struct Record {
+        std::uint64_t size;
+        std::uint64_t device;
+        std::uint64_t inode;
+        std::int64_t mtimeNs;
+        std::int64_t ctimeNs;
+        std::uint64_t pathOffset;     // Offset of the path in the path texts following the records
+        std::uint32_t pathLength;
+        std::uint8_t sampleLength;
+        std::uint8_t digestLength;
+        std::uint8_t reserved[2];
+        std::uint8_t sample[Digest::kMaxSize];
+        std::uint8_t digest[Digest::kMaxSize];
+    };
+
+    /**
+     * @brief Opens and maps an index.
+     * @throws std::runtime_error If the index cannot be read or is not a valid index.
+     */
+    explicit ReferenceIndex(const std::string& path);
+    ~ReferenceIndex();
+
+    ReferenceIndex(const ReferenceIndex&) = delete;
+    ReferenceIndex& operator=(const ReferenceIndex&) = delete;
+
+    /**
+     * @brief Writes an index, atomically replacing any file at path.
+     * @param path Location of the index file.
+     * @param algorithm Name of the digest algorithm the digests were computed with.
+     * @param sampleBlockSize Bytes sampled from the head and the tail of a file by the sample digests.
+     * @param root Canonical path of the reference tree; every entry lies below it.
+     * @param entries The files of the reference tree. Of files with equal content only the one with
+     *                the smallest path is kept.
+     * @return The number of distinct contents written.
+     * @throws std::runtime_error If the index cannot be written.
+     */
+    static std::size_t write(const std::string& path, const std::string& algorithm, std::size_t sampleBlockSize,
+                      const std::string& root, std::vector<Entry>& entries);
+
+    /**
+     * @brief Whether any indexed file has the given size.
+     */
+    bool hasSize(std::uintmax_t size) const;
+
+    /**
+     * @brief Whether any indexed file has the given size and sample digest.
+     */
+    bool hasSample(std::uintmax_t size, const Digest& sample) const;
+
+    /**
+     * @brief Looks up the indexed file with the given content.
+     * @return The record of the file, nullptr if no indexed file has that content.
+     */
+    const Record* find(std::uintmax_t size, const Digest& sample, const Digest& digest) const;
+
+    /**
+     * @brief Full path of an indexed file.
+     */
+    std::string path(const Record& record) const;
+
+    /**
+     * @brief Whether a canonical path is the reference tree or lies inside it.
+     */
+    bool covers(const std::string& path) const;
+
+    const std::string& algorithm() const { return algorithmName; }
+    const std::string& root() const { return rootPath; }
+    std::size_t sampleBlockSize() const { return blockSize; }
+    std::size_t size() const { return recordCount; }
+
+private:
+    std::string indexPath;
+    std::string algorithmName;
+    std::string rootPath;
+    std::size_t blockSize = 0;
+    void* mapping = nullptr;        // Mapped index file, or heap copy where mmap is unavailable
+    std::size_t mappingSize = 0;
+    const Record* records = nullptr;
+    std::size_t recordCount = 0;
+    const char* paths = nullptr;
+    std::size_t pathBytes = 0;
+
+    void unmap();
+};
+
+#endif // REFERENCE_INDEX_HPP
@@ -0,0 +1,283 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "ReportWriter.hpp"
+#include <charconv>
+#include <stdexcept>
+
+namespace {
+    constexpr char kBinaryMagic[] = "RMDUPRP1";
+
+    enum RecordType : std::uint8_t {
+        kScanRecord = 1,
+        kGroupRecord = 2,
+        kActionRecord = 3,
+        kSummaryRecord = 4
+    };
+
+    std::uint8_t actionCode(DuplicateAction action) {
+        switch (action) {
+            case DuplicateAction::Delete:
+                return 0;
+            case DuplicateAction::Reflink:
+                return 1;
+            case DuplicateAction::Hardlink:
+                return 2;
+        }
+        return 0;
+    }
+}
+
+ReportWriter::ReportWriter(ReportFormat format, std::ostream& out)
+        : format(format), out(out) {
+    if (format == ReportFormat::Binary) {
+        buffer.append(kBinaryMagic, sizeof(kBinaryMagic) - 1);
+    }
+}
+
+ReportWriter::~ReportWriter() {
+    try {
+        flush();
+    } catch (...) {
+        // A destructor cannot report a failing stream
+    }
+}
+
+void ReportWriter::scan(const std::string& root, const std::string& algorithm) {
+    if (format == ReportFormat::Ndjson) {
+        buffer += "{\"type\":\"scan\",\"root\":";
+        appendJsonString(root);
+        buffer += ",\"algorithm\":";
+        appendJsonString(algorithm);
+        buffer += "}\n";
+    } else if (format == ReportFormat::Binary) {
+        beginRecord(kScanRecord);
+        appendBinaryString(root);
+        appendBinaryString(algorithm);
+        endRecord();
+    }
+    spill();
+}
+
+void ReportWriter::group(const Digest* digest, std::uintmax_t size, const std::string& kept,
+                         const std::vector<const std::string*>& duplicates) {
+    if (format == ReportFormat::Ndjson) {
+        buffer += "{\"type\":\"group\",\"size\":";
+        appendDecimal(size);
+        buffer += ",\"digest\":";
+        if (digest != nullptr) {
+            static const char hexDigits[] = "0123456789abcdef";
+            char hex[2 * Digest::kMaxSize + 2];
+            hex[0] = '"';
+            for (std::size_t i = 0; i < digest->length; ++i) {
+                hex[1 + 2 * i] = hexDigits[digest->bytes[i] >> 4];
+                hex[2 + 2 * i] = hexDigits[digest->bytes[i] & 0x0F];
+            }
+            hex[1 + 2 * digest->length] = '"';
+            buffer.append(hex, 2 + 2 * static_cast<std::size_t>(digest->length));
+        } else {
+            buffer += "null";
+        }
+        buffer += ",\"kept\":";
+        appendJsonString(kept);
+        buffer += ",\"duplicates\":[";
+        for (std::size_t i = 0; i < duplicates.size(); ++i) {
+            if (i > 0) {
+                buffer += ',';
+            }
+            appendJsonString(*duplicates[i]);
+        }
+        buffer += "]}\n";
+    } else if (format == ReportFormat::Binary) {
+        beginRecord(kGroupRecord);
+        appendU64(size);
+        appendU8(digest != nullptr ? digest->length : 0);
+        if (digest != nullptr) {
+            buffer.append(reinterpret_cast<const char*>(digest->bytes.data()), digest->length);
+        }
+        appendU32(static_cast<std::uint32_t>(duplicates.size() + 1));
+        appendBinaryString(kept);
+        for (const std::string* duplicate : duplicates) {
+            appendBinaryString(*duplicate);
+        }
+        endRecord();
+    }
+    spill();
+}
+
+void ReportWriter::action(DuplicateAction action, const std::string& path, std::uint64_t bytesShared,
+                          const std::string& error) {
+    if (format == ReportFormat::Ndjson) {
+        buffer += "{\"type\":\"action\",\"action\":\"";
+        buffer += Deduplicator::actionName(action);
+        buffer += "\",\"path\":";
+        appendJsonString(path);
+        buffer += error.empty() ? ",\"status\":\"ok\"" : ",\"status\":\"error\",\"error\":";
+        if (!error.empty()) {
+            appendJsonString(error);
+        }
+        if (action == DuplicateAction::Reflink) {
+            buffer += ",\"bytes\":";
+            appendDecimal(bytesShared);
+        }
+        buffer += "}\n";
+    } else if (format == ReportFormat::Binary) {
+        beginRecord(kActionRecord);
+        appendU8(actionCode(action));
+        appendU8(error.empty() ? 0 : 1);
+        appendU64(bytesShared);
+        appendBinaryString(path);
+        appendBinaryString(error);
+        endRecord();
+    }
+    spill();
+}
+
+void ReportWriter::summary(std::size_t files, std::size_t uniqueFiles, std::size_t duplicateFiles, std::size_t groups,
+                           bool liveRun) {
+    if (format == ReportFormat::Ndjson) {
+        buffer += "{\"type\":\"summary\",\"files\":" + std::to_string(files)
+                  + ",\"unique\":" + std::to_string(uniqueFiles)
+                  + ",\"duplicates\":" + std::to_string(duplicateFiles)
+                  + ",\"groups\":" + std::to_string(groups)
+                  + ",\"live\":" + (liveRun ? "true" : "false") + "}\n";
+    } else if (format == ReportFormat::Binary) {
+        beginRecord(kSummaryRecord);
+        appendU64(files);
+        appendU64(uniqueFiles);
+        appendU64(duplicateFiles);
+        appendU64(groups);
+        appendU8(liveRun ? 1 : 0);
+        endRecord();
+    }
+    // A scan is complete with its summary, and the next directory of a shared report may take a while
+    flush();
+}
+
+void ReportWriter::flush() {
+    if (!buffer.empty()) {
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+    out.flush();
+}
+
+ReportFormat ReportWriter::parseFormat(const std::string& name) {
+    for (ReportFormat format : {ReportFormat::Text, ReportFormat::Ndjson, ReportFormat::Binary}) {
+        if (name == formatName(format)) {
+            return format;
+        }
+    }
+    throw std::invalid_argument("'" + name + "' is not a known report format (text, ndjson, binary).");
+}
+
+const char* ReportWriter::formatName(ReportFormat format) {
+    switch (format) {
+        case ReportFormat::Text:
+            return "text";
+        case ReportFormat::Ndjson:
+            return "ndjson";
+        case ReportFormat::Binary:
+            return "binary";
+    }
+    return "text";
+}
+
+void ReportWriter::beginRecord(std::uint8_t type) {
+    appendU8(type);
+    recordStart = buffer.size();
+    appendU32(0);
+}
+
+void ReportWriter::endRecord() {
+    // Patch the payload length reserved by beginRecord()
+    const auto length = static_cast<std::uint32_t>(buffer.size() - recordStart - sizeof(std::uint32_t));
+    for (std::size_t i = 0; i < sizeof(length); ++i) {
+        buffer[recordStart + i] = static_cast<char>((length >> (8 * i)) & 0xFF);
+    }
+}
+
+void ReportWriter::appendDecimal(std::uint64_t value) {
+    char digits[24];
+    const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    buffer.append(digits, result.ptr);
+}
+
+void ReportWriter::appendJsonString(const std::string& value) {
+    static const char hexDigits[] = "0123456789abcdef";
+    buffer += '"';
+    // Paths rarely need escaping, so runs of plain characters are copied in one go
+    std::size_t plain = 0;
+    for (std::size_t i = 0; i < value.size(); ++i) {
+        const char c = value[i];
+        if (c != '"' && c != '\\' && static_cast<unsigned char>(c) >= 0x20) {
+            continue;
+        }
+        buffer.append(value, plain, i - plain);
+        plain = i + 1;
+        switch (c) {
+            case '"': buffer += "\\\""; break;
+            case '\\': buffer += "\\\\"; break;
+            case '\n': buffer += "\\n"; break;
+            case '\r': buffer += "\\r"; break;
+            case '\t': buffer += "\\t"; break;
+            default:
+                buffer += "\\u00";
+                buffer += hexDigits[(c >> 4) & 0x0F];
+                buffer += hexDigits[c & 0x0F];
+        }
+    }
+    buffer.append(value, plain, value.size() - plain);
+    buffer += '"';
+}
+
+void ReportWriter::appendU8(std::uint8_t value) {
+    buffer += static_cast<char>(value);
+}
+
+void ReportWriter::appendU32(std::uint32_t value) {
+    for (std::size_t i = 0; i < sizeof(value); ++i) {
+        buffer += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+void ReportWriter::appendU64(std::uint64_t value) {
+    for (std::size_t i = 0; i < sizeof(value); ++i) {
+        buffer += static_cast<char>((value >> (8 * i)) & 0xFF);
+    }
+}
+
+void ReportWriter::appendBinaryString(const std::string& value) {
+    appendU32(static_cast<std::uint32_t>(value.size()));
+    buffer += value;
+}
+
+void ReportWriter::spill() {
+    if (buffer.size() >= kBufferSize) {
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    }
+}
@@ -0,0 +1,152 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef REPORT_WRITER_HPP
+#define REPORT_WRITER_HPP
+
+#include "Deduplicator.hpp"
+#include "Digest.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Layout of the report written to standard output.
+ */
+enum class ReportFormat {
+    Text,   // The human readable messages, no records
+    Ndjson, // One JSON object per line
+    Binary  // Length-prefixed little-endian records
+};
+
+/**
+ * @brief Streams machine-readable records of a scan through a large buffer.
+ * @details Every duplicate group is written as soon as it is confirmed, so a consumer can process
+ *          the report while the scan is still running. Records accumulate in a buffer of
+ *          kBufferSize bytes and reach the stream in large writes instead of one flush per line.
+ *
+ *          NDJSON records are objects with a "type" of "scan", "group", "action" or "summary". Paths
+ *          are emitted byte for byte; names that are not valid UTF-8 are therefore not valid JSON
+ *          strings, the binary format is lossless.
+ *
+ *          The binary report starts with the 8 bytes "RMDUPRP1". Every record follows as a one-byte
+ *          type, a u32 payload length and the payload, integers in little-endian and strings as a
+ *          u32 length followed by the bytes:
+ *            1 scan:    string root, string algorithm
+ *            2 group:   u64 size, u8 digest length, digest, u32 path count, strings (kept path first)
+ *            3 action:  u8 action (0 delete, 1 reflink, 2 hardlink), u8 status (0 ok, 1 error),
+ *                       u64 bytes shared, string path, string error
+ *            4 summary: u64 files, u64 unique files, u64 duplicate files, u64 groups, u8 live run
+ *          The length lets a reader skip record types it does not know.
+ *
+ *          A report covering several directories holds one sequence of scan, group, action and
+ *          summary records per directory, after a single magic.
+ */
+class ReportWriter {
+public:
+    static constexpr std::size_t kBufferSize = 1 << 20;
+
+    /**
+     * @param format Layout of the records; the text format writes nothing.
+     * @param out Stream receiving the records.
+     */
+    ReportWriter(ReportFormat format, std::ostream& out);
+
+    /**
+     * @brief Writes whatever is still buffered.
+     */
+    ~ReportWriter();
+
+    ReportWriter(const ReportWriter&) = delete;
+    ReportWriter& operator=(const ReportWriter&) = delete;
+
+    /**
+     * @brief Whether records are written, in which case human readable messages belong on stderr.
+     */
+    bool isMachineReadable() const { return format != ReportFormat::Text; }
+
+    /**
+     * @brief Opens the report with the scanned directory and the digest algorithm.
+     */
+    void scan(const std::string& root, const std::string& algorithm);
+
+    /**
+     * @brief Records a confirmed set of identical files.
+     * @param digest Full digest of the content, nullptr if the group was confirmed by comparing bytes.
+     * @param kept The path that is kept.
+     * @param duplicates Every path the action applies to, hardlinks of duplicates included.
+     */
+    void group(const Digest* digest, std::uintmax_t size, const std::string& kept,
+               const std::vector<const std::string*>& duplicates);
+
+    /**
+     * @brief Records the outcome of the action on one path.
+     * @param bytesShared Bytes now shared with the original, only reported for DuplicateAction::Reflink.
+     * @param error Why the action failed, empty on success.
+     */
+    void action(DuplicateAction action, const std::string& path, std::uint64_t bytesShared, const std::string& error);
+
+    /**
+     * @brief Closes the records of a scan with its totals and flushes them to the stream.
+     */
+    void summary(std::size_t files, std::size_t uniqueFiles, std::size_t duplicateFiles, std::size_t groups, bool liveRun);
+
+    /**
+     * @brief Hands the buffered records to the stream and flushes it.
+     */
+    void flush();
+
+    /**
+     * @brief Parses the value of --format.
+     * @throws std::invalid_argument If the name is not a known format.
+     */
+    static ReportFormat parseFormat(const std::string& name);
+
+    /**
+     * @brief Name of a format as accepted by parseFormat().
+     */
+    static const char* formatName(ReportFormat format);
+
+private:
+    ReportFormat format;
+    std::ostream& out;
+    std::string buffer;        // Records not yet handed to the stream
+    std::size_t recordStart = 0; // Offset of the binary record being built
+
+    void beginRecord(std::uint8_t type);
+    void endRecord();
+    void appendDecimal(std::uint64_t value);
+    void appendJsonString(const std::string& value);
+    void appendU8(std::uint8_t value);
+    void appendU32(std::uint32_t value);
+    void appendU64(std::uint64_t value);
+    void appendBinaryString(const std::string& value);
+    void spill();
+};
+
+#endif // REPORT_WRITER_HPP
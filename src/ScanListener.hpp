@@ -0,0 +1,57 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef SCAN_LISTENER_HPP
+#define SCAN_LISTENER_HPP
+
+#include "Deduplicator.hpp"
+#include "Digest.hpp"
+#include <functional>
+#include <string>
+
+/**
+ * @brief Callbacks through which an embedding program receives the results of a scan as they come.
+ * @details The callbacks are never invoked concurrently and either may be left empty. Sets arrive on
+ *          the thread running PurgeDuplicates::execute(), errors of the directory walk may arrive on
+ *          a worker thread. A scan given a listener writes nothing to stdout or stderr apart from a
+ *          machine-readable report, if one was asked for.
+ */
+struct ScanListener {
+    /**
+     * @brief Receives every duplicate set as soon as it is confirmed, before any action is taken on it.
+     * @details The digest is the full digest shared by the set, or null where the files were only
+     *          compared byte by byte. A set larger than the memory limit may arrive in several pieces
+     *          with the same original.
+     */
+    std::function<void(const DuplicateSet& set, const Digest* digest)> onGroup;
+
+    /**
+     * @brief Receives every file or directory that could not be processed; the scan goes on without it.
+     */
+    std::function<void(const std::string& path, const std::string& message)> onError;
+};
+
+#endif // SCAN_LISTENER_HPP
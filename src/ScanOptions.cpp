@@ -0,0 +1,61 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "ScanOptions.hpp"
+#include <limits>
+#include <stdexcept>
+
+std::size_t ScanOptions::parseByteSize(const std::string& value) {
+    // std::stoull skips blanks and accepts a sign, wrapping "-1" around to the largest value
+    if (value.empty() || value[0] < '0' || value[0] > '9') {
+        throw std::invalid_argument("'" + value + "' is not a valid size.");
+    }
+    std::size_t consumed = 0;
+    unsigned long long amount = 0;
+    try {
+        amount = std::stoull(value, &consumed);
+    } catch (const std::out_of_range&) {
+        throw std::invalid_argument("'" + value + "' is too large a size.");
+    } catch (const std::exception&) {
+        throw std::invalid_argument("'" + value + "' is not a valid size.");
+    }
+
+    const std::string suffix = value.substr(consumed);
+    unsigned int shift = 0;
+    if (suffix == "K" || suffix == "k") {
+        shift = 10;
+    } else if (suffix == "M" || suffix == "m") {
+        shift = 20;
+    } else if (suffix == "G" || suffix == "g") {
+        shift = 30;
+    } else if (!suffix.empty()) {
+        throw std::invalid_argument("'" + value + "' is not a valid size.");
+    }
+    if (amount > (std::numeric_limits<std::size_t>::max() >> shift)) {
+        throw std::invalid_argument("'" + value + "' is too large a size.");
+    }
+    return static_cast<std::size_t>(amount << shift);
+}
@@ -0,0 +1,72 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ */
+#ifndef SCAN_OPTIONS_HPP
+#define SCAN_OPTIONS_HPP
+
+#include "ContentComparer.hpp"
+#include "Deduplicator.hpp"
+#include "FileReader.hpp"
+#include "ReadScheduler.hpp"
+#include "ReportWriter.hpp"
+#include "UringReader.hpp"
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Settings controlling how a directory is scanned for duplicates.
+ */
+struct ScanOptions {
+    bool showProgress = false;          // Flag to indicate if a progress bar is displayed
+    bool liveRun = false;               // Apply the action to duplicates instead of a dry run
+    std::size_t sampleBlockSize = 4096; // Bytes sampled from the head and the tail of a file by the partial hash
+    unsigned int jobs = 0;              // Number of directories read and files hashed concurrently, zero selects the hardware concurrency
+    ReadBackend readBackend = ReadBackend::Auto;                 // System interface used to read file contents
+    std::size_t readBufferSize = FileReader::kDefaultBufferSize; // Bytes requested per read call
+    IoEngine ioEngine = IoEngine::Sync;                          // How batches of files are read while hashing
+    std::string cachePath;              // File persisting full digests between runs, empty disables the cache
+    bool cachePrune = false;            // Drop cache records of files not seen during this run
+    std::string hashAlgorithm;          // Name of the digest algorithm, empty selects the platform default
+    ReadOrder readOrder = ReadOrder::Auto; // Order in which the files of a hash tier are read
+    bool oneFileSystem = false;         // Skip directories mounted from a different device than the scanned directory
+    CompareMode compareMode = CompareMode::Auto; // How candidates surviving the partial hash are confirmed
+    DuplicateAction action = DuplicateAction::Delete; // What a live run does with the duplicates it found
+    ReportFormat reportFormat = ReportFormat::Text;   // Layout of the report on stdout
+    std::size_t maxMemory = 0;          // Bytes of file lists kept in memory before they spill to disk, zero never spills
+    std::string buildReference;         // Write a digest index of the directory to this file instead of looking for duplicates
+    std::string referenceIndex;         // Index of a reference tree the directory is checked against, empty looks within the directory
+    bool printStats = false;            // Print time per phase, I/O counters and latencies after the summary
+    std::string statsPath;              // Append the statistics of every scan to this file as one JSON line, empty writes none
+
+    /**
+     * @brief Parses a byte count with an optional K, M or G (binary) suffix.
+     * @param value The text to parse, e.g. "4096" or "64K".
+     * @return The number of bytes.
+     * @throws std::invalid_argument If the value is not a plain unsigned number, or does not fit in a std::size_t.
+     */
+    static std::size_t parseByteSize(const std::string& value);
+};
+
+#endif // SCAN_OPTIONS_HPP
@@ -0,0 +1,402 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "ScanStats.hpp"
+#include "Platform.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+#if PDCPP_HAS_POSIX_IO
+#include <sys/resource.h>
+#endif
+
+namespace {
+    constexpr std::size_t kCounters = static_cast<std::size_t>(StatCounter::Count);
+    constexpr std::size_t kErrorKinds = static_cast<std::size_t>(ScanErrorKind::Count);
+    constexpr std::size_t kLatencies = static_cast<std::size_t>(StatLatency::Count);
+    constexpr std::size_t kPhases = static_cast<std::size_t>(ScanPhase::Count);
+
+    // Counters of one thread. Only the owning thread writes them, so an increment is a relaxed load
+    // and store rather than a locked read-modify-write; the atomics only keep snapshots race-free.
+    struct ThreadBlock {
+        std::array<std::atomic<std::uint64_t>, kCounters> counters{};
+        std::array<std::atomic<std::uint64_t>, kErrorKinds> errors{};
+        std::array<std::array<std::atomic<std::uint64_t>, ScanStats::kLatencyBuckets>, kLatencies> latencies{};
+    };
+
+    void bump(std::atomic<std::uint64_t>& value, std::uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    void addTo(ScanStats::Totals& totals, const ThreadBlock& block) {
+        for (std::size_t i = 0; i < kCounters; ++i) {
+            totals.counters[i] += block.counters[i].load(std::memory_order_relaxed);
+        }
+        for (std::size_t i = 0; i < kErrorKinds; ++i) {
+            totals.errors[i] += block.errors[i].load(std::memory_order_relaxed);
+        }
+        for (std::size_t i = 0; i < kLatencies; ++i) {
+            for (std::size_t bucket = 0; bucket < ScanStats::kLatencyBuckets; ++bucket) {
+                totals.latencies[i][bucket] += block.latencies[i][bucket].load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    struct Registry {
+        std::mutex mutex;
+        std::vector<const ThreadBlock*> blocks;
+        ScanStats::Totals retired;     // Counters of threads that have exited
+    };
+
+    // Never destroyed, so threads exiting during static destruction can still retire their counters
+    Registry& registry() {
+        static Registry* instance = new Registry();
+        return *instance;
+    }
+
+    struct ThreadSlot {
+        ThreadBlock block;
+
+        ThreadSlot() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.blocks.push_back(&block);
+        }
+
+        ~ThreadSlot() {
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            addTo(r.retired, block);
+            r.blocks.erase(std::find(r.blocks.begin(), r.blocks.end(), &block));
+        }
+    };
+
+    ThreadBlock& localBlock() {
+        thread_local ThreadSlot slot;
+        return slot.block;
+    }
+
+    std::size_t latencyBucket(std::chrono::steady_clock::duration elapsed) {
+        const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        std::size_t bucket = 0;
+        for (auto bound = static_cast<std::uint64_t>(std::max<decltype(micros)>(micros, 0)); bound > 0; bound >>= 1) {
+            ++bucket;
+        }
+        return std::min(bucket, ScanStats::kLatencyBuckets - 1);
+    }
+
+    std::uint64_t bucketBound(std::size_t bucket) {
+        return std::uint64_t(1) << bucket;
+    }
+
+    std::string formatSeconds(double value) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.6f", value);
+        return text;
+    }
+}
+
+void ScanStats::count(StatCounter counter, std::uint64_t amount) {
+    bump(localBlock().counters[static_cast<std::size_t>(counter)], amount);
+}
+
+void ScanStats::countError(ScanErrorKind kind) {
+    bump(localBlock().errors[static_cast<std::size_t>(kind)], 1);
+}
+
+void ScanStats::recordLatency(StatLatency latency, std::chrono::steady_clock::duration elapsed) {
+    bump(localBlock().latencies[static_cast<std::size_t>(latency)][latencyBucket(elapsed)], 1);
+}
+
+ScanStats::Totals ScanStats::snapshot() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    Totals totals = r.retired;
+    for (const ThreadBlock* block : r.blocks) {
+        addTo(totals, *block);
+    }
+    return totals;
+}
+
+void ScanStats::start() {
+    phases.fill(Clock::duration::zero());
+    current = ScanPhase::Other;
+    startTime = Clock::now();
+    phaseStart = startTime;
+    wall = Clock::duration::zero();
+    totals = Totals();
+    peakRss = 0;
+    begin = snapshot();
+}
+
+void ScanStats::finish() {
+    enterPhase(ScanPhase::Other);
+    wall = Clock::now() - startTime;
+
+    const Totals end = snapshot();
+    for (std::size_t i = 0; i < kCounters; ++i) {
+        totals.counters[i] = end.counters[i] - begin.counters[i];
+    }
+    for (std::size_t i = 0; i < kErrorKinds; ++i) {
+        totals.errors[i] = end.errors[i] - begin.errors[i];
+    }
+    for (std::size_t i = 0; i < kLatencies; ++i) {
+        for (std::size_t bucket = 0; bucket < kLatencyBuckets; ++bucket) {
+            totals.latencies[i][bucket] = end.latencies[i][bucket] - begin.latencies[i][bucket];
+        }
+    }
+
+#if PDCPP_HAS_POSIX_IO
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        peakRss = static_cast<std::uint64_t>(usage.ru_maxrss);
+#else
+        peakRss = static_cast<std::uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+}
+
+ScanPhase ScanStats::enterPhase(ScanPhase phase) {
+    const Clock::time_point now = Clock::now();
+    phases[static_cast<std::size_t>(current)] += now - phaseStart;
+    phaseStart = now;
+    const ScanPhase previous = current;
+    current = phase;
+    return previous;
+}
+
+double ScanStats::seconds(Clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+double ScanStats::phaseSeconds(ScanPhase phase) const {
+    return seconds(phases[static_cast<std::size_t>(phase)]);
+}
+
+std::uint64_t ScanStats::errorCount() const {
+    std::uint64_t total = 0;
+    for (std::uint64_t value : totals.errors) {
+        total += value;
+    }
+    return total;
+}
+
+std::uint64_t ScanStats::syscallCount() const {
+    std::uint64_t total = 0;
+    for (StatCounter counter : {StatCounter::FilesOpened, StatCounter::ReadCalls, StatCounter::MapCalls,
+                                StatCounter::StatCalls, StatCounter::DirectoryOpens, StatCounter::DirectoryReads,
+                                StatCounter::LocateCalls, StatCounter::UringEnters, StatCounter::ActionCalls}) {
+        total += this->counter(counter);
+    }
+    return total;
+}
+
+std::uint64_t ScanStats::latencyCount(StatLatency latency) const {
+    std::uint64_t total = 0;
+    for (std::uint64_t value : totals.latencies[static_cast<std::size_t>(latency)]) {
+        total += value;
+    }
+    return total;
+}
+
+std::uint64_t ScanStats::latencyPercentile(StatLatency latency, double fraction) const {
+    const std::uint64_t total = latencyCount(latency);
+    if (total == 0) {
+        return 0;
+    }
+    const auto& buckets = totals.latencies[static_cast<std::size_t>(latency)];
+    const auto rank = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(fraction * static_cast<double>(total) + 0.999999));
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < kLatencyBuckets; ++bucket) {
+        seen += buckets[bucket];
+        if (seen >= rank) {
+            return bucketBound(bucket);
+        }
+    }
+    return bucketBound(kLatencyBuckets - 1);
+}
+
+void ScanStats::print(std::ostream& out) const {
+    out << "Scan statistics:\n";
+    out << "  Wall time:             " << formatSeconds(wallSeconds()) << " s\n";
+    for (std::size_t i = 0; i < kPhases; ++i) {
+        const auto phase = static_cast<ScanPhase>(i);
+        out << "    " << std::left << std::setw(20) << phaseName(phase) << formatSeconds(phaseSeconds(phase)) << " s\n";
+    }
+    out << "  Syscalls:              " << syscallCount() << "\n";
+    for (std::size_t i = 0; i < kCounters; ++i) {
+        const auto counter = static_cast<StatCounter>(i);
+        out << "    " << std::left << std::setw(20) << counterName(counter) << this->counter(counter) << "\n";
+    }
+    out << "  Errors:                " << errorCount() << "\n";
+    for (std::size_t i = 0; i < kErrorKinds; ++i) {
+        const auto kind = static_cast<ScanErrorKind>(i);
+        if (errors(kind) > 0) {
+            out << "    " << std::left << std::setw(20) << errorKindName(kind) << errors(kind) << "\n";
+        }
+    }
+    for (std::size_t i = 0; i < kLatencies; ++i) {
+        const auto latency = static_cast<StatLatency>(i);
+        out << "  " << std::left << std::setw(22) << (std::string(latencyName(latency)) + " latency:")
+            << latencyCount(latency) << " files";
+        if (latencyCount(latency) > 0) {
+            out << ", p50 < " << latencyPercentile(latency, 0.5) << " us, p90 < " << latencyPercentile(latency, 0.9)
+                << " us, p99 < " << latencyPercentile(latency, 0.99) << " us, max < "
+                << latencyPercentile(latency, 1.0) << " us";
+        }
+        out << "\n";
+    }
+    out << "  Peak resident memory:  " << peakRss << " bytes\n";
+    out << std::right;
+}
+
+std::string ScanStats::toJson() const {
+    std::string json = "{\"type\":\"stats\",\"wall_seconds\":" + formatSeconds(wallSeconds()) + ",\"phases\":{";
+    for (std::size_t i = 0; i < kPhases; ++i) {
+        const auto phase = static_cast<ScanPhase>(i);
+        json += std::string(i == 0 ? "" : ",") + "\"" + phaseName(phase) + "\":" + formatSeconds(phaseSeconds(phase));
+    }
+    json += "},\"counters\":{";
+    for (std::size_t i = 0; i < kCounters; ++i) {
+        const auto counter = static_cast<StatCounter>(i);
+        json += std::string(i == 0 ? "" : ",") + "\"" + counterName(counter) + "\":" + std::to_string(this->counter(counter));
+    }
+    json += ",\"syscalls\":" + std::to_string(syscallCount()) + "},\"errors\":{";
+    for (std::size_t i = 0; i < kErrorKinds; ++i) {
+        const auto kind = static_cast<ScanErrorKind>(i);
+        json += std::string(i == 0 ? "" : ",") + "\"" + errorKindName(kind) + "\":" + std::to_string(errors(kind));
+    }
+    json += ",\"total\":" + std::to_string(errorCount()) + "},\"latency_us\":{";
+    for (std::size_t i = 0; i < kLatencies; ++i) {
+        const auto latency = static_cast<StatLatency>(i);
+        json += std::string(i == 0 ? "" : ",") + "\"" + latencyName(latency) + "\":{\"count\":"
+                + std::to_string(latencyCount(latency))
+                + ",\"p50\":" + std::to_string(latencyPercentile(latency, 0.5))
+                + ",\"p90\":" + std::to_string(latencyPercentile(latency, 0.9))
+                + ",\"p99\":" + std::to_string(latencyPercentile(latency, 0.99))
+                + ",\"max\":" + std::to_string(latencyPercentile(latency, 1.0)) + ",\"buckets\":[";
+        const auto& buckets = totals.latencies[i];
+        for (std::size_t bucket = 0; bucket < kLatencyBuckets; ++bucket) {
+            json += std::string(bucket == 0 ? "" : ",") + std::to_string(buckets[bucket]);
+        }
+        json += "]}";
+    }
+    json += "},\"peak_rss_bytes\":" + std::to_string(peakRss) + "}";
+    return json;
+}
+
+const char* ScanStats::phaseName(ScanPhase phase) {
+    switch (phase) {
+        case ScanPhase::Traversal:
+            return "traversal";
+        case ScanPhase::SizeGrouping:
+            return "size_grouping";
+        case ScanPhase::PartialHash:
+            return "partial_hash";
+        case ScanPhase::FullHash:
+            return "full_hash";
+        case ScanPhase::Compare:
+            return "compare";
+        case ScanPhase::Action:
+            return "action";
+        case ScanPhase::Other:
+        case ScanPhase::Count:
+            break;
+    }
+    return "other";
+}
+
+const char* ScanStats::counterName(StatCounter counter) {
+    switch (counter) {
+        case StatCounter::FilesOpened:
+            return "files_opened";
+        case StatCounter::BytesRead:
+            return "bytes_read";
+        case StatCounter::ReadCalls:
+            return "read_calls";
+        case StatCounter::MapCalls:
+            return "map_calls";
+        case StatCounter::StatCalls:
+            return "stat_calls";
+        case StatCounter::DirectoryOpens:
+            return "directory_opens";
+        case StatCounter::DirectoryReads:
+            return "directory_reads";
+        case StatCounter::LocateCalls:
+            return "locate_calls";
+        case StatCounter::UringEnters:
+            return "uring_enters";
+        case StatCounter::ActionCalls:
+            return "action_calls";
+        case StatCounter::CacheHits:
+            return "cache_hits";
+        case StatCounter::CacheMisses:
+            return "cache_misses";
+        case StatCounter::Count:
+            break;
+    }
+    return "unknown";
+}
+
+const char* ScanStats::errorKindName(ScanErrorKind kind) {
+    switch (kind) {
+        case ScanErrorKind::Walk:
+            return "walk";
+        case ScanErrorKind::Read:
+            return "read";
+        case ScanErrorKind::Delete:
+            return "delete";
+        case ScanErrorKind::Hardlink:
+            return "hardlink";
+        case ScanErrorKind::Reflink:
+            return "reflink";
+        case ScanErrorKind::Cache:
+            return "cache";
+        case ScanErrorKind::Reference:
+            return "reference";
+        case ScanErrorKind::Count:
+            break;
+    }
+    return "unknown";
+}
+
+const char* ScanStats::latencyName(StatLatency latency) {
+    switch (latency) {
+        case StatLatency::PartialHash:
+            return "partial_hash";
+        case StatLatency::FullHash:
+            return "full_hash";
+        case StatLatency::Count:
+            break;
+    }
+    return "unknown";
+}
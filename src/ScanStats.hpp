@@ -0,0 +1,205 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#ifndef SCAN_STATS_HPP
+#define SCAN_STATS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+/**
+ * @brief Phases of a scan that --stats reports the time of.
+ * @details Phases nest: time spent in an inner phase is not counted again for the outer one.
+ *          Whatever is not attributed to a phase is reported as Other.
+ */
+enum class ScanPhase {
+    Traversal,      // Walking the directory tree and indexing the files found
+    SizeGrouping,   // Setting aside files of a unique size, with a memory limit also sorting files by size
+    PartialHash,    // Sampling digests of the head and tail of files
+    FullHash,       // Full-content digests, including spilling and merging digest runs
+    Compare,        // Byte-by-byte comparison of candidate groups
+    Action,         // Deleting, linking or listing duplicates
+    Other,
+    Count
+};
+
+/**
+ * @brief Operation counters recorded by the I/O layers.
+ */
+enum class StatCounter {
+    FilesOpened,        // Files opened to read their content
+    BytesRead,          // Bytes of file content read or mapped
+    ReadCalls,          // read and pread calls, stream reads included
+    MapCalls,           // mmap calls
+    StatCalls,          // stat family calls on files and directories
+    DirectoryOpens,     // Directories opened by the walk
+    DirectoryReads,     // getdents64 or readdir calls
+    LocateCalls,        // Opens and FIEMAP ioctls used to order reads by disk position
+    UringEnters,        // io_uring_enter calls
+    ActionCalls,        // unlink, link, rename and FIDEDUPERANGE calls
+    CacheHits,          // Digests found in the hash cache
+    CacheMisses,        // Cacheable files missing from the hash cache
+    Count
+};
+
+/**
+ * @brief Kinds of errors reported during a scan.
+ */
+enum class ScanErrorKind {
+    Walk,           // Directories or entries that could not be read
+    Read,           // Files that could not be hashed or compared
+    Delete,
+    Hardlink,
+    Reflink,
+    Cache,
+    Reference,      // Reference index load, save or lookup errors
+    Count
+};
+
+/**
+ * @brief Operations whose per-file latency is recorded in a histogram.
+ */
+enum class StatLatency {
+    PartialHash,
+    FullHash,
+    Count
+};
+
+/**
+ * @brief Built-in instrumentation of a scan: time per phase, I/O counters, errors by kind,
+ *        per-file hashing latency histograms and peak resident memory.
+ * @details Counters are recorded through the static functions from any thread. Each thread writes
+ *          to its own block of counters without synchronization; the blocks are only summed when a
+ *          scan starts and finishes, and the blocks of exited threads are folded into a shared
+ *          total. A scan's figures are the difference between the two sums, so scans running
+ *          concurrently in one process see each other's I/O.
+ *          Phase timing is kept by the instance and must be driven from the coordinating thread.
+ */
+class ScanStats {
+public:
+    /// Latency buckets: bucket i holds durations below 2^i microseconds, the last one everything above
+    static constexpr std::size_t kLatencyBuckets = 28;
+
+    static void count(StatCounter counter, std::uint64_t amount = 1);
+    static void countError(ScanErrorKind kind);
+    static void recordLatency(StatLatency latency, std::chrono::steady_clock::duration elapsed);
+
+    /**
+     * @brief Ends the current phase and starts another one.
+     * @return The phase that was ended.
+     */
+    ScanPhase enterPhase(ScanPhase phase);
+
+    /**
+     * @brief Enters a phase for the lifetime of the scope and returns to the previous one afterwards.
+     */
+    class PhaseScope {
+    public:
+        PhaseScope(ScanStats& stats, ScanPhase phase) : stats(stats), previous(stats.enterPhase(phase)) {}
+        ~PhaseScope() { stats.enterPhase(previous); }
+
+        PhaseScope(const PhaseScope&) = delete;
+        PhaseScope& operator=(const PhaseScope&) = delete;
+
+    private:
+        ScanStats& stats;
+        ScanPhase previous;
+    };
+
+    /**
+     * @brief Resets the figures and starts recording.
+     */
+    void start();
+
+    /**
+     * @brief Stops recording and computes the figures of the scan, including peak resident memory.
+     */
+    void finish();
+
+    double phaseSeconds(ScanPhase phase) const;
+    double wallSeconds() const { return seconds(wall); }
+    std::uint64_t counter(StatCounter counter) const { return totals.counters[static_cast<std::size_t>(counter)]; }
+    std::uint64_t errors(ScanErrorKind kind) const { return totals.errors[static_cast<std::size_t>(kind)]; }
+    std::uint64_t errorCount() const;
+    std::uint64_t syscallCount() const;
+    std::uint64_t latencyCount(StatLatency latency) const;
+
+    /**
+     * @brief Upper bound in microseconds of the bucket that holds the given fraction of latencies.
+     * @param latency The recorded operation.
+     * @param fraction Between 0 and 1, e.g. 0.99 for the 99th percentile.
+     * @return 0 if nothing was recorded.
+     */
+    std::uint64_t latencyPercentile(StatLatency latency, double fraction) const;
+
+    /// Peak resident set size of the process in bytes, 0 where the platform does not report it
+    std::uint64_t peakRssBytes() const { return peakRss; }
+
+    /**
+     * @brief Writes the figures as a human-readable block.
+     */
+    void print(std::ostream& out) const;
+
+    /**
+     * @brief Formats the figures as a single-line JSON object.
+     */
+    std::string toJson() const;
+
+    static const char* phaseName(ScanPhase phase);
+    static const char* counterName(StatCounter counter);
+    static const char* errorKindName(ScanErrorKind kind);
+    static const char* latencyName(StatLatency latency);
+
+    /**
+     * @brief Sum of the counters of all threads.
+     */
+    struct Totals {
+        std::array<std::uint64_t, static_cast<std::size_t>(StatCounter::Count)> counters{};
+        std::array<std::uint64_t, static_cast<std::size_t>(ScanErrorKind::Count)> errors{};
+        std::array<std::array<std::uint64_t, kLatencyBuckets>, static_cast<std::size_t>(StatLatency::Count)> latencies{};
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::array<Clock::duration, static_cast<std::size_t>(ScanPhase::Count)> phases{};
+    ScanPhase current = ScanPhase::Other;
+    Clock::time_point phaseStart;
+    Clock::time_point startTime;
+    Clock::duration wall{};
+    Totals begin;
+    Totals totals;
+    std::uint64_t peakRss = 0;
+
+    static Totals snapshot();
+    static double seconds(Clock::duration duration);
+};
+
+#endif // SCAN_STATS_HPP
@@ -0,0 +1,428 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "UringReader.hpp"
+#include "ScanStats.hpp"
+#include <stdexcept>
+
+#if PDCPP_HAVE_IO_URING
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+    int uringSetup(unsigned int entries, io_uring_params* params) {
+        return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int uringEnter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags) {
+        return static_cast<int>(::syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+    }
+
+    int uringRegister(int fd, unsigned int opcode, void* arg, unsigned int count) {
+        return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, count));
+    }
+
+    std::string errorText(int error) {
+        return std::strerror(error);
+    }
+}
+
+/**
+ * @brief The mapped submission and completion queues of one io_uring instance.
+ */
+struct UringReader::Ring {
+    int fd = -1;
+    void* sqMapping = MAP_FAILED;
+    std::size_t sqMappingSize = 0;
+    void* cqMapping = MAP_FAILED;
+    std::size_t cqMappingSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    std::size_t sqesSize = 0;
+
+    unsigned int* sqTail = nullptr;
+    unsigned int sqMask = 0;
+    unsigned int* sqArray = nullptr;
+    unsigned int* cqHead = nullptr;
+    unsigned int* cqTail = nullptr;
+    unsigned int cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+    unsigned int unsubmitted = 0;
+
+    std::size_t bufferSize = 0;
+    unsigned int depth = 0;
+    unsigned char* buffers = nullptr;
+
+    explicit Ring(unsigned int entries) {
+        io_uring_params params {};
+        fd = uringSetup(entries, &params);
+        if (fd < 0) {
+            throw std::runtime_error("io_uring_setup failed: " + errorText(errno));
+        }
+
+        sqMappingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        cqMappingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (singleMapping) {
+            sqMappingSize = cqMappingSize = std::max(sqMappingSize, cqMappingSize);
+        }
+
+        sqMapping = ::mmap(nullptr, sqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqMapping == MAP_FAILED) {
+            release();
+            throw std::runtime_error("Could not map the io_uring submission queue: " + errorText(errno));
+        }
+        if (singleMapping) {
+            cqMapping = sqMapping;
+        } else {
+            cqMapping = ::mmap(nullptr, cqMappingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cqMapping == MAP_FAILED) {
+                release();
+                throw std::runtime_error("Could not map the io_uring completion queue: " + errorText(errno));
+            }
+        }
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(::mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) {
+            release();
+            throw std::runtime_error("Could not map the io_uring submission entries: " + errorText(errno));
+        }
+
+        auto* sq = static_cast<unsigned char*>(sqMapping);
+        auto* cq = static_cast<unsigned char*>(cqMapping);
+        sqTail = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~Ring() {
+        release();
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    void release() {
+        if (buffers != nullptr) {
+            ::operator delete[](buffers, std::align_val_t(4096));
+            buffers = nullptr;
+        }
+        if (sqes != MAP_FAILED) {
+            ::munmap(sqes, sqesSize);
+            sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+        }
+        if (cqMapping != MAP_FAILED && cqMapping != sqMapping) {
+            ::munmap(cqMapping, cqMappingSize);
+        }
+        cqMapping = MAP_FAILED;
+        if (sqMapping != MAP_FAILED) {
+            ::munmap(sqMapping, sqMappingSize);
+            sqMapping = MAP_FAILED;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    bool supportsOperations(std::initializer_list<unsigned int> operations) const {
+        constexpr unsigned int kProbeOps = 256;
+        std::vector<unsigned char> storage(sizeof(io_uring_probe) + kProbeOps * sizeof(io_uring_probe_op));
+        auto* probe = reinterpret_cast<io_uring_probe*>(storage.data());
+        if (uringRegister(fd, IORING_REGISTER_PROBE, probe, kProbeOps) < 0) {
+            return false;
+        }
+        for (unsigned int operation : operations) {
+            if (operation > probe->last_op || (probe->ops[operation].flags & IO_URING_OP_SUPPORTED) == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Queues a submission entry; one slot never has more than one request in flight, so the
+     *        queue cannot overflow as long as it has at least as many entries as there are slots.
+     */
+    io_uring_sqe* nextEntry() {
+        const unsigned int tail = *sqTail;
+        const unsigned int index = tail & sqMask;
+        io_uring_sqe* entry = &sqes[index];
+        std::memset(entry, 0, sizeof(*entry));
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        ++unsubmitted;
+        return entry;
+    }
+
+    void submitAndWait() {
+        for (;;) {
+            const int submitted = uringEnter(fd, unsubmitted, 1, IORING_ENTER_GETEVENTS);
+            ScanStats::count(StatCounter::UringEnters);
+            if (submitted < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                    continue;
+                }
+                throw std::runtime_error("io_uring_enter failed: " + errorText(errno));
+            }
+            unsubmitted -= std::min<unsigned int>(unsubmitted, static_cast<unsigned int>(submitted));
+            return;
+        }
+    }
+};
+
+UringReader::UringReader(unsigned int queueDepth, std::size_t bufferSize)
+        : ring(std::make_unique<Ring>(std::max(1u, queueDepth))) {
+    if (!ring->supportsOperations({IORING_OP_OPENAT, IORING_OP_READ, IORING_OP_CLOSE})) {
+        throw std::runtime_error("The running kernel does not support io_uring open/read/close.");
+    }
+    ring->depth = std::max(1u, queueDepth);
+    ring->bufferSize = std::max<std::size_t>(1, bufferSize);
+    ring->buffers = static_cast<unsigned char*>(::operator new[](ring->depth * ring->bufferSize, std::align_val_t(4096)));
+}
+
+UringReader::~UringReader() = default;
+
+void UringReader::run(const std::vector<UringReadJob>& jobs, const ChunkSink& onData, const DoneSink& onDone) {
+    enum class State { Idle, Opening, Reading, Closing };
+    struct Slot {
+        State state = State::Idle;
+        std::size_t job = 0;
+        int fd = -1;
+        std::size_t range = 0;          // Index of the range being read
+        std::uintmax_t offset = 0;      // File offset of the next read
+        std::uintmax_t remaining = 0;   // Bytes left in the current range
+        std::string error;
+    };
+
+    Ring& r = *ring;
+    std::vector<Slot> slots(r.depth);
+    std::size_t nextJob = 0;
+    std::size_t active = 0;
+
+    auto queueRead = [&](std::size_t slotIndex) {
+        Slot& slot = slots[slotIndex];
+        const UringReadJob& job = jobs[slot.job];
+        std::uintmax_t length = r.bufferSize;
+        if (!job.ranges.empty()) {
+            length = std::min<std::uintmax_t>(length, slot.remaining);
+        }
+        io_uring_sqe* entry = r.nextEntry();
+        entry->opcode = IORING_OP_READ;
+        entry->fd = slot.fd;
+        entry->addr = reinterpret_cast<std::uintptr_t>(r.buffers + slotIndex * r.bufferSize);
+        entry->len = static_cast<unsigned int>(length);
+        entry->off = slot.offset;
+        entry->user_data = slotIndex;
+        slot.state = State::Reading;
+    };
+
+    auto queueClose = [&](std::size_t slotIndex) {
+        Slot& slot = slots[slotIndex];
+        io_uring_sqe* entry = r.nextEntry();
+        entry->opcode = IORING_OP_CLOSE;
+        entry->fd = slot.fd;
+        entry->user_data = slotIndex;
+        slot.state = State::Closing;
+    };
+
+    // Moves to the next range of the job, returns false once the job has been read completely
+    auto startRange = [&](Slot& slot) {
+        const UringReadJob& job = jobs[slot.job];
+        while (slot.range < job.ranges.size()) {
+            slot.offset = job.ranges[slot.range].offset;
+            slot.remaining = job.ranges[slot.range].length;
+            if (slot.remaining > 0) {
+                return true;
+            }
+            ++slot.range;
+        }
+        return false;
+    };
+
+    auto startJob = [&](std::size_t slotIndex) {
+        Slot& slot = slots[slotIndex];
+        slot = Slot();
+        slot.job = nextJob++;
+        io_uring_sqe* entry = r.nextEntry();
+        entry->opcode = IORING_OP_OPENAT;
+        entry->fd = AT_FDCWD;
+        entry->addr = reinterpret_cast<std::uintptr_t>(jobs[slot.job].path->c_str());
+        entry->open_flags = O_RDONLY | O_CLOEXEC;
+        entry->user_data = slotIndex;
+        slot.state = State::Opening;
+        ++active;
+    };
+
+    auto finishJob = [&](std::size_t slotIndex) {
+        Slot& slot = slots[slotIndex];
+        slot.state = State::Idle;
+        --active;
+        onDone(slot.job, slot.error);
+        if (nextJob < jobs.size()) {
+            startJob(slotIndex);
+        }
+    };
+
+    for (std::size_t slotIndex = 0; slotIndex < slots.size() && nextJob < jobs.size(); ++slotIndex) {
+        startJob(slotIndex);
+    }
+
+    while (active > 0) {
+        r.submitAndWait();
+
+        unsigned int head = *r.cqHead;
+        const unsigned int tail = __atomic_load_n(r.cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& completion = r.cqes[head & r.cqMask];
+            const auto slotIndex = static_cast<std::size_t>(completion.user_data);
+            const int result = completion.res;
+            Slot& slot = slots[slotIndex];
+            const UringReadJob& job = jobs[slot.job];
+
+            switch (slot.state) {
+                case State::Opening:
+                    if (result < 0) {
+                        slot.error = "Could not open file (" + errorText(-result) + "): " + *job.path;
+                        finishJob(slotIndex);
+                    } else {
+                        slot.fd = result;
+                        ScanStats::count(StatCounter::FilesOpened);
+                        if (job.ranges.empty() || startRange(slot)) {
+                            queueRead(slotIndex);
+                        } else {
+                            queueClose(slotIndex);
+                        }
+                    }
+                    break;
+                case State::Reading:
+                    if (result == -EINTR || result == -EAGAIN) {
+                        queueRead(slotIndex);
+                        break;
+                    }
+                    if (result < 0) {
+                        slot.error = "Could not read file (" + errorText(-result) + "): " + *job.path;
+                        queueClose(slotIndex);
+                        break;
+                    }
+                    if (result == 0) {
+                        // End of file is only expected when reading the whole file
+                        if (!job.ranges.empty()) {
+                            slot.error = "Unexpected end of file: " + *job.path;
+                        }
+                        queueClose(slotIndex);
+                        break;
+                    }
+                    ScanStats::count(StatCounter::BytesRead, static_cast<std::uint64_t>(result));
+                    try {
+                        onData(slot.job, r.buffers + slotIndex * r.bufferSize, static_cast<std::size_t>(result));
+                    } catch (const std::exception& e) {
+                        slot.error = e.what();
+                        queueClose(slotIndex);
+                        break;
+                    }
+                    slot.offset += static_cast<std::uintmax_t>(result);
+                    if (!job.ranges.empty()) {
+                        slot.remaining -= static_cast<std::uintmax_t>(result);
+                        if (slot.remaining == 0) {
+                            ++slot.range;
+                            if (!startRange(slot)) {
+                                queueClose(slotIndex);
+                                break;
+                            }
+                        }
+                    }
+                    queueRead(slotIndex);
+                    break;
+                case State::Closing:
+                    finishJob(slotIndex);
+                    break;
+                case State::Idle:
+                    break;
+            }
+        }
+        __atomic_store_n(r.cqHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+bool UringReader::isSupported() {
+    static const bool supported = []() {
+        try {
+            UringReader probe(1, 1);
+            return true;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }();
+    return supported;
+}
+#else
+struct UringReader::Ring {
+};
+
+UringReader::UringReader(unsigned int, std::size_t) {
+    throw std::runtime_error("This build does not include the io_uring engine.");
+}
+
+UringReader::~UringReader() = default;
+
+void UringReader::run(const std::vector<UringReadJob>&, const ChunkSink&, const DoneSink&) {
+    throw std::runtime_error("This build does not include the io_uring engine.");
+}
+
+bool UringReader::isSupported() {
+    return false;
+}
+#endif
+
+IoEngine UringReader::parseEngine(const std::string& name) {
+    for (IoEngine engine : {IoEngine::Sync, IoEngine::Uring}) {
+        if (name == engineName(engine)) {
+            return engine;
+        }
+    }
+    throw std::invalid_argument("'" + name + "' is not a known I/O engine (sync, uring).");
+}
+
+const char* UringReader::engineName(IoEngine engine) {
+    switch (engine) {
+        case IoEngine::Sync:
+            return "sync";
+        case IoEngine::Uring:
+            return "uring";
+    }
+    return "sync";
+}
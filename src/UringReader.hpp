@@ -0,0 +1,112 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ */
+#ifndef URING_READER_HPP
+#define URING_READER_HPP
+
+#include "FileReader.hpp"
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief How batches of files are read while hashing.
+ */
+enum class IoEngine {
+    Sync, // One blocking open/read/close sequence per file on each worker thread
+    Uring // Linux io_uring keeping many opens and reads in flight per worker thread
+};
+
+/**
+ * @brief A file to read through the UringReader.
+ */
+struct UringReadJob {
+    const std::string* path;       // Path of the file, must stay valid until run() returns
+    std::vector<ByteRange> ranges; // Parts of the file to read in order, empty reads the whole file
+};
+
+/**
+ * @brief Reads many files at once through a Linux io_uring instance.
+ * @details Opens, reads and closes of up to queueDepth files are kept in flight together and
+ *          submitted with a single system call per round trip, which hides the per-file latency
+ *          that dominates trees of small files. Every file receives its chunks in order. An
+ *          instance owns its ring and must only be used by one thread at a time.
+ *          Only available when built with PDCPP_ENABLE_IO_URING on a kernel supporting
+ *          IORING_OP_OPENAT, IORING_OP_READ and IORING_OP_CLOSE (Linux 5.6+).
+ */
+class UringReader {
+public:
+    using ChunkSink = std::function<void(std::size_t job, const unsigned char* data, std::size_t length)>;
+    using DoneSink = std::function<void(std::size_t job, const std::string& error)>;
+
+    static constexpr unsigned int kDefaultQueueDepth = 64;      // Files kept in flight at once
+    static constexpr std::size_t kSlotBufferSize = 128 * 1024;  // Bytes requested per read of one file
+
+    /**
+     * @brief Sets up the ring.
+     * @param queueDepth Number of files kept in flight at once.
+     * @param bufferSize Bytes requested per read of one file.
+     * @throws std::runtime_error If io_uring is not available.
+     */
+    explicit UringReader(unsigned int queueDepth = kDefaultQueueDepth, std::size_t bufferSize = kSlotBufferSize);
+    ~UringReader();
+
+    UringReader(const UringReader&) = delete;
+    UringReader& operator=(const UringReader&) = delete;
+
+    /**
+     * @brief Reads all jobs and returns once every one of them completed.
+     * @param jobs The files to read.
+     * @param onData Receives the content of a job one chunk at a time, in file order. An exception
+     *               thrown here fails that job only.
+     * @param onDone Called exactly once per job, with an empty error message on success.
+     */
+    void run(const std::vector<UringReadJob>& jobs, const ChunkSink& onData, const DoneSink& onDone);
+
+    /**
+     * @brief Tells whether this build and the running kernel support the io_uring engine.
+     * @details The kernel is probed once, later calls return the cached answer.
+     */
+    static bool isSupported();
+
+    /**
+     * @brief Parses an engine name as given on the command line.
+     * @throws std::invalid_argument If the name is unknown.
+     */
+    static IoEngine parseEngine(const std::string& name);
+
+    /**
+     * @brief Returns the command line name of an engine.
+     */
+    static const char* engineName(IoEngine engine);
+
+private:
+    struct Ring;
+    std::unique_ptr<Ring> ring;
+};
+
+#endif // URING_READER_HPP
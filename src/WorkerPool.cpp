@@ -0,0 +1,241 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+#include "WorkerPool.hpp"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+    // Pool and queue owned by the current thread, the caller of run() or parallelFor() owns queue 0
+    thread_local const WorkerPool* currentPool = nullptr;
+    thread_local std::size_t currentQueueIndex = 0;
+}
+
+WorkerPool::WorkerPool(unsigned int jobs) {
+    const unsigned int threadCount = resolveJobs(jobs);
+    for (unsigned int i = 0; i < threadCount; ++i) {
+        queues.push_back(std::make_unique<TaskQueue>());
+    }
+    for (unsigned int i = 1; i < threadCount; ++i) {
+        threads.emplace_back(&WorkerPool::workerLoop, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
+unsigned int WorkerPool::resolveJobs(unsigned int requested) {
+    if (requested != 0) {
+        return requested;
+    }
+    const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads == 0 ? 1 : hardwareThreads;
+}
+
+void WorkerPool::push(std::size_t queueIndex, Task task) {
+    {
+        std::lock_guard<std::mutex> lock(queues[queueIndex]->mutex);
+        queues[queueIndex]->tasks.push_back(std::move(task));
+    }
+    {
+        // Taking the sleep mutex orders the increment with a worker that is about to wait
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        ++queuedTasks;
+    }
+    wakeUp.notify_one();
+}
+
+bool WorkerPool::tryRunOne(std::size_t ownQueue) {
+    Task task;
+    {
+        std::lock_guard<std::mutex> lock(queues[ownQueue]->mutex);
+        if (!queues[ownQueue]->tasks.empty()) {
+            task = std::move(queues[ownQueue]->tasks.back());
+            queues[ownQueue]->tasks.pop_back();
+        }
+    }
+
+    // Own queue is empty, steal the oldest task of another queue
+    for (std::size_t offset = 1; !task && offset < queues.size(); ++offset) {
+        TaskQueue& victim = *queues[(ownQueue + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+    }
+
+    if (!task) {
+        return false;
+    }
+    --queuedTasks;
+    task();
+    return true;
+}
+
+std::size_t WorkerPool::currentQueue() const {
+    return currentPool == this ? currentQueueIndex : 0;
+}
+
+void WorkerPool::workerLoop(std::size_t ownQueue) {
+    currentPool = this;
+    currentQueueIndex = ownQueue;
+    for (;;) {
+        if (tryRunOne(ownQueue)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wakeUp.wait(lock, [this]() { return stopping || queuedTasks.load() > 0; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void WorkerPool::parallelFor(std::size_t count, const std::function<void(std::size_t)>& task) {
+    if (count == 0) {
+        return;
+    }
+
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+    auto runRange = [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!firstError) {
+                    firstError = std::current_exception();
+                }
+            }
+        }
+    };
+
+    if (queues.size() == 1 || count == 1) {
+        runRange(0, count);
+    } else {
+        // Several chunks per thread leave room for stealing when item costs are uneven
+        const std::size_t chunkSize = std::max<std::size_t>(1, count / (queues.size() * 8));
+        const std::size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+
+        std::atomic<std::size_t> pendingChunks{chunkCount};
+        std::mutex doneMutex;
+        std::condition_variable done;
+
+        for (std::size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            const std::size_t begin = chunk * chunkSize;
+            const std::size_t end = std::min(count, begin + chunkSize);
+            push(chunk % queues.size(), [&, begin, end]() {
+                runRange(begin, end);
+                // Decrement under the lock so the waiter cannot leave before the notification is sent
+                std::lock_guard<std::mutex> lock(doneMutex);
+                if (--pendingChunks == 0) {
+                    done.notify_all();
+                }
+            });
+        }
+
+        // Help out until every chunk has been claimed, then wait for the stragglers
+        while (pendingChunks.load() > 0 && tryRunOne(0)) {
+        }
+        std::unique_lock<std::mutex> lock(doneMutex);
+        done.wait(lock, [&]() { return pendingChunks.load() == 0; });
+    }
+
+    if (firstError) {
+        std::rethrow_exception(firstError);
+    }
+}
+
+void WorkerPool::parallelForOrdered(std::size_t count, const std::function<void(std::size_t)>& task) {
+    std::atomic<std::size_t> next{0};
+    std::exception_ptr firstError;
+    std::mutex errorMutex;
+    parallelFor(std::min(count, queues.size()), [&](std::size_t) {
+        for (std::size_t i = next++; i < count; i = next++) {
+            try {
+                task(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!firstError) {
+                    firstError = std::current_exception();
+                }
+            }
+        }
+    });
+
+    if (firstError) {
+        std::rethrow_exception(firstError);
+    }
+}
+
+void WorkerPool::TaskGroup::spawn(GroupTask task) {
+    ++pending;
+    pool.push(pool.currentQueue(), [this, task = std::move(task)]() {
+        try {
+            task(*this);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!firstError) {
+                firstError = std::current_exception();
+            }
+        }
+        // Decrement under the lock so the waiter cannot leave before the notification is sent
+        std::lock_guard<std::mutex> lock(doneMutex);
+        if (--pending == 0) {
+            done.notify_all();
+        }
+    });
+}
+
+void WorkerPool::run(const GroupTask& root) {
+    TaskGroup group(*this);
+    group.spawn(root);
+
+    // Help out while work is queued; tasks may still spawn more, so an idle caller only naps briefly
+    while (group.pending.load() > 0) {
+        if (tryRunOne(0)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(group.doneMutex);
+        group.done.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+            return group.pending.load() == 0 || queuedTasks.load() > 0;
+        });
+    }
+
+    if (group.firstError) {
+        std::rethrow_exception(group.firstError);
+    }
+}
@@ -0,0 +1,143 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ */
+#ifndef WORKER_POOL_HPP
+#define WORKER_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief A fixed-size pool of worker threads with one work-stealing queue per thread.
+ * @details Every worker pops tasks from the back of its own queue and, once that runs dry, steals
+ *          from the front of the other queues. The thread that submits work through parallelFor()
+ *          takes part in executing it, so a pool created for N jobs starts N - 1 threads.
+ */
+class WorkerPool {
+public:
+    class TaskGroup;
+    using GroupTask = std::function<void(TaskGroup&)>;
+
+    /**
+     * @brief A set of tasks that may keep spawning further tasks, see run().
+     */
+    class TaskGroup {
+    public:
+        /**
+         * @brief Queues a task on the calling thread's queue, where it runs before older work and
+         *        can be stolen by idle threads.
+         */
+        void spawn(GroupTask task);
+
+    private:
+        friend class WorkerPool;
+
+        explicit TaskGroup(WorkerPool& pool) : pool(pool) {}
+
+        WorkerPool& pool;
+        std::atomic<std::size_t> pending{0};
+        std::mutex doneMutex;
+        std::condition_variable done;
+        std::mutex errorMutex;
+        std::exception_ptr firstError;
+    };
+
+    /**
+     * @brief Starts the worker threads.
+     * @param jobs Total number of threads executing tasks, including the caller of parallelFor().
+     *             Zero selects the hardware concurrency.
+     */
+    explicit WorkerPool(unsigned int jobs);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief Runs task(i) for every i in [0, count) and blocks until all of them completed.
+     * @param count Number of items to process.
+     * @param task Callable invoked once per item, possibly from several threads at the same time.
+     * @throws Rethrows the first exception escaping a task once all items have been processed.
+     */
+    void parallelFor(std::size_t count, const std::function<void(std::size_t)>& task);
+
+    /**
+     * @brief Like parallelFor(), but items are started strictly in ascending order.
+     * @details Every thread claims the next unstarted item, so the items in flight at any moment are
+     *          neighbours. Meant for work sorted by disk location, where chunks handed to different
+     *          threads would make the disk seek back and forth between them.
+     */
+    void parallelForOrdered(std::size_t count, const std::function<void(std::size_t)>& task);
+
+    /**
+     * @brief Runs a task and everything it spawns, transitively, and blocks until all of them completed.
+     * @param root The first task; it and every task it spawns receive the group to spawn into.
+     * @throws Rethrows the first exception escaping a task once all tasks have been processed.
+     * @details Suited to work that is discovered while running, like the directories of a tree. A
+     *          thread runs its own newest task first, so every thread descends depth-first while idle
+     *          threads steal the oldest, typically largest, pieces of work.
+     */
+    void run(const GroupTask& root);
+
+    /**
+     * @brief Number of threads executing tasks, including the caller of parallelFor().
+     */
+    unsigned int jobs() const { return static_cast<unsigned int>(queues.size()); }
+
+    /**
+     * @brief Resolves a requested job count, zero meaning the hardware concurrency.
+     */
+    static unsigned int resolveJobs(unsigned int requested);
+
+private:
+    using Task = std::function<void()>;
+
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<TaskQueue>> queues; // Queue 0 belongs to the caller of parallelFor()
+    std::vector<std::thread> threads;
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    std::atomic<std::size_t> queuedTasks{0};
+    bool stopping = false;
+
+    void push(std::size_t queueIndex, Task task);
+    std::size_t currentQueue() const;
+    bool tryRunOne(std::size_t ownQueue);
+    void workerLoop(std::size_t ownQueue);
+};
+
+#endif // WORKER_POOL_HPP
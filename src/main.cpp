@@ -26,13 +26,35 @@
  */
 
 #include "version.hpp"
+#include "Hasher.hpp"
 #include "PurgeDuplicates.hpp"
+#include <fstream>
 #include <iostream>
 #include <string>
 #include <sstream>
+#include <stdexcept>
+#include <vector>
 
 #define PDCPP_ARG_SHOWPROGRESS "--show-progress"
 #define PDCPP_ARG_LIVERUN "--live-run"
+#define PDCPP_ARG_SAMPLESIZE "--sample-size"
+#define PDCPP_ARG_JOBS "--jobs"
+#define PDCPP_ARG_READBACKEND "--read-backend"
+#define PDCPP_ARG_READBUFFER "--read-buffer"
+#define PDCPP_ARG_IOENGINE "--io-engine"
+#define PDCPP_ARG_CACHE "--cache"
+#define PDCPP_ARG_CACHEPRUNE "--cache-prune"
+#define PDCPP_ARG_HASH "--hash"
+#define PDCPP_ARG_COMPARE "--compare"
+#define PDCPP_ARG_ONEFILESYSTEM "--one-file-system"
+#define PDCPP_ARG_READORDER "--read-order"
+#define PDCPP_ARG_ACTION "--action"
+#define PDCPP_ARG_FORMAT "--format"
+#define PDCPP_ARG_MAXMEMORY "--max-memory"
+#define PDCPP_ARG_BUILDREFERENCE "--build-reference"
+#define PDCPP_ARG_REFERENCE "--reference"
+#define PDCPP_ARG_STATS "--stats"
+#define PDCPP_ARG_STATSJSON "--stats-json"
 /**
  * @brief prints version information to standard output
  */
@@ -48,12 +70,63 @@ void print_version_info() {
 void print_usage_info(const bool isError = false,const char* appName = "purge-duplicates") {
     std::stringstream ss;
     ss << "purge-duplicates v" << pdcpp::VERSION << std::endl;
-    ss << "Usage: " << appName << " <directory_path> [--show-progress] [--live-run]" << std::endl;
+    ss << "Usage: " << appName << " <directory_path>... [--show-progress] [--live-run] [--sample-size=BYTES] [--jobs N]" << std::endl;
+    ss << "       [--read-backend=auto|stream|pread|mmap] [--read-buffer=BYTES] [--io-engine=sync|uring]" << std::endl;
+    ss << "       [--cache=PATH [--cache-prune]] [--hash=ALGORITHM] [--compare=auto|hash|bytes]" << std::endl;
+    ss << "       [--one-file-system] [--read-order=auto|discovery|inode|extent] [--action=delete|reflink|hardlink]" << std::endl;
+    ss << "       [--format=text|ndjson|binary] [--max-memory=BYTES] [--build-reference=INDEX | --reference=INDEX]" << std::endl;
+    ss << "       [--stats] [--stats-json=PATH]" << std::endl;
     ss << std::endl;
     ss << "Arguments:" << std::endl;
-    ss << "  <directory_path>   Required: Path to directory to scan for duplicates" << std::endl;
+    ss << "  <directory_path>   Required: Path to directory to scan for duplicates; with --reference any number" << std::endl;
+    ss << "                     of directories can be given" << std::endl;
     ss << "  --show-progress    Optional: Display progress during scanning" << std::endl;
     ss << "  --live-run         Optional: Actually delete duplicates (without this, runs in dry-run mode)" << std::endl;
+    ss << "  --action=A         Optional: What a live run does with duplicates: delete (default) removes them," << std::endl;
+    ss << "                     reflink keeps every path and lets them share the extents of the original" << std::endl;
+    ss << "                     (Linux FIDEDUPERANGE on btrfs, XFS and other file systems with shared extents)," << std::endl;
+    ss << "                     hardlink atomically replaces them by hardlinks to the original" << std::endl;
+    ss << "  --format=F         Optional: Report on stdout: text (default), ndjson with one JSON record per" << std::endl;
+    ss << "                     line or binary; with ndjson and binary the messages go to stderr" << std::endl;
+    ss << "  --max-memory=N     Optional: Bound the memory taken by file lists: beyond N bytes they are sorted" << std::endl;
+    ss << "                     in runs on disk (TMPDIR) and merged, which is slower but never runs out of" << std::endl;
+    ss << "                     memory (accepts K/M/G suffixes, at least 16M)" << std::endl;
+    ss << "  --build-reference=INDEX" << std::endl;
+    ss << "                     Optional: Hash every file of the directory into the reference index INDEX" << std::endl;
+    ss << "                     instead of looking for duplicates; nothing is removed" << std::endl;
+    ss << "  --reference=INDEX  Optional: Remove the files of the directories whose content is already in the" << std::endl;
+    ss << "                     reference tree indexed in INDEX, without reading that tree again; files inside" << std::endl;
+    ss << "                     the reference tree are never touched" << std::endl;
+    ss << "  --stats            Optional: Print time per phase, system calls, bytes read, cache hits, errors by" << std::endl;
+    ss << "                     kind, per-file hashing latencies and peak memory after the summary" << std::endl;
+    ss << "  --stats-json=PATH  Optional: Write the same statistics to PATH, one JSON object per directory" << std::endl;
+    ss << "  --sample-size=N    Optional: Bytes hashed from the head and tail of a file before a full hash" << std::endl;
+    ss << "                     is attempted (default 4K, accepts K/M/G suffixes)" << std::endl;
+    ss << "  --jobs N           Optional: Number of directories read and files hashed concurrently" << std::endl;
+    ss << "                     (default: hardware concurrency)" << std::endl;
+    ss << "  --read-backend=B   Optional: How files are read: pread, mmap, stream or auto (default), which" << std::endl;
+    ss << "                     maps files of 64M and more and uses pread for the rest" << std::endl;
+    ss << "  --read-buffer=N    Optional: Bytes requested per read call (default 1M)" << std::endl;
+    ss << "  --io-engine=E      Optional: sync (default) or uring, which keeps many small-file opens and reads" << std::endl;
+    ss << "                     in flight through Linux io_uring and falls back to sync where unavailable" << std::endl;
+    ss << "  --cache=PATH       Optional: Keep full digests in PATH and reuse them for files whose inode, size" << std::endl;
+    ss << "                     and timestamps are unchanged since the previous run" << std::endl;
+    ss << "  --cache-prune      Optional: Drop cache entries of files not seen during this run" << std::endl;
+    ss << "  --hash=ALGORITHM   Optional: Digest used to find duplicates, one of:" << std::endl;
+    ss << "                    ";
+    for (const auto& name : HashAlgorithm::names()) {
+        ss << " " << name;
+    }
+    ss << std::endl;
+    ss << "                     (default blake2b512, blake2s256 on 32-bit platforms). Matches found with the" << std::endl;
+    ss << "                     non-cryptographic xxh3 and xxh128 are confirmed byte by byte" << std::endl;
+    ss << "  --compare=M        Optional: How files surviving the head/tail sample are confirmed: hash reads" << std::endl;
+    ss << "                     them in full, bytes compares the files of a group in lockstep and stops at the" << std::endl;
+    ss << "                     first difference, auto (default) compares small groups and hashes large ones" << std::endl;
+    ss << "  --one-file-system  Optional: Do not descend into directories on other file systems" << std::endl;
+    ss << "  --read-order=O     Optional: Order in which files are read: extent sorts them by their physical" << std::endl;
+    ss << "                     location (FIEMAP), inode by inode number, discovery keeps the walk order and" << std::endl;
+    ss << "                     auto (default) uses extent on rotational disks and discovery otherwise" << std::endl;
 
     if (isError) {
         std::cerr << ss.str();
@@ -76,6 +149,54 @@ void print_unknown_arg_err(const char* arg) {
     print_usage_info(true);
 }
 
+/**
+ * @brief Matches an option that carries a value, given either as "--name=value" or as "--name value"
+ * @param argument The argument currently being processed
+ * @param name Name of the option including its leading dashes
+ * @param index Index of the current argument, advanced when the value is taken from the next argument
+ * @param argc Argument count as passed to main
+ * @param argv Argument vector as passed to main
+ * @param value Receives the value of the option when it matches
+ * @return true if the argument is the given option
+ * @throws std::invalid_argument If the option is given without a value
+ */
+bool match_option_value(const std::string& argument, const char* name, int& index, int argc, char* argv[], std::string& value) {
+    const std::string optionName = name;
+    if (argument == optionName) {
+        if (index + 1 >= argc) {
+            throw std::invalid_argument("'" + optionName + "' requires a value.");
+        }
+        value = argv[++index];
+        return true;
+    }
+    if (argument.compare(0, optionName.size() + 1, optionName + "=") == 0) {
+        value = argument.substr(optionName.size() + 1);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Parses a strictly positive integer count
+ * @param value The text to parse
+ * @param name Name of the option the value belongs to, used in error messages
+ * @return The parsed count
+ * @throws std::invalid_argument If the value is not a positive integer
+ */
+unsigned int parse_positive_count(const std::string& value, const char* name) {
+    std::size_t consumed = 0;
+    unsigned long count = 0;
+    try {
+        count = std::stoul(value, &consumed);
+    } catch (const std::exception&) {
+        consumed = 0;
+    }
+    if (consumed == 0 || consumed != value.size() || count == 0 || count > 0xFFFFu) {
+        throw std::invalid_argument("'" + std::string(name) + "' expects a positive number, got '" + value + "'.");
+    }
+    return static_cast<unsigned int>(count);
+}
+
 int main(int argc, char* argv[]) {
 // First check if we have enough arguments
     if (argc < 2) {
@@ -96,41 +217,135 @@ int main(int argc, char* argv[]) {
         }
     }
 
-// First argument is the directory path
-    const std::string directory = argv[1];
-    bool showProgress = false;
-    bool liveRun = false;
+// First argument is the directory path, further ones are only accepted along with a reference index
+    std::vector<std::string> directories{argv[1]};
+    ScanOptions options;
 
 // Process remaining arguments (flags)
     for (int i = 2; i < argc; ++i) {
         std::string argument = argv[i];
+        std::string value;
         if (!argument.empty() && argument.at(0) == '-') {
-            if (argument == PDCPP_ARG_SHOWPROGRESS) {
-                showProgress = true;
-            } else if (argument == PDCPP_ARG_LIVERUN) {
-                liveRun = true;
-            } else {
-                // Unknown argument
-                print_unknown_arg_err(argument.c_str());
+            try {
+                if (argument == PDCPP_ARG_SHOWPROGRESS) {
+                    options.showProgress = true;
+                } else if (argument == PDCPP_ARG_LIVERUN) {
+                    options.liveRun = true;
+                } else if (argument == PDCPP_ARG_ONEFILESYSTEM) {
+                    options.oneFileSystem = true;
+                } else if (argument == PDCPP_ARG_STATS) {
+                    options.printStats = true;
+                } else if (match_option_value(argument, PDCPP_ARG_STATSJSON, i, argc, argv, value)) {
+                    if (value.empty()) {
+                        throw std::invalid_argument("'" PDCPP_ARG_STATSJSON "' requires a file path.");
+                    }
+                    options.statsPath = value;
+                } else if (match_option_value(argument, PDCPP_ARG_SAMPLESIZE, i, argc, argv, value)) {
+                    options.sampleBlockSize = ScanOptions::parseByteSize(value);
+                    if (options.sampleBlockSize == 0) {
+                        throw std::invalid_argument("'" PDCPP_ARG_SAMPLESIZE "' must be greater than zero.");
+                    }
+                } else if (match_option_value(argument, PDCPP_ARG_JOBS, i, argc, argv, value)) {
+                    options.jobs = parse_positive_count(value, PDCPP_ARG_JOBS);
+                } else if (match_option_value(argument, PDCPP_ARG_READBACKEND, i, argc, argv, value)) {
+                    options.readBackend = FileReader::parseBackend(value);
+                } else if (match_option_value(argument, PDCPP_ARG_IOENGINE, i, argc, argv, value)) {
+                    options.ioEngine = UringReader::parseEngine(value);
+                } else if (argument == PDCPP_ARG_CACHEPRUNE) {
+                    options.cachePrune = true;
+                } else if (match_option_value(argument, PDCPP_ARG_CACHE, i, argc, argv, value)) {
+                    if (value.empty()) {
+                        throw std::invalid_argument("'" PDCPP_ARG_CACHE "' requires a file path.");
+                    }
+                    options.cachePath = value;
+                } else if (match_option_value(argument, PDCPP_ARG_FORMAT, i, argc, argv, value)) {
+                    options.reportFormat = ReportWriter::parseFormat(value);
+                } else if (match_option_value(argument, PDCPP_ARG_MAXMEMORY, i, argc, argv, value)) {
+                    options.maxMemory = ScanOptions::parseByteSize(value);
+                    if (options.maxMemory < PurgeDuplicates::kMinMaxMemory) {
+                        throw std::invalid_argument("'" PDCPP_ARG_MAXMEMORY "' must be at least 16M.");
+                    }
+                } else if (match_option_value(argument, PDCPP_ARG_BUILDREFERENCE, i, argc, argv, value)) {
+                    if (value.empty()) {
+                        throw std::invalid_argument("'" PDCPP_ARG_BUILDREFERENCE "' requires a file path.");
+                    }
+                    options.buildReference = value;
+                } else if (match_option_value(argument, PDCPP_ARG_REFERENCE, i, argc, argv, value)) {
+                    if (value.empty()) {
+                        throw std::invalid_argument("'" PDCPP_ARG_REFERENCE "' requires a file path.");
+                    }
+                    options.referenceIndex = value;
+                } else if (match_option_value(argument, PDCPP_ARG_ACTION, i, argc, argv, value)) {
+                    options.action = Deduplicator::parseAction(value);
+                } else if (match_option_value(argument, PDCPP_ARG_READORDER, i, argc, argv, value)) {
+                    options.readOrder = ReadScheduler::parseOrder(value);
+                } else if (match_option_value(argument, PDCPP_ARG_COMPARE, i, argc, argv, value)) {
+                    options.compareMode = ContentComparer::parseMode(value);
+                } else if (match_option_value(argument, PDCPP_ARG_HASH, i, argc, argv, value)) {
+                    options.hashAlgorithm = HashAlgorithm::byName(value).name();
+                } else if (match_option_value(argument, PDCPP_ARG_READBUFFER, i, argc, argv, value)) {
+                    options.readBufferSize = ScanOptions::parseByteSize(value);
+                    if (options.readBufferSize == 0) {
+                        throw std::invalid_argument("'" PDCPP_ARG_READBUFFER "' must be greater than zero.");
+                    }
+                } else {
+                    // Unknown argument
+                    print_unknown_arg_err(argument.c_str());
+                    return EXIT_FAILURE;
+                }
+            } catch (const std::invalid_argument& e) {
+                std::cerr << "Error: " << e.what() << std::endl;
+                print_usage_info(true, argv[0]);
                 return EXIT_FAILURE;
             }
         } else {
-            // Non-flag argument after the directory path
-            std::cerr << "Unexpected argument: " << argument << std::endl;
-            print_usage_info(true, argv[0]);
-            return EXIT_FAILURE;
+            directories.push_back(argument);
         }
     }
 
+    if (directories.size() > 1 && options.referenceIndex.empty()) {
+        std::cerr << "Unexpected argument: " << directories[1] << std::endl;
+        print_usage_info(true, argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!options.buildReference.empty() && !options.referenceIndex.empty()) {
+        std::cerr << "Error: '" PDCPP_ARG_BUILDREFERENCE "' and '" PDCPP_ARG_REFERENCE "' cannot be combined." << std::endl;
+        print_usage_info(true, argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (options.maxMemory != 0 && (!options.buildReference.empty() || !options.referenceIndex.empty())) {
+        std::cerr << "Error: '" PDCPP_ARG_MAXMEMORY "' does not apply to reference indexes." << std::endl;
+        print_usage_info(true, argv[0]);
+        return EXIT_FAILURE;
+    }
 
-    try {
-        // Pass the new flag to PurgeDuplicates
-        PurgeDuplicates purgeDuplicates(directory, showProgress, liveRun);
-        purgeDuplicates.execute(); // Begin execution
-    } catch (const std::exception& e) {
-        std::cerr << "Error: " << e.what() << std::endl;
+
+    if (options.cachePrune && options.cachePath.empty()) {
+        std::cerr << "Error: '" PDCPP_ARG_CACHEPRUNE "' requires '" PDCPP_ARG_CACHE "'." << std::endl;
+        print_usage_info(true, argv[0]);
         return EXIT_FAILURE;
     }
 
-    return EXIT_SUCCESS;
+    // Every directory appends its statistics, so a file left from an earlier run is emptied first
+    if (!options.statsPath.empty() && !std::ofstream(options.statsPath, std::ios::trunc)) {
+        std::cerr << "Error: cannot write the statistics to " << options.statsPath << "." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // A directory that fails does not keep the others from being checked
+    // and all of them write into one report
+    int status = EXIT_SUCCESS;
+    ReportWriter report(options.reportFormat, std::cout);
+    for (const auto& directory : directories) {
+        try {
+            PurgeDuplicates purgeDuplicates(directory, options);
+            purgeDuplicates.shareReport(report);
+            purgeDuplicates.execute(); // Begin execution
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            status = EXIT_FAILURE;
+        }
+    }
+
+    return status;
 }
@@ -399,6 +399,85 @@ void test_large_dataset_live_run() {
     fs::remove_all(testDir);
 }
 
+void test_parallel_jobs_live_run() {
+    const std::string testDir = fs::temp_directory_path() / "test_parallel_jobs_live_run";
+    if (fs::exists(testDir)) {
+        fs::remove_all(testDir);
+    }
+    fs::create_directory(testDir);
+
+    // 10 groups of 50 identical files each, plus 500 unique files of the same sizes
+    for (int i = 0; i < 1000; ++i) {
+        std::string filePath = testDir + "/file" + std::to_string(i) + ".bin";
+        if (i < 500) {
+            write_binary_file(filePath, std::vector<char>(1000 + i % 10, static_cast<char>(i % 10)));
+        } else {
+            write_binary_file(filePath, generate_random_binary_data(1000 + i % 10));
+        }
+    }
+
+    try {
+        ScanOptions options;
+        options.liveRun = true;
+        options.jobs = 8;
+        PurgeDuplicates pd(testDir, options);
+        pd.execute();
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+        return;
+    }
+
+    size_t fileCount = 0;
+    for (const auto& entry : fs::directory_iterator(testDir)) {
+        if (entry.is_regular_file()) {
+            fileCount++;
+        }
+    }
+    assert(fileCount == 510);
+
+    std::cout << "Test Passed: Parallel hashing with several jobs removes duplicates correctly." << std::endl;
+
+    fs::remove_all(testDir);
+}
+
+// A symbolic link is listed like its target, so it can end up as the kept original of a set
+void test_hardlink_action_with_symlinked_original() {
+    const std::string testDir = fs::temp_directory_path() / "test_hardlink_symlinked_original";
+    if (fs::exists(testDir)) {
+        fs::remove_all(testDir);
+    }
+    fs::create_directories(testDir + "/b");
+    fs::create_directories(testDir + "/c");
+    const std::string content = "content shared by the real file and its copy";
+    std::ofstream(testDir + "/b/real") << content;
+    std::ofstream(testDir + "/c/copy") << content;
+    fs::create_symlink("b/real", testDir + "/a_link");
+
+    try {
+        ScanOptions options;
+        options.liveRun = true;
+        options.action = DuplicateAction::Hardlink;
+        PurgeDuplicates pd(testDir, options);
+        pd.execute();
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+        return;
+    }
+
+    // The copy is replaced by a hardlink to the file, never by a copy of the link itself
+    assert(!fs::is_symlink(testDir + "/c/copy"));
+    assert(fs::is_regular_file(testDir + "/c/copy"));
+    assert(fs::equivalent(testDir + "/c/copy", testDir + "/b/real"));
+    std::string kept;
+    std::getline(std::ifstream(testDir + "/c/copy"), kept);
+    assert(kept == content);
+    assert(fs::is_symlink(testDir + "/a_link"));
+
+    std::cout << "Test Passed: Hardlinks point to the file behind a symlinked original." << std::endl;
+
+    fs::remove_all(testDir);
+}
+
 int main() {
     // Run all tests
     test_large_number_of_mixed_files(); // Mixed ASCII and binary files
@@ -409,6 +488,8 @@ int main() {
     test_dry_run_then_live_run(); // Test Dry run followed by live run
     test_large_dataset_dry_run(); // Test large dataset dry run
     test_large_dataset_live_run(); // Test large dataset live run
+    test_parallel_jobs_live_run(); // Test hashing on several threads
+    test_hardlink_action_with_symlinked_original(); // Test hardlinking next to a symbolic link
 
     std::cout << "All integration tests passed!" << std::endl;
     return 0;
@@ -0,0 +1,664 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2024 Salem B.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES, OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * ---
+ *
+ */
+
+#include "../src/Platform.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if PDCPP_HAS_POSIX_IO
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// Synthetic trees are generated with "tests_perf generate" and measured with "tests_perf run", which
+// CTest invokes for every scenario of the perf label
+
+// Every file holds at least this many bytes, so two different contents can never collide by chance
+constexpr std::uintmax_t kMinFileSize = 16;
+
+/**
+ * @brief Shape of a synthetic tree.
+ */
+struct TreeSpec {
+    std::size_t files = 10000;            // Paths created, hardlinks included
+    std::string sizes = "lognormal:4K:1.5"; // Size distribution: fixed:N, uniform:MIN:MAX or lognormal:MEDIAN:SIGMA
+    double duplicates = 0.25;             // Share of paths that are copies of an earlier file
+    double hardlinks = 0.0;               // Share of paths that are hardlinks to an earlier file
+    double sizeCollisions = 0.0;          // Share of new contents that reuse the size of an earlier one
+    unsigned int depth = 3;               // Depth of the directories holding the files
+    std::size_t filesPerDir = 100;        // Paths per directory
+    std::uint64_t seed = 1;               // Seed of every random choice and of the content
+
+    /**
+     * @brief The options that reproduce this tree, which also identify it.
+     */
+    std::string describe() const {
+        std::ostringstream text;
+        text << "--files=" << files << " --sizes=" << sizes << " --duplicates=" << duplicates
+             << " --hardlinks=" << hardlinks << " --size-collisions=" << sizeCollisions << " --depth=" << depth
+             << " --files-per-dir=" << filesPerDir << " --seed=" << seed;
+        return text.str();
+    }
+};
+
+/**
+ * @brief What a generated tree holds, and what rmdup is expected to find in it.
+ */
+struct TreeStats {
+    std::size_t files = 0;       // Paths, hardlinks included
+    std::uintmax_t bytes = 0;    // Bytes of all paths, hardlinks counted once per path
+    std::size_t directories = 0; // Directories holding files
+    std::size_t hardlinks = 0;   // Paths that are a further link to an inode
+    std::size_t duplicates = 0;  // Inodes whose content another inode already has
+    std::size_t groups = 0;      // Distinct contents held by more than one inode
+};
+
+// Helper function to parse a byte count with an optional K, M or G (binary) suffix
+std::uintmax_t parse_byte_size(const std::string& value) {
+    std::size_t consumed = 0;
+    unsigned long long amount = 0;
+    try {
+        amount = std::stoull(value, &consumed);
+    } catch (const std::exception&) {
+        throw std::invalid_argument("'" + value + "' is not a valid size.");
+    }
+    const std::string suffix = value.substr(consumed);
+    if (suffix == "K" || suffix == "k") {
+        amount <<= 10;
+    } else if (suffix == "M" || suffix == "m") {
+        amount <<= 20;
+    } else if (suffix == "G" || suffix == "g") {
+        amount <<= 30;
+    } else if (!suffix.empty()) {
+        throw std::invalid_argument("'" + value + "' is not a valid size.");
+    }
+    return amount;
+}
+
+// Helper function to parse a share between 0 and 1
+double parse_ratio(const std::string& value) {
+    std::size_t consumed = 0;
+    double ratio = -1;
+    try {
+        ratio = std::stod(value, &consumed);
+    } catch (const std::exception&) {
+        consumed = 0;
+    }
+    if (consumed != value.size() || ratio < 0 || ratio > 1) {
+        throw std::invalid_argument("'" + value + "' is not a ratio between 0 and 1.");
+    }
+    return ratio;
+}
+
+// Helper function to split "a:b:c" into its fields
+std::vector<std::string> split_fields(const std::string& text, char separator) {
+    std::vector<std::string> fields;
+    std::stringstream stream(text);
+    std::string field;
+    while (std::getline(stream, field, separator)) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+/**
+ * @brief Draws file sizes from the distribution named in TreeSpec::sizes.
+ */
+class SizeDistribution {
+public:
+    explicit SizeDistribution(const std::string& spec) {
+        const std::vector<std::string> fields = split_fields(spec, ':');
+        kind = fields.empty() ? std::string() : fields[0];
+        if (kind == "fixed" && fields.size() == 2) {
+            first = static_cast<double>(parse_byte_size(fields[1]));
+        } else if (kind == "uniform" && fields.size() == 3) {
+            first = static_cast<double>(parse_byte_size(fields[1]));
+            second = static_cast<double>(parse_byte_size(fields[2]));
+            if (second < first) {
+                throw std::invalid_argument("The uniform size distribution needs MIN <= MAX in '" + spec + "'.");
+            }
+        } else if (kind == "lognormal" && fields.size() == 3) {
+            first = std::log(static_cast<double>(std::max<std::uintmax_t>(1, parse_byte_size(fields[1]))));
+            std::size_t consumed = 0;
+            try {
+                second = std::stod(fields[2], &consumed);
+            } catch (const std::exception&) {
+                consumed = 0;
+            }
+            if (consumed != fields[2].size() || second < 0) {
+                throw std::invalid_argument("The lognormal size distribution needs SIGMA >= 0 in '" + spec + "'.");
+            }
+        } else {
+            throw std::invalid_argument("'" + spec + "' is not fixed:N, uniform:MIN:MAX or lognormal:MEDIAN:SIGMA.");
+        }
+    }
+
+    std::uintmax_t draw(std::mt19937_64& random) const {
+        double size = first;
+        if (kind == "uniform") {
+            size = std::uniform_real_distribution<double>(first, second)(random);
+        } else if (kind == "lognormal") {
+            size = std::lognormal_distribution<double>(first, second)(random);
+        }
+        return std::max<std::uintmax_t>(kMinFileSize, static_cast<std::uintmax_t>(size));
+    }
+
+private:
+    std::string kind;
+    double first = 0;
+    double second = 0;
+};
+
+// Helper function to write a file whose content is determined by its content id alone
+void write_content(const fs::path& path, std::uint64_t contentId, std::uintmax_t size, std::vector<char>& buffer) {
+    std::mt19937_64 random(contentId * 0x9E3779B97F4A7C15ull + 1);
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    for (std::uintmax_t written = 0; written < size;) {
+        const std::size_t chunk = static_cast<std::size_t>(std::min<std::uintmax_t>(buffer.size(), size - written));
+        for (std::size_t i = 0; i < chunk; i += sizeof(std::uint64_t)) {
+            const std::uint64_t word = random();
+            std::memcpy(buffer.data() + i, &word, std::min(sizeof(word), chunk - i));
+        }
+        file.write(buffer.data(), static_cast<std::streamsize>(chunk));
+        written += chunk;
+    }
+    if (!file) {
+        throw std::runtime_error("Cannot write " + path.string());
+    }
+}
+
+// Helper function to write the stats of a tree as a JSON record
+std::string stats_json(const TreeStats& stats) {
+    std::ostringstream json;
+    json << "{\"files\":" << stats.files << ",\"bytes\":" << stats.bytes << ",\"directories\":" << stats.directories
+         << ",\"hardlinks\":" << stats.hardlinks << ",\"duplicates\":" << stats.duplicates
+         << ",\"groups\":" << stats.groups << "}";
+    return json.str();
+}
+
+// Helper function to read a number field of a flat JSON record, or the fallback if it is absent
+double json_number(const std::string& record, const std::string& key, double fallback = -1) {
+    const std::string needle = "\"" + key + "\":";
+    const std::size_t position = record.find(needle);
+    if (position == std::string::npos) {
+        return fallback;
+    }
+    return std::strtod(record.c_str() + position + needle.size(), nullptr);
+}
+
+// Helper function to read a string field of a flat JSON record
+std::string json_string(const std::string& record, const std::string& key) {
+    const std::string needle = "\"" + key + "\":\"";
+    const std::size_t position = record.find(needle);
+    if (position == std::string::npos) {
+        return std::string();
+    }
+    const std::size_t begin = position + needle.size();
+    return record.substr(begin, record.find('"', begin) - begin);
+}
+
+/**
+ * @brief Generates the tree described by the spec under root, replacing anything there.
+ * @details Directories are laid out as a balanced tree of the requested depth with files in its
+ *          leaves. Every path is, in this order of precedence, a hardlink to an earlier file, a copy
+ *          of an earlier content or a new content, so the duplicates rmdup has to find are known.
+ */
+TreeStats generate_tree(const fs::path& root, const TreeSpec& spec) {
+    if (spec.files == 0 || spec.filesPerDir == 0) {
+        throw std::invalid_argument("A tree needs at least one file and one file per directory.");
+    }
+    const SizeDistribution distribution(spec.sizes);
+    std::mt19937_64 random(spec.seed);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+
+    fs::remove_all(root);
+    fs::create_directories(root);
+    TreeStats stats;
+    stats.directories = (spec.files + spec.filesPerDir - 1) / spec.filesPerDir;
+    std::size_t fanout = 1;
+    while (spec.depth > 0 && std::pow(static_cast<double>(fanout), spec.depth) < static_cast<double>(stats.directories)) {
+        ++fanout;
+    }
+
+    struct Content {
+        std::uintmax_t size;
+        std::size_t inodes;
+    };
+    std::vector<Content> contents;
+    std::vector<std::pair<fs::path, std::size_t>> regularFiles; // Path of every inode and its content
+    std::vector<char> buffer(1 << 20);
+    for (std::size_t i = 0; i < spec.files; ++i) {
+        const std::size_t directory = i / spec.filesPerDir;
+        fs::path parent = root;
+        for (std::size_t level = 0, rest = directory; level < spec.depth; ++level, rest /= fanout) {
+            parent /= "d" + std::to_string(rest % fanout);
+        }
+        if (i % spec.filesPerDir == 0) {
+            fs::create_directories(parent);
+        }
+        const fs::path path = parent / ("f" + std::to_string(i));
+
+        const double roll = chance(random);
+        if (!regularFiles.empty() && roll < spec.hardlinks) {
+            const auto& target = regularFiles[std::uniform_int_distribution<std::size_t>(0, regularFiles.size() - 1)(random)];
+            fs::create_hard_link(target.first, path);
+            stats.bytes += contents[target.second].size;
+            ++stats.hardlinks;
+        } else if (!contents.empty() && roll < spec.hardlinks + spec.duplicates) {
+            const std::size_t content = std::uniform_int_distribution<std::size_t>(0, contents.size() - 1)(random);
+            write_content(path, spec.seed * 1000003 + content, contents[content].size, buffer);
+            if (contents[content].inodes++ == 1) {
+                ++stats.groups;
+            }
+            ++stats.duplicates;
+            stats.bytes += contents[content].size;
+            regularFiles.emplace_back(path, content);
+        } else {
+            std::uintmax_t size = distribution.draw(random);
+            if (!contents.empty() && chance(random) < spec.sizeCollisions) {
+                size = contents[std::uniform_int_distribution<std::size_t>(0, contents.size() - 1)(random)].size;
+            }
+            write_content(path, spec.seed * 1000003 + contents.size(), size, buffer);
+            regularFiles.emplace_back(path, contents.size());
+            contents.push_back({size, 1});
+            stats.bytes += size;
+        }
+        ++stats.files;
+    }
+    return stats;
+}
+
+/**
+ * @brief Generates the tree unless the one already at root was generated from the same spec.
+ * @details The spec and the stats are kept next to the tree, not inside it where rmdup would see them.
+ */
+TreeStats prepare_tree(const fs::path& root, const TreeSpec& spec) {
+    const fs::path manifest = root.string() + ".manifest";
+    std::ifstream existing(manifest);
+    std::string described;
+    std::string statsLine;
+    if (existing && std::getline(existing, described) && std::getline(existing, statsLine)
+            && described == spec.describe() && fs::is_directory(root)) {
+        TreeStats stats;
+        stats.files = static_cast<std::size_t>(json_number(statsLine, "files"));
+        stats.bytes = static_cast<std::uintmax_t>(json_number(statsLine, "bytes"));
+        stats.directories = static_cast<std::size_t>(json_number(statsLine, "directories"));
+        stats.hardlinks = static_cast<std::size_t>(json_number(statsLine, "hardlinks"));
+        stats.duplicates = static_cast<std::size_t>(json_number(statsLine, "duplicates"));
+        stats.groups = static_cast<std::size_t>(json_number(statsLine, "groups"));
+        return stats;
+    }
+    existing.close();
+
+    fs::remove(manifest);
+    const TreeStats stats = generate_tree(root, spec);
+    std::ofstream(manifest, std::ios::trunc) << spec.describe() << '\n' << stats_json(stats) << '\n';
+    return stats;
+}
+
+/**
+ * @brief Outcome of one rmdup run.
+ */
+struct RunResult {
+    double wallSeconds = 0;        // Time from start to exit
+    std::uintmax_t peakRss = 0;    // Largest resident set of the process in bytes
+    std::string summary;           // The summary record of the NDJSON report
+};
+
+#if PDCPP_HAS_POSIX_IO
+// Helper function to run rmdup on a tree with an NDJSON report and measure it
+RunResult run_rmdup(const std::string& rmdup, const fs::path& root, const std::vector<std::string>& extraArguments,
+                    const fs::path& reportPath) {
+    std::vector<std::string> arguments = {rmdup, root.string(), "--format=ndjson"};
+    arguments.insert(arguments.end(), extraArguments.begin(), extraArguments.end());
+    std::vector<char*> argv;
+    for (auto& argument : arguments) {
+        argv.push_back(&argument[0]);
+    }
+    argv.push_back(nullptr);
+
+    const auto start = std::chrono::steady_clock::now();
+    const pid_t child = ::fork();
+    if (child < 0) {
+        throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+    }
+    if (child == 0) {
+        const int report = ::open(reportPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        const int null = ::open("/dev/null", O_WRONLY);
+        if (report < 0 || null < 0 || ::dup2(report, STDOUT_FILENO) < 0 || ::dup2(null, STDERR_FILENO) < 0) {
+            ::_exit(127);
+        }
+        ::execv(argv[0], argv.data());
+        ::_exit(127);
+    }
+    int status = 0;
+    struct rusage usage {};
+    if (::wait4(child, &status, 0, &usage) < 0) {
+        throw std::runtime_error(std::string("wait4 failed: ") + std::strerror(errno));
+    }
+    RunResult result;
+    result.wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        throw std::runtime_error(rmdup + " failed on " + root.string() + " with status " + std::to_string(status));
+    }
+#if defined(__APPLE__)
+    result.peakRss = static_cast<std::uintmax_t>(usage.ru_maxrss);
+#else
+    result.peakRss = static_cast<std::uintmax_t>(usage.ru_maxrss) * 1024;
+#endif
+
+    std::ifstream report(reportPath);
+    std::string line;
+    while (std::getline(report, line)) {
+        if (json_string(line, "type") == "summary") {
+            result.summary = line;
+        }
+    }
+    return result;
+}
+#endif
+
+// Helper function to read the baseline record of a scenario, empty if there is none
+std::string find_baseline(const fs::path& baselinePath, const std::string& scenario) {
+    std::ifstream baseline(baselinePath);
+    std::string line;
+    while (std::getline(baseline, line)) {
+        if (json_string(line, "scenario") == scenario) {
+            return line;
+        }
+    }
+    return std::string();
+}
+
+// Helper function to replace the baseline record of a scenario, keeping those of the others
+void store_baseline(const fs::path& baselinePath, const std::string& scenario, const std::string& record) {
+    std::vector<std::string> lines;
+    {
+        std::ifstream baseline(baselinePath);
+        std::string line;
+        while (std::getline(baseline, line)) {
+            if (!line.empty() && json_string(line, "scenario") != scenario) {
+                lines.push_back(line);
+            }
+        }
+    }
+    lines.push_back(record);
+    std::sort(lines.begin(), lines.end());
+    const fs::path temporary = baselinePath.string() + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        for (const auto& line : lines) {
+            out << line << '\n';
+        }
+        if (!out) {
+            throw std::runtime_error("Cannot write " + temporary.string());
+        }
+    }
+    fs::rename(temporary, baselinePath);
+}
+
+void print_usage(const char* appName) {
+    std::cerr << "Usage: " << appName << " generate <directory> [tree options]" << std::endl;
+    std::cerr << "       " << appName << " run <scenario> --rmdup=PATH --work=DIR [tree options] [--runs=N]" << std::endl;
+    std::cerr << "           [--baseline=FILE [--threshold=R] [--update-baseline]] [-- rmdup arguments]" << std::endl;
+    std::cerr << std::endl;
+    std::cerr << "Tree options:" << std::endl;
+    std::cerr << "  --files=N            Paths created, hardlinks included (default 10000)" << std::endl;
+    std::cerr << "  --sizes=D            fixed:N, uniform:MIN:MAX or lognormal:MEDIAN:SIGMA (default lognormal:4K:1.5)" << std::endl;
+    std::cerr << "  --duplicates=R       Share of paths that copy an earlier file (default 0.25)" << std::endl;
+    std::cerr << "  --hardlinks=R        Share of paths that link to an earlier file (default 0)" << std::endl;
+    std::cerr << "  --size-collisions=R  Share of new contents that reuse an earlier size (default 0)" << std::endl;
+    std::cerr << "  --depth=N            Depth of the directories holding the files (default 3)" << std::endl;
+    std::cerr << "  --files-per-dir=N    Paths per directory (default 100)" << std::endl;
+    std::cerr << "  --seed=N             Seed of the layout and the content (default 1)" << std::endl;
+    std::cerr << "Run options:" << std::endl;
+    std::cerr << "  --runs=N             Measured runs; the fastest wall time and the largest RSS count (default 3)" << std::endl;
+    std::cerr << "  --baseline=FILE      NDJSON baseline with one record per scenario" << std::endl;
+    std::cerr << "  --threshold=R        Relative regression tolerated before the run fails (default 0.25)" << std::endl;
+    std::cerr << "  --update-baseline    Record this run as the baseline of the scenario instead of comparing" << std::endl;
+}
+
+// Helper function to match "--name=value"
+bool match_option(const std::string& argument, const std::string& name, std::string& value) {
+    if (argument.compare(0, name.size() + 1, name + "=") == 0) {
+        value = argument.substr(name.size() + 1);
+        return true;
+    }
+    return false;
+}
+
+// Helper function to consume a tree option, returns false if the argument is not one
+bool parse_tree_option(const std::string& argument, TreeSpec& spec) {
+    std::string value;
+    if (match_option(argument, "--files", value)) {
+        spec.files = static_cast<std::size_t>(parse_byte_size(value));
+    } else if (match_option(argument, "--sizes", value)) {
+        SizeDistribution check(value);
+        (void)check;
+        spec.sizes = value;
+    } else if (match_option(argument, "--duplicates", value)) {
+        spec.duplicates = parse_ratio(value);
+    } else if (match_option(argument, "--hardlinks", value)) {
+        spec.hardlinks = parse_ratio(value);
+    } else if (match_option(argument, "--size-collisions", value)) {
+        spec.sizeCollisions = parse_ratio(value);
+    } else if (match_option(argument, "--depth", value)) {
+        spec.depth = static_cast<unsigned int>(std::stoul(value));
+    } else if (match_option(argument, "--files-per-dir", value)) {
+        spec.filesPerDir = static_cast<std::size_t>(parse_byte_size(value));
+    } else if (match_option(argument, "--seed", value)) {
+        spec.seed = std::stoull(value);
+    } else {
+        return false;
+    }
+    if (spec.duplicates + spec.hardlinks > 1) {
+        throw std::invalid_argument("The duplicate and hardlink shares add up to more than 1.");
+    }
+    return true;
+}
+
+int generate_main(int argc, char* argv[]) {
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    TreeSpec spec;
+    for (int i = 3; i < argc; ++i) {
+        if (!parse_tree_option(argv[i], spec)) {
+            std::cerr << "Error: '" << argv[i] << "' is an unknown command-line argument." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    const TreeStats stats = generate_tree(argv[2], spec);
+    std::cout << stats_json(stats) << std::endl;
+    return EXIT_SUCCESS;
+}
+
+int run_main(int argc, char* argv[]) {
+#if PDCPP_HAS_POSIX_IO
+    if (argc < 3) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const std::string scenario = argv[2];
+    TreeSpec spec;
+    std::string rmdup;
+    fs::path work;
+    fs::path baselinePath;
+    double threshold = 0.25;
+    unsigned int runs = 3;
+    bool updateBaseline = false;
+    std::vector<std::string> extraArguments;
+    for (int i = 3; i < argc; ++i) {
+        const std::string argument = argv[i];
+        std::string value;
+        if (argument == "--") {
+            extraArguments.assign(argv + i + 1, argv + argc);
+            break;
+        } else if (parse_tree_option(argument, spec)) {
+            continue;
+        } else if (match_option(argument, "--rmdup", value)) {
+            rmdup = value;
+        } else if (match_option(argument, "--work", value)) {
+            work = value;
+        } else if (match_option(argument, "--baseline", value)) {
+            baselinePath = value;
+        } else if (match_option(argument, "--threshold", value)) {
+            threshold = std::stod(value);
+        } else if (match_option(argument, "--runs", value)) {
+            runs = std::max(1u, static_cast<unsigned int>(std::stoul(value)));
+        } else if (argument == "--update-baseline") {
+            updateBaseline = true;
+        } else {
+            std::cerr << "Error: '" << argument << "' is an unknown command-line argument." << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (rmdup.empty() || work.empty()) {
+        std::cerr << "Error: 'run' needs --rmdup and --work." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    fs::create_directories(work);
+    const fs::path root = work / scenario;
+    const auto generationStart = std::chrono::steady_clock::now();
+    const TreeStats stats = prepare_tree(root, spec);
+    std::cout << "Scenario " << scenario << ": " << stats_json(stats) << " ready after "
+              << std::chrono::duration<double>(std::chrono::steady_clock::now() - generationStart).count() << " s" << std::endl;
+
+    // The first run warms the page cache, so every measured run reads the same way
+    const fs::path reportPath = work / (scenario + ".report.ndjson");
+    RunResult best = run_rmdup(rmdup, root, extraArguments, reportPath);
+    best.wallSeconds = 0;
+    for (unsigned int r = 0; r < runs; ++r) {
+        const RunResult result = run_rmdup(rmdup, root, extraArguments, reportPath);
+        if (best.wallSeconds == 0 || result.wallSeconds < best.wallSeconds) {
+            best.wallSeconds = result.wallSeconds;
+        }
+        best.peakRss = std::max(best.peakRss, result.peakRss);
+        best.summary = result.summary;
+    }
+
+    // The numbers only count if the duplicates planted in the tree were found
+    bool failed = false;
+    const double foundDuplicates = json_number(best.summary, "duplicates");
+    const double foundGroups = json_number(best.summary, "groups");
+    if (foundDuplicates != static_cast<double>(stats.duplicates) || foundGroups != static_cast<double>(stats.groups)) {
+        std::cerr << "FAIL: expected " << stats.duplicates << " duplicates in " << stats.groups << " groups, rmdup reported "
+                  << best.summary << std::endl;
+        failed = true;
+    }
+
+    std::ostringstream record;
+    record.precision(6);
+    record << "{\"scenario\":\"" << scenario << "\",\"files\":" << stats.files << ",\"bytes\":" << stats.bytes
+           << ",\"wall_seconds\":" << best.wallSeconds
+           << ",\"files_per_second\":" << static_cast<double>(stats.files) / best.wallSeconds
+           << ",\"bytes_per_second\":" << static_cast<double>(stats.bytes) / best.wallSeconds
+           << ",\"peak_rss_bytes\":" << best.peakRss << "}";
+    std::cout << record.str() << std::endl;
+
+    if (baselinePath.empty()) {
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (updateBaseline) {
+        if (!failed) {
+            store_baseline(baselinePath, scenario, record.str());
+            std::cout << "Baseline of " << scenario << " updated in " << baselinePath.string() << std::endl;
+        }
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    const std::string baseline = find_baseline(baselinePath, scenario);
+    if (baseline.empty()) {
+        std::cout << "No baseline for " << scenario << " in " << baselinePath.string()
+                  << ", record one with --update-baseline." << std::endl;
+        return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    if (json_number(baseline, "files") != static_cast<double>(stats.files)
+            || json_number(baseline, "bytes") != static_cast<double>(stats.bytes)) {
+        std::cerr << "FAIL: the baseline of " << scenario << " was recorded on a different tree, update it." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Times and memory regress upwards, rates downwards
+    struct Metric {
+        const char* key;
+        bool higherIsBetter;
+    };
+    for (const Metric& metric : {Metric{"wall_seconds", false}, Metric{"files_per_second", true},
+                                 Metric{"bytes_per_second", true}, Metric{"peak_rss_bytes", false}}) {
+        const double reference = json_number(baseline, metric.key);
+        const double current = json_number(record.str(), metric.key);
+        if (reference <= 0) {
+            continue;
+        }
+        const double change = (current - reference) / reference;
+        const bool regressed = metric.higherIsBetter ? change < -threshold : change > threshold;
+        std::cout << (regressed ? "REGRESSION " : "ok ") << metric.key << ": " << current << " against " << reference
+                  << " (" << (change >= 0 ? "+" : "") << change * 100 << "%)" << std::endl;
+        failed = failed || regressed;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+#else
+    (void)argc;
+    std::cerr << argv[0] << ": measuring rmdup needs a POSIX system." << std::endl;
+    return EXIT_FAILURE;
+#endif
+}
+
+int main(int argc, char* argv[]) {
+    const std::string command = argc > 1 ? argv[1] : "";
+    try {
+        if (command == "generate") {
+            return generate_main(argc, argv);
+        } else if (command == "run") {
+            return run_main(argc, argv);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+}
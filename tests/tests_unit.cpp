@@ -25,6 +25,31 @@
  *
  */
 #include "../src/PurgeDuplicates.hpp"
+#include "../src/ProgressRenderer.hpp"
+#include "../src/ReadScheduler.hpp"
+#include "../src/ReferenceIndex.hpp"
+#include "../src/ReportWriter.hpp"
+#include "../src/ContentComparer.hpp"
+#include "../src/Deduplicator.hpp"
+#include "../src/DigestTable.hpp"
+#include "../src/ExternalSorter.hpp"
+#include "../src/FileReader.hpp"
+#include "../src/FileWalker.hpp"
+#include "../src/HashCache.hpp"
+#include "../src/PathStore.hpp"
+#include "../src/ScanStats.hpp"
+#include "../src/Hasher.hpp"
+#include "../src/UringReader.hpp"
+#include "../src/WorkerPool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
 #include <filesystem>
 #include <cassert>
 #include <exception>
@@ -48,6 +73,36 @@ void test_main_argument_parsing() {
     std::cout << "Test Passed: Command-line argument parsing works correctly." << std::endl;
 }
 
+void test_byte_sizes() {
+    try {
+        assert(ScanOptions::parseByteSize("4096") == 4096);
+        assert(ScanOptions::parseByteSize("64K") == 64 * 1024);
+        assert(ScanOptions::parseByteSize("16m") == 16u << 20);
+        assert(ScanOptions::parseByteSize("1G") == 1u << 30);
+
+        // Signs, blanks and values that overflow once scaled are rejected instead of wrapping around
+        const std::string tooLarge = std::to_string(std::numeric_limits<std::size_t>::max() >> 9) + "K";
+        for (const std::string& value : {std::string("-1"), std::string("-4K"), std::string("+8"), std::string(" 8"),
+                                         std::string(""), std::string("K"), std::string("8T"), tooLarge,
+                                         std::string("99999999999999999999999"),
+                                         std::to_string(std::numeric_limits<std::size_t>::max()) + "G"}) {
+            bool rejected = false;
+            try {
+                ScanOptions::parseByteSize(value);
+            } catch (const std::invalid_argument&) {
+                rejected = true;
+            }
+            assert(rejected);
+        }
+        assert(ScanOptions::parseByteSize(std::to_string(std::numeric_limits<std::size_t>::max() >> 10) + "K")
+               == (std::numeric_limits<std::size_t>::max() >> 10) << 10);
+
+        std::cout << "Test Passed: Byte sizes are parsed with suffixes and checked for sign and overflow." << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
 void test_generate_hash() {
     // Generate a hash for a mock file
     try {
@@ -131,6 +186,1421 @@ void test_identify_and_remove_duplicates() {
     }
 }
 
+void test_same_size_distinct_files() {
+    try {
+        const std::string testDir = "test_same_size_distinct";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directory(testDir);
+
+        // Same size, different content: must survive the size filter and the hash comparison
+        std::string file1 = testDir + "/file1.txt";
+        std::string file2 = testDir + "/file2.txt";
+        // Unique size: skipped by the size filter without being read
+        std::string file3 = testDir + "/file3.txt";
+
+        std::ofstream(file1) << "Content AAAA";
+        std::ofstream(file2) << "Content BBBB";
+        std::ofstream(file3) << "Content with a unique size";
+
+        PurgeDuplicates pd(testDir, false, true);
+        pd.execute();
+
+        assert(fs::exists(file1));
+        assert(fs::exists(file2));
+        assert(fs::exists(file3));
+
+        std::cout << "Test Passed: Files sharing a size but not content are preserved." << std::endl;
+
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_partial_hash_tiers() {
+    try {
+        const std::string testDir = "test_partial_hash_tiers";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directory(testDir);
+
+        // A file no larger than two sample blocks is hashed in full by the partial hash
+        const std::string smallFile = testDir + "/small.txt";
+        std::ofstream(smallFile) << "Small content";
+        assert(PurgeDuplicates::generatePartialHash(smallFile, fs::file_size(smallFile), 4096)
+               == PurgeDuplicates::generateHash(smallFile));
+
+        // Same size, same head and tail, different middle: only the full hash can tell them apart
+        const std::string file1 = testDir + "/file1.bin";
+        const std::string file2 = testDir + "/file2.bin";
+        const std::string file3 = testDir + "/file3.bin";
+        std::string content(64 * 1024, 'x');
+        std::ofstream(file1, std::ios::binary) << content;
+        std::ofstream(file3, std::ios::binary) << content;
+        content[content.size() / 2] = 'y';
+        std::ofstream(file2, std::ios::binary) << content;
+
+        assert(PurgeDuplicates::generatePartialHash(file1, content.size(), 512)
+               == PurgeDuplicates::generatePartialHash(file2, content.size(), 512));
+        assert(PurgeDuplicates::generateHash(file1) != PurgeDuplicates::generateHash(file2));
+
+        ScanOptions options;
+        options.liveRun = true;
+        options.sampleBlockSize = 512;
+        PurgeDuplicates pd(testDir, options);
+        pd.execute();
+
+        assert(fs::exists(smallFile));
+        assert(fs::exists(file2));
+        assert(fs::exists(file1) != fs::exists(file3)); // One duplicate should remain
+
+        std::cout << "Test Passed: Partial and full hash tiers split candidate groups correctly." << std::endl;
+
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_digest_table() {
+    // Digests differing only past the bytes used for hashing and tagging must stay apart
+    std::vector<Digest> digests(3000);
+    for (size_t i = 0; i < digests.size(); ++i) {
+        digests[i].length = 64;
+        digests[i].bytes[0] = static_cast<std::uint8_t>(i % 1000 % 3);
+        digests[i].bytes[63] = static_cast<std::uint8_t>(i % 1000 / 7);
+        digests[i].bytes[62] = static_cast<std::uint8_t>(i % 1000 % 7);
+    }
+
+    DigestTable table(digests);
+    table.reset(4);
+    for (std::uint32_t i = 0; i < digests.size(); ++i) {
+        // Every digest repeats each 1000 entries, growing the table on the way
+        const std::uint32_t first = table.findOrInsert(i);
+        assert(first == i % 1000);
+        assert(digests[first] == digests[i]);
+    }
+    assert(table.size() == 1000);
+    assert(digests[5].toHex().size() == 128);
+    assert(digests[5].toHex().substr(0, 2) == "02");
+
+    std::cout << "Test Passed: Digest table finds equal digests and keeps distinct ones apart." << std::endl;
+}
+
+void test_worker_pool() {
+    WorkerPool pool(4);
+    assert(pool.jobs() == 4);
+
+    // Every index is visited exactly once
+    std::vector<std::atomic<int>> visits(10000);
+    pool.parallelFor(visits.size(), [&](size_t i) { ++visits[i]; });
+    for (const auto& count : visits) {
+        assert(count.load() == 1);
+    }
+
+    // The pool is reusable and exceptions escape parallelFor once all items ran
+    std::atomic<size_t> processed{0};
+    bool thrown = false;
+    try {
+        pool.parallelFor(100, [&](size_t i) {
+            ++processed;
+            if (i == 42) {
+                throw std::runtime_error("task failure");
+            }
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(processed.load() == 100);
+
+    // Tasks spawning tasks: a binary tree of depth 10 has 2047 nodes
+    std::atomic<int> nodes{0};
+    std::function<void(WorkerPool::TaskGroup&, int)> visit = [&](WorkerPool::TaskGroup& group, int depth) {
+        ++nodes;
+        if (depth < 10) {
+            for (int child = 0; child < 2; ++child) {
+                group.spawn([&, depth](WorkerPool::TaskGroup& spawnedIn) { visit(spawnedIn, depth + 1); });
+            }
+        }
+    };
+    pool.run([&](WorkerPool::TaskGroup& group) { visit(group, 0); });
+    assert(nodes.load() == 2047);
+
+    thrown = false;
+    try {
+        pool.run([](WorkerPool::TaskGroup& group) {
+            group.spawn([](WorkerPool::TaskGroup&) { throw std::runtime_error("spawned task failed"); });
+        });
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    assert(WorkerPool::resolveJobs(0) >= 1);
+    std::cout << "Test Passed: Worker pool runs every item once and propagates errors." << std::endl;
+}
+
+void test_file_walker() {
+    try {
+        const std::string testDir = "test_file_walker";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directories(testDir + "/subdir/nested");
+        std::ofstream(testDir + "/a.txt") << "12345";
+        std::ofstream(testDir + "/subdir/b.txt") << "123";
+        std::ofstream(testDir + "/subdir/nested/c.txt") << "";
+
+        size_t files = 0;
+        std::uintmax_t bytes = 0;
+        FileWalker walker(testDir);
+        walker.walk([&](FileEntry&& entry) {
+            ++files;
+            bytes += entry.size;
+        }, [](const std::string&, const std::string&) {
+            assert(false && "Unexpected walk error.");
+        });
+
+        assert(files == 3);
+        assert(bytes == 8);
+
+        // Links to files are listed like the files, links to directories and dangling links are not followed
+        fs::create_symlink("a.txt", testDir + "/link.txt");
+        fs::create_directory_symlink("subdir", testDir + "/linkdir");
+        fs::create_symlink("missing.txt", testDir + "/dangling.txt");
+        for (int i = 0; i < 20; ++i) {
+            const std::string wide = testDir + "/wide/" + std::to_string(i);
+            fs::create_directories(wide);
+            std::ofstream(wide + "/f.txt") << i;
+        }
+
+        // A parallel walk finds the same files as a sequential one and never calls the sinks concurrently
+        std::vector<std::string> sequential;
+        walker.walk([&](FileEntry&& entry) { sequential.push_back(entry.path); },
+                    [](const std::string&, const std::string&) { assert(false && "Unexpected walk error."); });
+        std::vector<std::string> parallel;
+        std::atomic<int> inSink{0};
+        WorkerPool pool(4);
+        walker.walk([&](FileEntry&& entry) {
+            assert(++inSink == 1);
+            parallel.push_back(entry.path);
+            --inSink;
+        }, [](const std::string&, const std::string&) {
+            assert(false && "Unexpected walk error.");
+        }, pool);
+        std::sort(sequential.begin(), sequential.end());
+        std::sort(parallel.begin(), parallel.end());
+        assert(sequential.size() == 24);
+        assert(sequential == parallel);
+        assert(std::count(sequential.begin(), sequential.end(), testDir + "/link.txt") == 1);
+
+        // An unreadable directory is reported and skipped, the rest of the tree is still walked
+        fs::create_directory(testDir + "/locked");
+        std::ofstream(testDir + "/locked/hidden.txt") << "hidden";
+        fs::permissions(testDir + "/locked", fs::perms::none);
+        size_t reachable = 0;
+        size_t errors = 0;
+        walker.walk([&](FileEntry&&) { ++reachable; },
+                    [&](const std::string& path, const std::string&) {
+                        assert(path == testDir + "/locked");
+                        ++errors;
+                    }, pool);
+        fs::permissions(testDir + "/locked", fs::perms::owner_all);
+        // Privileged users can read the directory anyway
+        assert((errors == 1 && reachable == 24) || (errors == 0 && reachable == 25));
+        std::cout << "Test Passed: File walker streams every regular file once." << std::endl;
+
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_read_backends() {
+    try {
+        const std::string testFile = "test_read_backends.bin";
+        std::string content(3 * 1024 * 1024 + 123, '\0');
+        for (size_t i = 0; i < content.size(); ++i) {
+            content[i] = static_cast<char>(i * 31 % 251);
+        }
+        std::ofstream(testFile, std::ios::binary) << content;
+
+        // Every backend and buffer size must feed the digest the same bytes
+        const std::string expectedHash = PurgeDuplicates::generateHash(testFile);
+        for (ReadBackend backend : {ReadBackend::Auto, ReadBackend::Stream, ReadBackend::Pread, ReadBackend::Mmap}) {
+            for (size_t bufferSize : {size_t(1000), size_t(4096), FileReader::kDefaultBufferSize}) {
+                FileReader reader(backend, bufferSize);
+                assert(PurgeDuplicates::generateHash(testFile, reader) == expectedHash);
+                assert(PurgeDuplicates::generatePartialHash(testFile, content.size(), 4096, reader)
+                       == PurgeDuplicates::generatePartialHash(testFile, content.size(), 4096));
+            }
+            assert(FileReader::parseBackend(FileReader::backendName(backend)) == backend);
+        }
+
+        // A range past the end of the file is an error
+        bool thrown = false;
+        try {
+            FileReader().readRanges(testFile, {{content.size() - 10, 20}}, [](const unsigned char*, size_t) {});
+        } catch (const std::ios_base::failure&) {
+            thrown = true;
+        }
+        assert(thrown);
+
+#if defined(PDCPP_FORCE_32BIT_PATH)
+        // A file too large to be mapped on a 32-bit platform is read in full instead of by its low bits
+        const std::string sparseFile = "test_read_backends_sparse.bin";
+        const std::uintmax_t sparseSize = FileReader::kMaxMappedSize + 2;
+        {
+            std::ofstream sparse(sparseFile, std::ios::binary | std::ios::trunc);
+            sparse.seekp(static_cast<std::streamoff>(sparseSize - 1));
+            sparse.put('e');
+        }
+        assert(fs::file_size(sparseFile) == sparseSize);
+        std::uintmax_t delivered = 0;
+        unsigned char last = 0;
+        FileReader(ReadBackend::Mmap).readFile(sparseFile, [&](const unsigned char* data, size_t length) {
+            delivered += length;
+            last = data[length - 1];
+        });
+        fs::remove(sparseFile);
+        assert(delivered == sparseSize && last == 'e');
+#endif
+
+        std::cout << "Test Passed: All read backends deliver identical content." << std::endl;
+        fs::remove(testFile);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_uring_engine() {
+    try {
+        const std::string testDir = "test_uring_engine";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directory(testDir);
+
+        std::vector<std::string> paths;
+        for (int i = 0; i < 300; ++i) {
+            paths.push_back(testDir + "/file" + std::to_string(i) + ".txt");
+            std::ofstream(paths.back()) << std::string(static_cast<size_t>(i) * 37, 'a' + i % 5);
+        }
+
+        if (UringReader::isSupported()) {
+            // Whole files and ranges must arrive complete and in order, failures only affect their own job
+            std::vector<UringReadJob> jobs;
+            for (const auto& path : paths) {
+                jobs.push_back({&path, {}});
+            }
+            jobs.push_back({&paths[100], {{10, 20}, {3000, 700}}});
+            const std::string missing = testDir + "/missing.txt";
+            jobs.push_back({&missing, {}});
+
+            std::vector<std::string> contents(jobs.size());
+            std::vector<std::string> errors(jobs.size());
+            size_t completed = 0;
+            UringReader reader(8, 100);
+            reader.run(jobs, [&](size_t job, const unsigned char* data, size_t length) {
+                contents[job].append(reinterpret_cast<const char*>(data), length);
+            }, [&](size_t job, const std::string& error) {
+                errors[job] = error;
+                ++completed;
+            });
+
+            assert(completed == jobs.size());
+            for (size_t i = 0; i < paths.size(); ++i) {
+                assert(errors[i].empty());
+                assert(contents[i] == std::string(i * 37, static_cast<char>('a' + i % 5)));
+            }
+            assert(contents[paths.size()] == std::string(720, 'a'));
+            assert(!errors[paths.size() + 1].empty());
+        } else {
+            std::cout << "io_uring is not available, only the fallback is tested." << std::endl;
+        }
+
+        // The engine either runs or falls back to synchronous reads, the result is the same
+        std::ofstream(testDir + "/copy.txt") << std::string(37, 'b');
+        ScanOptions options;
+        options.liveRun = true;
+        options.ioEngine = IoEngine::Uring;
+        PurgeDuplicates pd(testDir, options);
+        pd.execute();
+        assert(fs::exists(paths[1]) != fs::exists(testDir + "/copy.txt"));
+        assert(UringReader::parseEngine("uring") == IoEngine::Uring);
+
+        std::cout << "Test Passed: io_uring engine reads batches of files correctly." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_hash_cache() {
+    try {
+        const std::string testDir = "test_hash_cache";
+        const std::string cachePath = "test_hash_cache.bin";
+#if defined(PDCPP_FORCE_32BIT_PATH)
+        const std::string algorithm = "blake2s256";
+#else
+        const std::string algorithm = "blake2b512";
+#endif
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::remove(cachePath);
+        fs::create_directory(testDir);
+
+        const std::string large(20000, 'x');
+        std::ofstream(testDir + "/a.bin") << large;
+        std::ofstream(testDir + "/b.bin") << large;
+        std::string middleChanged = large;
+        middleChanged[10000] = 'y';
+        std::ofstream(testDir + "/c.bin") << middleChanged;
+
+        ScanOptions options;
+        options.cachePath = cachePath;
+        PurgeDuplicates(testDir, options).execute();
+        assert(fs::exists(cachePath));
+
+        std::vector<FileEntry> files;
+        FileWalker(testDir).walk([&](FileEntry&& file) { files.push_back(std::move(file)); },
+                                 [](const std::string&, const std::string&) { assert(false); });
+        assert(files.size() == 3);
+
+        {
+            // Every full digest of the first run is reused as long as the file is unchanged
+            HashCache foreign(cachePath, "sha256");
+            assert(foreign.size() == 0);
+            HashCache cache(cachePath, algorithm);
+            assert(cache.size() == 3);
+            for (const auto& file : files) {
+                Digest digest;
+                assert(cache.lookup(file, digest));
+                assert(digest.toHex() == PurgeDuplicates::generateHash(file.path));
+            }
+            assert(cache.hits() == 3);
+
+            // A changed file no longer matches its record
+            FileEntry changed = files[0];
+            changed.mtimeNs += 1;
+            Digest digest;
+            assert(!cache.lookup(changed, digest));
+        }
+
+        // Pruning without new records shrinks the file down to the records hit in this run
+        // while a concurrent run that mapped the old file still finds every record in it
+        const auto sizeBefore = fs::file_size(cachePath);
+        {
+            HashCache concurrent(cachePath, algorithm);
+            HashCache cache(cachePath, algorithm);
+            Digest digest;
+            assert(cache.lookup(files[1], digest));
+            cache.save(true);
+            assert(cache.size() == 1);
+            for (const auto& file : files) {
+                assert(concurrent.lookup(file, digest));
+                assert(digest.toHex() == PurgeDuplicates::generateHash(file.path));
+            }
+        }
+        assert(fs::file_size(cachePath) == sizeBefore - 2 * sizeof(HashCache::Record));
+        {
+            HashCache cache(cachePath, algorithm);
+            Digest digest;
+            assert(cache.size() == 1);
+            assert(cache.lookup(files[1], digest));
+            assert(!cache.lookup(files[0], digest));
+            cache.store(files[0], digest);
+            cache.save(false);
+            assert(cache.size() == 2);
+        }
+
+        // A corrupt cache is rebuilt, and an embedded scan hears about it through its listener only
+        std::ofstream(cachePath, std::ios::trunc) << "not a hash cache";
+        {
+            std::vector<std::string> errors;
+            ScanListener listener;
+            listener.onError = [&](const std::string& path, const std::string& message) {
+                assert(path == cachePath);
+                errors.push_back(message);
+            };
+            std::ostringstream captured;
+            std::streambuf* original = std::cerr.rdbuf(captured.rdbuf());
+            PurgeDuplicates(testDir, options, listener).execute();
+            std::cerr.rdbuf(original);
+            assert(captured.str().empty());
+            assert(errors.size() == 1 && errors[0].find("corrupt") != std::string::npos);
+            assert(HashCache(cachePath, algorithm).size() == 3);
+        }
+
+        // A new file of a cached size is still ruled out by its sample, not read in full and cached
+        std::string headChanged = large;
+        headChanged[0] = 'h';
+        std::ofstream(testDir + "/d.bin") << headChanged;
+        PurgeDuplicates(testDir, options).execute();
+        assert(HashCache(cachePath, algorithm).size() == 3);
+
+        // Pruning keeps the records of files that were walked but never looked up, like a unique size
+        std::ofstream(testDir + "/e.bin") << "same size twin";
+        std::ofstream(testDir + "/f.bin") << "same size twin";
+        PurgeDuplicates(testDir, options).execute();
+        fs::remove(testDir + "/f.bin");
+        ScanOptions pruning = options;
+        pruning.cachePrune = true;
+        PurgeDuplicates(testDir, pruning).execute();
+        {
+            FileEntry unique;
+            Digest digest;
+            assert(FileWalker::describe(testDir + "/e.bin", unique));
+            HashCache cache(cachePath, algorithm);
+            assert(cache.size() == 4 && cache.lookup(unique, digest));
+        }
+
+        std::cout << "Test Passed: Hash cache reuses, invalidates and compacts digests correctly." << std::endl;
+        fs::remove_all(testDir);
+        fs::remove(cachePath);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_hardlinks() {
+    try {
+        const std::string testDir = "test_hardlinks";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directory(testDir);
+
+        const std::string original = testDir + "/original.txt";
+        const std::string link = testDir + "/link.txt";
+        const std::string copy = testDir + "/copy.txt";
+        const std::string lonely = testDir + "/lonely.txt";
+        const std::string lonelyLink = testDir + "/lonely_link.txt";
+        std::ofstream(original) << "shared content";
+        std::ofstream(copy) << "shared content";
+        std::ofstream(lonely) << "nobody else has this";
+        fs::create_hard_link(original, link);
+        fs::create_hard_link(lonely, lonelyLink);
+
+        // Hardlinks to one inode are never duplicates of each other
+        PurgeDuplicates(testDir, true, true).execute();
+        assert(fs::exists(lonely) && fs::exists(lonelyLink));
+
+        // Either the copy goes, or every path of the hardlinked inode goes so that space is actually freed
+        assert(fs::exists(original) == fs::exists(link));
+        assert(fs::exists(original) != fs::exists(copy));
+
+        std::cout << "Test Passed: Hardlinked paths are collapsed into one file." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_hardlink_original_is_stable() {
+    try {
+        const std::string testDir = "test_hardlink_original_is_stable";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        for (const char* directory : {"/a", "/m", "/z"}) {
+            fs::create_directories(testDir + directory);
+        }
+        std::ofstream(testDir + "/a/x") << "shared content";
+        fs::create_hard_link(testDir + "/a/x", testDir + "/z/x");
+        std::ofstream(testDir + "/m/y") << "shared content";
+
+        // Whichever path of the inode the concurrent walk delivers first, its smallest one is kept
+        ScanOptions options;
+        options.jobs = 8;
+        for (int run = 0; run < 20; ++run) {
+            std::vector<DuplicateSet> groups;
+            PurgeDuplicates(testDir, options, ScanListener{[&](const DuplicateSet& set, const Digest*) {
+                groups.push_back(set);
+            }, nullptr}).execute();
+            assert(groups.size() == 1 && groups.front().original == testDir + "/a/x");
+            assert(groups.front().paths == std::vector<std::string>{testDir + "/m/y"});
+        }
+
+        options.liveRun = true;
+        PurgeDuplicates(testDir, options).execute();
+        assert(fs::exists(testDir + "/a/x") && fs::exists(testDir + "/z/x") && !fs::exists(testDir + "/m/y"));
+
+        std::cout << "Test Passed: The kept original of a hardlinked inode does not depend on the walk order." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_content_comparer() {
+    try {
+        const std::string testDir = "test_content_comparer";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directory(testDir);
+
+        // 150 files in three content classes interleaved, more than one window of open files,
+        // with differences at the very start, in a later chunk and in the last byte
+        std::vector<std::string> paths;
+        const std::string base(5000, 'q');
+        for (int i = 0; i < 150; ++i) {
+            std::string content = base;
+            if (i % 3 == 1) content[0] = 'a';
+            if (i % 3 == 2) content[4999] = 'z';
+            if (i == 149) content[2500] = 'm';
+            paths.push_back(testDir + "/file" + std::to_string(i));
+            std::ofstream(paths.back()) << content;
+        }
+        paths.push_back(testDir + "/missing");
+
+        std::vector<const std::string*> pointers;
+        for (const auto& path : paths) {
+            pointers.push_back(&path);
+        }
+        std::vector<std::string> errors;
+        const auto classes = ContentComparer(1000).split(pointers, 5000, errors);
+
+        assert(classes.size() == 4);
+        assert(classes[0].size() == 50 && classes[1].size() == 50 && classes[2].size() == 49);
+        assert(classes[3] == std::vector<size_t>{149});
+        for (size_t c = 0; c < 3; ++c) {
+            assert(classes[c].front() == c);
+            for (size_t position : classes[c]) {
+                assert(position % 3 == c);
+            }
+        }
+        assert(!errors[150].empty());
+
+        // A file that grew after the walk does not match the files its first bytes are equal to
+        const std::string kept = testDir + "/kept";
+        const std::string copy = testDir + "/copy";
+        const std::string grown = testDir + "/grown";
+        std::ofstream(kept) << base;
+        std::ofstream(copy) << base;
+        std::ofstream(grown) << base << "appended later";
+        const auto grownClasses = ContentComparer(1000).split({&kept, &grown, &copy}, 5000, errors);
+        assert((grownClasses == std::vector<std::vector<size_t>>{{0, 2}, {1}}));
+        assert(errors[0].empty() && errors[1].empty() && errors[2].empty());
+
+        std::cout << "Test Passed: Content comparer splits groups by their bytes." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_hash_algorithms() {
+    try {
+        const std::string testDir = "test_hash_algorithms";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directory(testDir);
+        std::ofstream(testDir + "/a.txt") << std::string(10000, 'k');
+        std::ofstream(testDir + "/b.txt") << std::string(10000, 'k');
+        std::ofstream(testDir + "/c.txt") << std::string(5000, 'k') + 'X' + std::string(4999, 'k');
+
+        bool threwUnknown = false;
+        try {
+            HashAlgorithm::byName("md4-but-faster");
+        } catch (const std::invalid_argument&) {
+            threwUnknown = true;
+        }
+        assert(threwUnknown);
+        assert(HashAlgorithm::byName("sha256").createHasher()->finish().length == 32);
+
+        // A reused hasher forgets abandoned and finished messages
+        const unsigned char message[] = "reused context";
+        Hasher& reused = HashAlgorithm::platformDefault().threadHasher();
+        reused.update(message, 6);
+        reused.reset();
+        reused.update(message, sizeof(message));
+        const Digest first = reused.finish();
+        reused.update(message, sizeof(message));
+        assert(reused.finish() == first);
+        const auto fresh = HashAlgorithm::platformDefault().createHasher();
+        fresh->update(message, sizeof(message));
+        assert(fresh->finish() == first);
+        assert(&HashAlgorithm::platformDefault().threadHasher() == &reused);
+
+        // Every algorithm built in must find the same duplicate, cryptographic or not
+        for (const auto& name : HashAlgorithm::names()) {
+            const std::string copy = testDir + "/copy.txt";
+            std::ofstream(copy) << std::string(10000, 'k');
+            ScanOptions options;
+            options.liveRun = true;
+            options.hashAlgorithm = name;
+            PurgeDuplicates(testDir, options).execute();
+            const int remaining = fs::exists(testDir + "/a.txt") + fs::exists(testDir + "/b.txt") + fs::exists(copy);
+            assert(remaining == 1);
+            assert(fs::exists(testDir + "/c.txt"));
+            if (!fs::exists(testDir + "/a.txt")) {
+                fs::copy_file(fs::exists(copy) ? copy : testDir + "/b.txt", testDir + "/a.txt");
+            }
+            if (!fs::exists(testDir + "/b.txt")) {
+                fs::copy_file(testDir + "/a.txt", testDir + "/b.txt");
+            }
+            fs::remove(copy);
+        }
+
+        std::cout << "Test Passed: Every built-in hash algorithm finds the same duplicates." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_compare_modes() {
+    try {
+        const std::string testDir = "test_compare_modes";
+        assert(ContentComparer::parseMode("bytes") == CompareMode::Bytes);
+        assert(ContentComparer::prefersBytes(2, 1ull << 40));
+        assert(!ContentComparer::prefersBytes(1000, 1 << 20));
+
+        for (CompareMode mode : {CompareMode::Hash, CompareMode::Bytes, CompareMode::Auto}) {
+            if (fs::exists(testDir)) {
+                fs::remove_all(testDir);
+            }
+            fs::create_directory(testDir);
+
+            // Same head and tail, the only difference is in the middle of a large file
+            std::string content(600000, 'r');
+            std::ofstream(testDir + "/one.bin") << content;
+            std::ofstream(testDir + "/two.bin") << content;
+            content[300000] = 's';
+            std::ofstream(testDir + "/three.bin") << content;
+
+            ScanOptions options;
+            options.liveRun = true;
+            options.compareMode = mode;
+            PurgeDuplicates(testDir, options).execute();
+            assert(fs::exists(testDir + "/one.bin") != fs::exists(testDir + "/two.bin"));
+            assert(fs::exists(testDir + "/three.bin"));
+        }
+
+        std::cout << "Test Passed: Hash and byte comparison modes find the same duplicates." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_read_order() {
+    try {
+        const std::string testDir = "test_read_order";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directory(testDir);
+        assert(ReadScheduler::parseOrder("extent") == ReadOrder::Extent);
+        assert(std::string(ReadScheduler::orderName(ReadOrder::Inode)) == "inode");
+
+        std::vector<FileEntry> files;
+        std::vector<size_t> indices;
+        for (int i = 0; i < 8; ++i) {
+            files.push_back({testDir + "/" + std::to_string(i) + ".bin", 0, 1, static_cast<std::uint64_t>(100 - i)});
+            indices.push_back(files.size() - 1);
+        }
+        WorkerPool pool(2);
+        ReadScheduler byInode(ReadOrder::Inode, testDir);
+        byInode.locate(files, indices, pool);
+        const std::vector<size_t> order = byInode.sort(files, {0, 3, 5});
+        assert((order == std::vector<size_t>{2, 1, 0}));
+        assert(ReadScheduler(ReadOrder::Discovery, testDir).sort(files, {0, 3, 5}) == (std::vector<size_t>{0, 1, 2}));
+
+        // Items are started in ascending order whatever the number of threads
+        std::vector<size_t> started;
+        std::mutex startedMutex;
+        WorkerPool(1).parallelForOrdered(50, [&](size_t i) {
+            std::lock_guard<std::mutex> lock(startedMutex);
+            started.push_back(i);
+        });
+        for (size_t i = 0; i < started.size(); ++i) {
+            assert(started[i] == i);
+        }
+
+        // Extent order finds the same duplicates, also where the file system forces a fallback to inodes
+        std::string content(20000, 'o');
+        std::ofstream(testDir + "/one.bin") << content;
+        std::ofstream(testDir + "/two.bin") << content;
+        content[10000] = 'p';
+        std::ofstream(testDir + "/three.bin") << content;
+        std::uint64_t offset = 0;
+        ReadScheduler::firstExtent(testDir + "/one.bin", offset);
+
+        ScanOptions options;
+        options.liveRun = true;
+        options.readOrder = ReadOrder::Extent;
+        PurgeDuplicates(testDir, options).execute();
+        assert(fs::exists(testDir + "/one.bin") && !fs::exists(testDir + "/two.bin"));
+        assert(fs::exists(testDir + "/three.bin"));
+
+        std::cout << "Test Passed: Reads are scheduled by disk location without changing the result." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_reflink_action() {
+    try {
+        const std::string testDir = "test_reflink_action";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directory(testDir);
+        assert(Deduplicator::parseAction("reflink") == DuplicateAction::Reflink);
+        assert(std::string(Deduplicator::actionName(DuplicateAction::Delete)) == "delete");
+
+        const std::string content(100000, 'x');
+        std::ofstream(testDir + "/a.bin") << content;
+        std::ofstream(testDir + "/b.bin") << content;
+        std::ofstream(testDir + "/c.bin") << std::string(100000, 'y');
+
+        // Sharing extents either succeeds completely or fails without touching the file
+        std::vector<std::uint64_t> shared;
+        std::vector<std::string> errors;
+        const std::string b = testDir + "/b.bin";
+        const std::string c = testDir + "/c.bin";
+        Deduplicator::shareExtents(testDir + "/a.bin", {&b, &c}, content.size(), shared, errors);
+        assert(shared.size() == 2 && errors.size() == 2);
+        assert(shared[0] == content.size() || !errors[0].empty());
+        assert(shared[1] == 0 && !errors[1].empty());
+
+        // A live run never removes a path
+        ScanOptions options;
+        options.liveRun = true;
+        options.action = DuplicateAction::Reflink;
+        PurgeDuplicates(testDir, options).execute();
+        assert(fs::exists(testDir + "/a.bin") && fs::exists(b) && fs::exists(c));
+        std::ifstream check(b);
+        assert(std::string(std::istreambuf_iterator<char>(check), {}) == content);
+
+        std::cout << "Test Passed: Reflink action keeps every path." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_hardlink_action() {
+    try {
+        const std::string testDir = "test_hardlink_action";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directories(testDir + "/sub");
+        const std::string content(50000, 'h');
+        std::ofstream(testDir + "/a.bin") << content;
+        std::ofstream(testDir + "/sub/b.bin") << content;
+        fs::create_hard_link(testDir + "/sub/b.bin", testDir + "/sub/b_alias.bin");
+        std::ofstream(testDir + "/sub/c.bin") << std::string(50000, 'i');
+
+        ScanOptions options;
+        options.action = DuplicateAction::Hardlink;
+        PurgeDuplicates(testDir, options).execute();
+        assert(!fs::equivalent(testDir + "/a.bin", testDir + "/sub/b.bin"));
+
+        // Every path of the duplicate, its own hardlinks included, now points at the original
+        options.liveRun = true;
+        PurgeDuplicates(testDir, options).execute();
+        assert(fs::equivalent(testDir + "/a.bin", testDir + "/sub/b.bin"));
+        assert(fs::equivalent(testDir + "/a.bin", testDir + "/sub/b_alias.bin"));
+        assert(!fs::equivalent(testDir + "/a.bin", testDir + "/sub/c.bin"));
+        size_t entries = 0;
+        for (const auto& entry : fs::directory_iterator(testDir + "/sub")) {
+            (void)entry;
+            ++entries;
+        }
+        assert(entries == 3);
+
+        // Errors are reported per file and leave it in place
+        const std::string missing = testDir + "/missing.bin";
+        const std::string original = testDir + "/a.bin";
+        const std::string replaced = testDir + "/sub/c.bin";
+        std::vector<std::string> errors;
+        Deduplicator::replaceWithHardlinks({{&replaced, &missing}}, errors);
+        assert(errors.size() == 1 && !errors[0].empty());
+        assert(fs::exists(replaced) && !fs::equivalent(original, replaced));
+        Deduplicator::removeFiles({&missing, &replaced}, errors);
+        assert(!errors[0].empty() && errors[1].empty() && !fs::exists(replaced));
+
+        std::cout << "Test Passed: Hardlink action replaces every path of a duplicate." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_report_writer() {
+    try {
+        assert(ReportWriter::parseFormat("ndjson") == ReportFormat::Ndjson);
+        assert(std::string(ReportWriter::formatName(ReportFormat::Binary)) == "binary");
+
+        // Records stay in the buffer until it fills up or the writer is flushed
+        std::ostringstream json;
+        const std::string kept = "dir/a \"quoted\"\n";
+        const std::string duplicate = "dir/b\\c";
+        {
+            ReportWriter writer(ReportFormat::Ndjson, json);
+            Digest digest;
+            digest.length = 2;
+            digest.bytes[0] = 0xab;
+            digest.bytes[1] = 0x01;
+            writer.group(&digest, 7, kept, {&duplicate});
+            assert(json.str().empty());
+            writer.action(DuplicateAction::Reflink, duplicate, 7, "");
+            writer.flush();
+            assert(json.str() == "{\"type\":\"group\",\"size\":7,\"digest\":\"ab01\",\"kept\":\"dir/a \\\"quoted\\\"\\n\","
+                                 "\"duplicates\":[\"dir/b\\\\c\"]}\n"
+                                 "{\"type\":\"action\",\"action\":\"reflink\",\"path\":\"dir/b\\\\c\",\"status\":\"ok\",\"bytes\":7}\n");
+        }
+
+        // Binary: magic, then type, payload length and payload
+        std::ostringstream binary;
+        {
+            ReportWriter writer(ReportFormat::Binary, binary);
+            writer.summary(5, 3, 2, 1, true);
+        }
+        const std::string bytes = binary.str();
+        assert(bytes.compare(0, 8, "RMDUPRP1") == 0);
+        assert(bytes[8] == 4 && bytes[9] == 33 && bytes[10] == 0);
+        assert(bytes.size() == 8 + 1 + 4 + 33 && bytes.back() == 1);
+
+        // A scan with --format=ndjson writes only records to stdout
+        const std::string testDir = "test_report_writer";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directory(testDir);
+        std::ofstream(testDir + "/a.txt") << "same";
+        std::ofstream(testDir + "/b.txt") << "same";
+        std::ostringstream captured;
+        std::streambuf* original = std::cout.rdbuf(captured.rdbuf());
+        try {
+            ScanOptions options;
+            options.reportFormat = ReportFormat::Ndjson;
+            PurgeDuplicates(testDir, options).execute();
+        } catch (...) {
+            std::cout.rdbuf(original);
+            throw;
+        }
+        std::cout.rdbuf(original);
+        std::istringstream lines(captured.str());
+        std::string line;
+        std::vector<std::string> records;
+        while (std::getline(lines, line)) {
+            assert(line.compare(0, 9, "{\"type\":\"") == 0);
+            records.push_back(line);
+        }
+        assert(records.size() == 3);
+        assert(records[1].find("\"kept\":\"" + testDir + "/a.txt\"") != std::string::npos);
+        assert(records[2].find("\"duplicates\":1") != std::string::npos);
+
+        std::cout << "Test Passed: Report writer streams NDJSON and binary records." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_progress_renderer() {
+    try {
+        ProgressRenderer::Snapshot snapshot;
+        snapshot.discoveredFiles = 2000;
+        snapshot.walkSeconds = 2.0;
+        assert(ProgressRenderer::render(snapshot) == "Scanning: 2000 files found (1000 files/s)");
+
+        // Half of the candidate bytes settled in 10 seconds leaves 10 seconds to go
+        snapshot.walking = false;
+        snapshot.resolvedFiles = 500;
+        snapshot.totalBytes = 200000000;
+        snapshot.resolvedBytes = 100000000;
+        snapshot.bytesRead = 50000000;
+        snapshot.hashSeconds = 10.0;
+        const std::string line = ProgressRenderer::render(snapshot);
+        assert(line.compare(0, 32, "[===============>              ]") == 0);
+        assert(line.find(" 50% 500/2000 files") != std::string::npos);
+        assert(line.find("47.7 MiB read, 5.0 MB/s") != std::string::npos);
+        assert(line.find("| 50 files/s |") != std::string::npos);
+        assert(line.find("ETA 00:10") != std::string::npos);
+
+        snapshot.resolvedBytes = snapshot.totalBytes;
+        assert(ProgressRenderer::render(snapshot).find("100% 500/2000 files") != std::string::npos);
+
+        // Nothing is drawn while disabled, a running renderer ends its line once stopped
+        std::ostringstream quiet;
+        ProgressRenderer(quiet, false).stop();
+        assert(quiet.str().empty());
+        std::ostringstream drawn;
+        {
+            ProgressRenderer renderer(drawn, true);
+            renderer.counters().discoveredFiles = 3;
+            renderer.finishWalk(0);
+            renderer.stop();
+            renderer.stop();
+        }
+        assert(drawn.str().find("100% 0/3 files") != std::string::npos);
+        assert(drawn.str().back() == '\n');
+
+        std::cout << "Test Passed: Progress renderer formats throughput and ETA." << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_external_sort() {
+    try {
+        // Spill files live in a private directory that goes away with everything in it
+        std::unique_ptr<SpillDirectory> directory = std::make_unique<SpillDirectory>();
+        const std::string directoryPath = directory->path();
+        assert((fs::status(directoryPath).permissions() & fs::perms::all) == fs::perms::owner_all);
+        const std::string prefix = directory->file("test-");
+
+        // One record per run forces an intermediate merge pass beyond kMaxMergeWidth runs
+        {
+            ExternalSorter sorter(prefix, SpillOrder::Size, 1);
+            const size_t count = ExternalSorter::kMaxMergeWidth + 44;
+            for (size_t i = 0; i < count; ++i) {
+                FileEntry file{"f" + std::to_string(i), (i * 7919) % 50, 1, i};
+                sorter.add({std::move(file), Digest(), {}});
+            }
+            assert(sorter.runsWritten() == count);
+            std::vector<SpillRecord> sorted;
+            sorter.merge([&](SpillRecord& record) { sorted.push_back(std::move(record)); });
+            assert(sorted.size() == count && sorter.size() == 0);
+            for (size_t i = 1; i < sorted.size(); ++i) {
+                assert(!ExternalSorter::less(SpillOrder::Size, sorted[i], sorted[i - 1]));
+            }
+        }
+
+        // Digest order keeps the hardlinks of a record and sorts equal digests by path
+        {
+            ExternalSorter sorter(prefix, SpillOrder::Digest, 1);
+            Digest low;
+            low.length = 1;
+            low.bytes[0] = 1;
+            Digest high = low;
+            high.bytes[0] = 2;
+            sorter.add({FileEntry{"b", 3}, high, {"b2", "b3"}});
+            sorter.add({FileEntry{"z", 3}, low, {}});
+            sorter.add({FileEntry{"a", 3}, high, {}});
+            std::vector<SpillRecord> sorted;
+            sorter.merge([&](SpillRecord& record) { sorted.push_back(std::move(record)); });
+            assert(sorted.size() == 3);
+            assert(sorted[0].file.path == "z" && sorted[1].file.path == "a" && sorted[2].file.path == "b");
+            assert(sorted[2].digest == high && sorted[2].links == std::vector<std::string>({"b2", "b3"}));
+        }
+
+        {
+            DuplicateSpool spool(prefix + "spool");
+            for (size_t i = 0; i < 10; ++i) {
+                spool.append({"original" + std::to_string(i), i, {"dup", "link"}, {0}});
+            }
+            std::vector<DuplicateSet> sets;
+            size_t chunks = 0;
+            spool.replay(1, [&](std::vector<DuplicateSet>& chunk) {
+                ++chunks;
+                sets.insert(sets.end(), chunk.begin(), chunk.end());
+            });
+            assert(chunks == 10 && sets.size() == 10);
+            assert(sets[9].original == "original9" && sets[9].size == 9 && sets[9].paths.size() == 2);
+            assert(sets[9].members == std::vector<size_t>({0}));
+        }
+        assert(!fs::exists(prefix + "0") && !fs::exists(prefix + "spool"));
+
+        // A file planted under the name of a run is never opened, let alone truncated through a link
+        const std::string victim = directory->file("victim");
+        std::ofstream(victim) << "keep me";
+        fs::create_symlink(victim, directory->file("planted-0"));
+        {
+            ExternalSorter sorter(directory->file("planted-"), SpillOrder::Size, 1);
+            bool refused = false;
+            try {
+                sorter.add({FileEntry{"f", 1}, Digest(), {}});
+            } catch (const std::runtime_error&) {
+                refused = true;
+            }
+            assert(refused);
+        }
+        std::string kept;
+        std::getline(std::ifstream(victim), kept);
+        assert(kept == "keep me");
+        directory.reset();
+        assert(!fs::exists(directoryPath));
+
+        // A scan in a few kilobytes finds the same duplicates as one held in memory: many sizes, a size
+        // class too large for a batch, and hardlinks on both sides
+        const std::string testDir = "test_external_sort";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directory(testDir);
+        for (int i = 0; i < 60; ++i) {
+            std::ofstream(testDir + "/same_" + std::to_string(i)) << "identical contents of one large class";
+            std::ofstream(testDir + "/pair_" + std::to_string(i) + "_a") << std::string(static_cast<size_t>(i + 1), 'p');
+            std::ofstream(testDir + "/pair_" + std::to_string(i) + "_b") << std::string(static_cast<size_t>(i + 1), 'p');
+            std::ofstream(testDir + "/other_" + std::to_string(i)) << "different contents of one large " << (i % 10);
+        }
+        std::ofstream(testDir + "/unique") << std::string(1000, 'u');
+        fs::create_hard_link(testDir + "/same_7", testDir + "/same_link");
+        fs::create_hard_link(testDir + "/pair_3_b", testDir + "/pair_link");
+
+        auto scan = [&](std::size_t maxMemory, const std::string& hash) {
+            std::ostringstream captured;
+            std::streambuf* original = std::cout.rdbuf(captured.rdbuf());
+            try {
+                ScanOptions options;
+                options.maxMemory = maxMemory;
+                options.hashAlgorithm = hash;
+                PurgeDuplicates(testDir, options).execute();
+            } catch (...) {
+                std::cout.rdbuf(original);
+                throw;
+            }
+            std::cout.rdbuf(original);
+            std::istringstream lines(captured.str());
+            std::vector<std::string> listed;
+            std::string line;
+            while (std::getline(lines, line)) {
+                if (line.compare(0, 2, "  ") == 0) {
+                    listed.push_back(line);
+                }
+            }
+            std::sort(listed.begin(), listed.end());
+            return listed;
+        };
+        const std::vector<std::string> inMemory = scan(0, "");
+        assert(inMemory.size() == 59 + 1 + 60 + 1 + 50);
+        assert(scan(4096, "") == inMemory);
+        // Matches of a non-cryptographic digest are verified pairwise against the kept original
+        for (const auto& name : HashAlgorithm::names()) {
+            if (!HashAlgorithm::byName(name).isCryptographic()) {
+                assert(scan(4096, name) == inMemory);
+            }
+        }
+        assert(std::find(inMemory.begin(), inMemory.end(), "  " + testDir + "/same_0") == inMemory.end());
+
+        ScanOptions live;
+        live.maxMemory = 4096;
+        live.liveRun = true;
+        PurgeDuplicates(testDir, live).execute();
+        assert(fs::exists(testDir + "/same_0") && !fs::exists(testDir + "/same_7") && !fs::exists(testDir + "/same_link"));
+        assert(fs::exists(testDir + "/pair_3_a") && !fs::exists(testDir + "/pair_link"));
+        assert(fs::exists(testDir + "/unique"));
+        assert(scan(0, "").empty());
+
+        std::cout << "Test Passed: External sort finds the same duplicates in bounded memory." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_path_store() {
+    try {
+        // Every path comes back byte for byte, whether the root ends with a slash, is "/" or is not an ancestor
+        for (const std::string root : {"scan", "scan/", "/"}) {
+            PathStore store(root);
+            const std::string base = root == "/" ? "/" : (root.back() == '/' ? root : root + "/");
+            const std::vector<std::string> paths = {
+                    base + "a", base + "dir/b", base + "dir/c", base + "dir/sub/d", base + "other/e",
+                    base + "dir/f", "elsewhere/g", "h", "/i"};
+            std::vector<PathRef> refs;
+            for (const auto& path : paths) {
+                refs.push_back(store.intern(path));
+            }
+            for (size_t i = 0; i < paths.size(); ++i) {
+                assert(store.path(refs[i]) == paths[i]);
+            }
+        }
+
+        // Names are shared by the files below them, each directory is stored once
+        PathStore store("root");
+        std::vector<PathRef> refs;
+        for (int i = 0; i < 1000; ++i) {
+            refs.push_back(store.intern("root/" + std::to_string(i % 10) + "/deep/file_" + std::to_string(i)));
+        }
+        assert(store.directories() == 1 + 10 + 10);
+        assert(store.path(refs[123]) == "root/3/deep/file_123");
+        std::string appended = "> ";
+        store.appendPath(refs[999], appended);
+        assert(appended == "> root/9/deep/file_999");
+        assert(store.memoryUsage() >= PathStore::kChunkSize);
+
+        // A text longer than a chunk gets a chunk of its own, the texts after it start a new one
+        const std::string longName = "outside/" + std::string(PathStore::kChunkSize + 1000, 'n') + "/file";
+        const PathRef longRef = store.intern(longName);
+        const PathRef shortRef = store.intern("outside/short/file");
+        const PathRef nextRef = store.intern("root/after/file");
+        assert(store.path(longRef) == longName);
+        assert(store.path(shortRef) == "outside/short/file");
+        assert(store.path(nextRef) == "root/after/file");
+        assert(store.path(refs[123]) == "root/3/deep/file_123");
+
+        std::cout << "Test Passed: Path store rebuilds every interned path." << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_reference_index() {
+    try {
+        const std::string testDir = "test_reference_index";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directories(testDir + "/archive/deep");
+        fs::create_directories(testDir + "/ingest/archive_copy");
+        const std::string large(20000, 'l');
+        std::ofstream(testDir + "/archive/small") << "archived";
+        std::ofstream(testDir + "/archive/deep/large") << large;
+        std::ofstream(testDir + "/archive/deep/large_again") << large;
+        std::ofstream(testDir + "/ingest/small_copy") << "archived";
+        std::ofstream(testDir + "/ingest/large_copy") << large;
+        std::ofstream(testDir + "/ingest/same_size") << std::string(20000, 'm');
+        std::ofstream(testDir + "/ingest/new") << "not archived";
+        fs::create_hard_link(testDir + "/ingest/large_copy", testDir + "/ingest/large_link");
+        // A path to the archived file itself from outside the archive is not a duplicate of it
+        fs::create_hard_link(testDir + "/archive/small", testDir + "/ingest/archive_copy/small");
+
+        const std::string indexPath = testDir + "/archive.idx";
+        ScanOptions build;
+        build.buildReference = indexPath;
+        PurgeDuplicates(testDir + "/archive", build).execute();
+
+        {
+            ReferenceIndex index(indexPath);
+            assert(index.root() == fs::weakly_canonical(testDir + "/archive").string());
+            assert(index.size() == 2 && index.sampleBlockSize() == build.sampleBlockSize);
+            assert(index.hasSize(large.size()) && !index.hasSize(large.size() + 1));
+            assert(index.covers(index.root()) && index.covers(index.root() + "/deep/large"));
+            assert(!index.covers(index.root() + "_other/file"));
+            FileEntry archived;
+            assert(FileWalker::describe(index.root() + "/deep/large", archived) && archived.size == large.size());
+        }
+
+        // The whole test directory holds the archive, which must survive a live run
+        ScanOptions check;
+        check.referenceIndex = indexPath;
+        check.liveRun = true;
+        PurgeDuplicates(testDir, check).execute();
+        assert(fs::exists(testDir + "/archive/small") && fs::exists(testDir + "/archive/deep/large"));
+        assert(fs::exists(testDir + "/archive/deep/large_again"));
+        assert(!fs::exists(testDir + "/ingest/small_copy") && !fs::exists(testDir + "/ingest/large_copy"));
+        assert(!fs::exists(testDir + "/ingest/large_link"));
+        assert(fs::exists(testDir + "/ingest/archive_copy/small"));
+        assert(fs::exists(testDir + "/ingest/same_size") && fs::exists(testDir + "/ingest/new"));
+
+        // Several directories checked against the index write one binary report with a single magic
+        fs::create_directories(testDir + "/first");
+        fs::create_directories(testDir + "/second");
+        std::ofstream(testDir + "/first/copy") << "archived";
+        std::ofstream(testDir + "/second/copy") << large;
+        {
+            std::ostringstream stream;
+            {
+                ScanOptions binary;
+                binary.referenceIndex = indexPath;
+                binary.reportFormat = ReportFormat::Binary;
+                ReportWriter report(binary.reportFormat, stream);
+                for (const std::string& target : {testDir + "/first", testDir + "/second"}) {
+                    PurgeDuplicates scan(target, binary);
+                    scan.shareReport(report);
+                    scan.execute();
+                }
+            }
+            const std::string bytes = stream.str();
+            assert(bytes.compare(0, 8, "RMDUPRP1") == 0 && bytes.find("RMDUPRP1", 8) == std::string::npos);
+            std::vector<int> types;
+            for (std::size_t offset = 8; offset + 5 <= bytes.size();) {
+                std::uint32_t length = 0;
+                for (int b = 0; b < 4; ++b) {
+                    length |= static_cast<std::uint32_t>(static_cast<unsigned char>(bytes[offset + 1 + b])) << (8 * b);
+                }
+                types.push_back(bytes[offset]);
+                offset += 5 + length;
+                assert(offset <= bytes.size());
+            }
+            assert((types == std::vector<int>{1, 2, 4, 1, 2, 4}));
+        }
+        assert(fs::exists(testDir + "/first/copy") && fs::exists(testDir + "/second/copy"));
+
+        // A reference file rewritten in place with its old size and modification time is no longer trusted
+        const auto indexedTime = fs::last_write_time(testDir + "/archive/small");
+        std::ofstream(testDir + "/archive/small", std::ios::trunc) << "archivez";
+        fs::last_write_time(testDir + "/archive/small", indexedTime);
+        PurgeDuplicates(testDir + "/first", check).execute();
+        assert(fs::exists(testDir + "/first/copy"));
+
+        // Checking a directory inside the archive is refused, and so is a file that is not an index
+        bool refused = false;
+        try {
+            PurgeDuplicates(testDir + "/archive/deep", check).execute();
+        } catch (const std::invalid_argument&) {
+            refused = true;
+        }
+        assert(refused);
+
+        std::ofstream(indexPath, std::ios::trunc) << "not an index";
+        bool rejected = false;
+        try {
+            ReferenceIndex index(indexPath);
+        } catch (const std::runtime_error&) {
+            rejected = true;
+        }
+        assert(rejected);
+
+        std::cout << "Test Passed: Reference index removes archived content and never touches the archive." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_scan_listener() {
+    try {
+        const std::string testDir = "test_scan_listener";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directories(testDir + "/nested");
+        std::ofstream(testDir + "/a1") << "alpha";
+        std::ofstream(testDir + "/a2") << "alpha";
+        std::ofstream(testDir + "/nested/a3") << "alpha";
+        std::ofstream(testDir + "/b1") << "beta payload";
+        std::ofstream(testDir + "/nested/b2") << "beta payload";
+        std::ofstream(testDir + "/unique") << "gamma";
+
+        // Sets arrive as they are confirmed, labelled with their digest
+        std::vector<DuplicateSet> groups;
+        size_t labelled = 0;
+        ScanListener listener;
+        listener.onGroup = [&](const DuplicateSet& set, const Digest* digest) {
+            groups.push_back(set);
+            labelled += digest != nullptr ? 1 : 0;
+        };
+        PurgeDuplicates(testDir, ScanOptions(), listener).execute();
+        assert(groups.size() == 2 && labelled == 2);
+        size_t duplicates = 0;
+        for (const auto& set : groups) {
+            duplicates += set.members.size();
+            assert(set.original == testDir + (set.size == 5 ? "/a1" : "/b1"));
+        }
+        assert(duplicates == 3);
+
+        // Cancelling from the callback stops the scan before anything is removed
+        ScanOptions live;
+        live.liveRun = true;
+        size_t delivered = 0;
+        PurgeDuplicates scan(testDir, live, ScanListener{[&](const DuplicateSet&, const Digest*) {
+            ++delivered;
+            scan.cancel();
+        }, nullptr});
+        scan.execute();
+        assert(scan.isCancelled() && delivered >= 1);
+        for (const char* name : {"/a1", "/a2", "/nested/a3", "/b1", "/nested/b2", "/unique"}) {
+            assert(fs::exists(testDir + name));
+        }
+
+        // A scan cancelled up front delivers nothing
+        delivered = 0;
+        PurgeDuplicates idle(testDir, live, ScanListener{[&](const DuplicateSet&, const Digest*) {
+            ++delivered;
+        }, nullptr});
+        idle.cancel();
+        idle.execute();
+        assert(delivered == 0 && fs::exists(testDir + "/a2"));
+
+        std::cout << "Test Passed: Scan listener receives groups as they are confirmed and cancellation stops the scan." << std::endl;
+        fs::remove_all(testDir);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
+void test_scan_stats() {
+    try {
+        const std::string testDir = "test_scan_stats";
+        if (fs::exists(testDir)) {
+            fs::remove_all(testDir);
+        }
+        fs::create_directories(testDir + "/nested");
+        const std::string large(3 * 4096, 'x');
+        std::ofstream(testDir + "/a1") << "alpha";
+        std::ofstream(testDir + "/nested/a2") << "alpha";
+        std::ofstream(testDir + "/l1") << large;
+        std::ofstream(testDir + "/l2") << large;
+        std::ofstream(testDir + "/unique") << "gamma payload";
+
+        // Every scan records its figures, whether or not they are printed
+        const std::string statsPath = testDir + ".json";
+        fs::remove(statsPath);
+        ScanOptions options;
+        options.compareMode = CompareMode::Hash;
+        options.statsPath = statsPath;
+        PurgeDuplicates scan(testDir, options);
+        scan.execute();
+        const ScanStats& stats = scan.stats();
+        assert(stats.counter(StatCounter::DirectoryOpens) == 2);
+        assert(stats.counter(StatCounter::StatCalls) >= 5);
+        assert(stats.counter(StatCounter::FilesOpened) == 6);
+        assert(stats.counter(StatCounter::BytesRead) == 2 * 5 + 2 * 2 * 4096 + 2 * large.size());
+        assert(stats.latencyCount(StatLatency::PartialHash) == 4);
+        assert(stats.latencyCount(StatLatency::FullHash) == 2);
+        assert(stats.latencyPercentile(StatLatency::FullHash, 0.5) >= 1);
+        assert(stats.errorCount() == 0 && stats.syscallCount() > 0);
+        double phases = 0;
+        for (ScanPhase phase : {ScanPhase::Traversal, ScanPhase::SizeGrouping, ScanPhase::PartialHash,
+                                ScanPhase::FullHash, ScanPhase::Compare, ScanPhase::Action, ScanPhase::Other}) {
+            phases += stats.phaseSeconds(phase);
+        }
+        assert(stats.phaseSeconds(ScanPhase::Traversal) > 0 && stats.phaseSeconds(ScanPhase::FullHash) > 0);
+        assert(phases <= stats.wallSeconds() + 1e-6);
+        assert(stats.peakRssBytes() > 0);
+
+        // One JSON line per scan, appended
+        PurgeDuplicates(testDir, options).execute();
+        std::ifstream json(statsPath);
+        std::string line;
+        size_t lines = 0;
+        while (std::getline(json, line)) {
+            ++lines;
+            assert(line.find("{\"type\":\"stats\"") == 0 && line.back() == '}');
+            assert(line.find("\"files_opened\":6") != std::string::npos);
+            assert(line.find("\"partial_hash\":{\"count\":4") != std::string::npos);
+        }
+        assert(lines == 2);
+
+        // Errors are counted by kind; a directory in place of the cache file can be neither read nor saved
+        const std::string cacheDir = testDir + "_cache";
+        fs::create_directories(cacheDir);
+        ScanOptions cached;
+        cached.cachePath = cacheDir;
+        size_t reported = 0;
+        PurgeDuplicates broken(testDir, cached, ScanListener{nullptr, [&](const std::string&, const std::string&) {
+            ++reported;
+        }});
+        broken.execute();
+        assert(reported == 2 && broken.stats().errors(ScanErrorKind::Cache) == 2 && broken.stats().errorCount() == 2);
+        assert(broken.stats().counter(StatCounter::CacheMisses) == 4);
+        fs::remove_all(cacheDir);
+
+        std::cout << "Test Passed: Scan statistics record phases, I/O counters, latencies and JSON output." << std::endl;
+        fs::remove_all(testDir);
+        fs::remove(statsPath);
+    } catch (const std::exception& e) {
+        std::cerr << "Test Failed: " << e.what() << std::endl;
+    }
+}
+
 void test_invalid_directory() {
     try {
         PurgeDuplicates pd("non_existent_directory", false,true);
@@ -317,11 +1787,35 @@ void test_live_and_dry_run() {
 int main() {
     // Run all unit tests
     test_main_argument_parsing();
+    test_byte_sizes();
     test_generate_hash();
     test_progress_display();
     test_identify_and_remove_duplicates();
     test_identify_and_remove_binary_duplicates();
     test_identify_and_remove_nested_duplicates();
+    test_same_size_distinct_files();
+    test_partial_hash_tiers();
+    test_digest_table();
+    test_worker_pool();
+    test_file_walker();
+    test_read_backends();
+    test_uring_engine();
+    test_hash_cache();
+    test_hardlinks();
+    test_hardlink_original_is_stable();
+    test_content_comparer();
+    test_hash_algorithms();
+    test_compare_modes();
+    test_read_order();
+    test_reflink_action();
+    test_hardlink_action();
+    test_report_writer();
+    test_progress_renderer();
+    test_external_sort();
+    test_path_store();
+    test_reference_index();
+    test_scan_listener();
+    test_scan_stats();
     test_invalid_directory();
     test_permission_denied();
 